@@ -0,0 +1,732 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+/* The benchmark works on the internal primitives of the library, with the keys and the loopback reader of the tests */
+#include "fixture.h"
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+static double nowSeconds(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+static void benchCRC16(void)
+{
+	static const DWORD SIZES[] = { 16, 64, 256, 1024, 4096 };
+	static BYTE data[4096];
+	DWORD b, s;
+
+	memset(data, 0xA5, sizeof(data));
+
+	for (s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); s++)
+	{
+		DWORD size = SIZES[s];
+		DWORD loops = (64UL * 1024 * 1024) / size;
+		double t0, t1;
+		DWORD i;
+		BYTE crc[2];
+
+		t0 = nowSeconds();
+		for (i = 0; i < loops / 16; i++)
+			referenceCRC16(data, size, crc);
+		t1 = nowSeconds();
+		printf("crc16 %-6s %5lu bytes: %8.1f MB/s\n", "serial", (unsigned long)size, (double)size * (loops / 16) / (t1 - t0) / 1e6);
+
+		for (b = 0; b < sizeof(CRC16_BACKENDS) / sizeof(CRC16_BACKENDS[0]); b++)
+		{
+			volatile WORD sink = 0;
+
+			if (!SSCP_CRC16_SetBackend(CRC16_BACKENDS[b].backend))
+				continue;
+
+			t0 = nowSeconds();
+			for (i = 0; i < loops; i++)
+				sink ^= SSCP_CRC16_Update(SSCP_CRC16_Init(), data, size);
+			t1 = nowSeconds();
+			printf("crc16 %-6s %5lu bytes: %8.1f MB/s\n", CRC16_BACKENDS[b].name, (unsigned long)size, (double)size * loops / (t1 - t0) / 1e6);
+		}
+	}
+
+	SSCP_CRC16_SetBackend(SSCP_CRC16_BACKEND_AUTO);
+}
+
+static void benchAES(void)
+{
+	static BYTE data[4096];
+	DWORD loops = 4096;
+	AES_CTX_ST ctx;
+	DWORD b, i, j;
+
+	memset(data, 0x5A, sizeof(data));
+
+	for (b = 0; b < sizeof(AES_BACKENDS) / sizeof(AES_BACKENDS[0]); b++)
+	{
+		double t0, t1, t2, t3;
+		BYTE iv[16];
+
+		if (!AES_SetBackend(AES_BACKENDS[b].backend))
+			continue;
+
+		AES_Init(&ctx, FIXTURE_KEY_C);
+		memset(iv, 0, sizeof(iv));
+
+		t0 = nowSeconds();
+		for (i = 0; i < loops; i++)
+			for (j = 0; j < sizeof(data); j += 16)
+				AES_Encrypt(&ctx, &data[j]);
+		t1 = nowSeconds();
+		for (i = 0; i < loops; i++)
+			for (j = 0; j < sizeof(data); j += 16)
+				AES_Decrypt(&ctx, &data[j]);
+		t2 = nowSeconds();
+		for (i = 0; i < loops; i++)
+			AES_DecryptCBC(&ctx, iv, data, sizeof(data) / 16);
+		t3 = nowSeconds();
+
+		printf("aes   %-7s encrypt %7.1f MB/s, decrypt %7.1f MB/s, cbc decrypt %7.1f MB/s\n", AES_BACKENDS[b].name,
+			(double)sizeof(data) * loops / (t1 - t0) / 1e6, (double)sizeof(data) * loops / (t2 - t1) / 1e6, (double)sizeof(data) * loops / (t3 - t2) / 1e6);
+		/* What competes with the application for the L1 cache: the tables, and the context holding the key schedules */
+		printf("      %-7s tables %5lu bytes, context %4lu bytes\n", "", (unsigned long)AES_TablesSize(AES_BACKENDS[b].backend), (unsigned long)sizeof(AES_CTX_ST));
+	}
+
+	AES_SetBackend(AES_BACKEND_AUTO);
+}
+
+static void benchSHA256(void)
+{
+	static BYTE data[4096];
+	HMAC_SHA256_CTX_ST sign;
+	SHA256_CTX_ST ctx;
+	DWORD loops = 4096;
+	BYTE digest[32];
+	DWORD b, i;
+
+	memset(data, 0x3C, sizeof(data));
+	HMAC_SHA256_Prepare(&sign, data, 16);
+
+	for (b = 0; b < sizeof(SHA256_BACKENDS) / sizeof(SHA256_BACKENDS[0]); b++)
+	{
+		double t0, t1, t2;
+
+		if (!SHA256_SetBackend(SHA256_BACKENDS[b].backend))
+			continue;
+
+		t0 = nowSeconds();
+		for (i = 0; i < loops; i++)
+		{
+			SHA256_Init(&ctx);
+			SHA256_Update(&ctx, data, sizeof(data));
+			SHA256_Final(&ctx, digest);
+		}
+		t1 = nowSeconds();
+		/* A short command or response */
+		for (i = 0; i < 64 * loops; i++)
+			HMAC_SHA256_Compute(&sign, data, 32, digest);
+		t2 = nowSeconds();
+
+		printf("sha256 %-6s %7.1f MB/s, hmac of 32 bytes %6.0f ns\n", SHA256_BACKENDS[b].name, (double)sizeof(data) * loops / (t1 - t0) / 1e6, (t2 - t1) * 1e9 / (64.0 * loops));
+	}
+
+	SHA256_SetBackend(SHA256_BACKEND_AUTO);
+}
+
+/* A polling sweep: one short command per reader, each reader with its own session key */
+static void benchHMACBatch(void)
+{
+	static const DWORD SIZES[] = { 48, 112, 304 };
+	static HMAC_SHA256_CTX_ST keys[BATCH_MESSAGES];
+	static HMAC_SHA256_JOB_ST jobs[BATCH_MESSAGES];
+	static BYTE data[BATCH_MESSAGES][304], digests[BATCH_MESSAGES][32];
+	DWORD loops = 2000;
+	DWORD b, s, i, j;
+
+	for (i = 0; i < BATCH_MESSAGES; i++)
+	{
+		memset(data[i], (int)i, sizeof(data[i]));
+		HMAC_SHA256_Prepare(&keys[i], data[i], 16);
+	}
+
+	for (b = 0; b < sizeof(SHA256_BACKENDS) / sizeof(SHA256_BACKENDS[0]); b++)
+	{
+		if (!SHA256_SetBackend(SHA256_BACKENDS[b].backend))
+			continue;
+
+		for (s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); s++)
+		{
+			double t0, t1, t2;
+
+			for (i = 0; i < BATCH_MESSAGES; i++)
+			{
+				jobs[i].key = &keys[i];
+				jobs[i].data = data[i];
+				jobs[i].length = SIZES[s];
+				jobs[i].digest = digests[i];
+			}
+
+			t0 = nowSeconds();
+			for (j = 0; j < loops; j++)
+				for (i = 0; i < BATCH_MESSAGES; i++)
+					HMAC_SHA256_Compute(jobs[i].key, jobs[i].data, jobs[i].length, jobs[i].digest);
+			t1 = nowSeconds();
+			for (j = 0; j < loops; j++)
+				HMAC_SHA256_ComputeBatch(jobs, BATCH_MESSAGES);
+			t2 = nowSeconds();
+
+			printf("hmac %-6s %3lu readers x %3lu bytes: one by one %6.0f ns, batch %6.0f ns per reader\n", SHA256_BACKENDS[b].name, (unsigned long)BATCH_MESSAGES,
+				(unsigned long)SIZES[s], (t1 - t0) * 1e9 / ((double)loops * BATCH_MESSAGES), (t2 - t1) * 1e9 / ((double)loops * BATCH_MESSAGES));
+		}
+	}
+
+	SHA256_SetBackend(SHA256_BACKEND_AUTO);
+}
+
+static void benchProviders(void)
+{
+	static const DWORD SIZES[] = { 64, 256, 4000 };
+	static BYTE plain[SSCP_MAX_PAYLOAD_SIZE], work[SSCP_MAX_PAYLOAD_SIZE];
+	SSCP_CTX_ST* ctx;
+	DWORD p, s;
+
+	ctx = SSCP_Alloc();
+	if (ctx == NULL)
+		return;
+
+	for (p = 0; p < sizeof(PROVIDER_NAMES) / sizeof(PROVIDER_NAMES[0]); p++)
+	{
+		if (SSCP_SetCryptoProvider(ctx, p) != SSCP_SUCCESS)
+			continue;
+		SSCP_ComputeSessionKeys(ctx, FIXTURE_KEY_C, FIXTURE_KEY_S, FIXTURE_IV);
+
+		for (s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); s++)
+		{
+			DWORD sz = makeResponse(plain, SIZES[s]);
+			DWORD loops = (16UL * 1024 * 1024) / sz;
+			BYTE hmac[32];
+			double t0, t1, t2;
+			DWORD i;
+
+			/* Command side: sign then encrypt */
+			t0 = nowSeconds();
+			for (i = 0; i < loops; i++)
+			{
+				memcpy(work, plain, sz);
+				ctx->crypto->sign(ctx, work, sz, hmac);
+				ctx->crypto->cipher(ctx, FIXTURE_IV, work, sz);
+			}
+			t1 = nowSeconds();
+			/* Response side: decrypt and check */
+			for (i = 0; i < loops; i++)
+			{
+				memcpy(work, plain, sz);
+				ctx->crypto->decipher(ctx, FIXTURE_IV, work, sz);
+				ctx->crypto->verify(ctx, work, SSCP_SignedResponseSz(work, sz), hmac);
+			}
+			t2 = nowSeconds();
+
+			printf("%-7s %5lu bytes: command %7.1f MB/s, response %7.1f MB/s\n", PROVIDER_NAMES[p], (unsigned long)sz, (double)sz * loops / (t1 - t0) / 1e6, (double)sz * loops / (t2 - t1) / 1e6);
+		}
+	}
+
+	SSCP_Free(ctx);
+}
+
+static void benchRandom(void)
+{
+	static SSCP_DRBG_ST drbg;
+	DWORD i, loops = 200000;
+	BYTE iv[16];
+	double t0, t1, t2;
+
+	t0 = nowSeconds();
+	for (i = 0; i < loops; i++)
+		SSCP_GetRandom(iv, 16);
+	t1 = nowSeconds();
+	for (i = 0; i < loops; i++)
+		SSCP_DRBG_Generate(&drbg, iv, 16);
+	t2 = nowSeconds();
+
+	printf("16-byte IV: system %6.0f ns, DRBG %6.0f ns\n", (t1 - t0) / loops * 1e9, (t2 - t1) / loops * 1e9);
+
+	SSCP_DRBG_Clear(&drbg);
+}
+
+/* The cryptography of an authentication: hB, hA and the session keys */
+static void benchKeyStore(void)
+{
+	static const char* SERIALS[256];
+	static char serials[256][16];
+	static DWORD handles[256];
+	SSCP_CTX_ST* ctx = SSCP_Alloc();
+	SSCP_KEYSTORE_ST* store = SSCP_KeyStoreAlloc(257);
+	SSCP_AUTH_KEY_ST authKey;
+	BYTE message[40] = { 0 }, rnd[16] = { 0 }, hmac[32];
+	DWORD i, master, loops = 20000;
+	double t0, t1, t2, t3, t4;
+
+	if ((ctx == NULL) || (store == NULL))
+		return;
+
+	SSCP_KeyStoreAdd(store, DIVERSIFY_MASTER, &master);
+	for (i = 0; i < 256; i++)
+	{
+		sprintf(serials[i], "%08lX", (unsigned long)(0x5A000000UL + i * 7919));
+		SERIALS[i] = serials[i];
+	}
+
+	t0 = nowSeconds();
+	for (i = 0; i < loops; i++)
+	{
+		SSCP_HMAC(DIVERSIFY_MASTER, message, 40, hmac);
+		SSCP_HMAC(DIVERSIFY_MASTER, message, 20, hmac);
+		SSCP_ComputeSessionKeys(ctx, DIVERSIFY_MASTER, rnd, rnd);
+	}
+	t1 = nowSeconds();
+	for (i = 0; i < loops; i++)
+	{
+		SSCP_PrepareAuthKey(&authKey, DIVERSIFY_MASTER);
+		SSCP_AuthKeyHMAC(ctx, &authKey, message, 40, hmac);
+		SSCP_AuthKeyHMAC(ctx, &authKey, message, 20, hmac);
+		SSCP_ComputeSessionKeys_Ctx(ctx, &authKey.kp, rnd, rnd);
+	}
+	t2 = nowSeconds();
+	for (i = 0; i < loops; i++)
+	{
+		SSCP_AUTH_KEY_ST* stored = SSCP_KeyStoreGet(store, master);
+		SSCP_AuthKeyHMAC(ctx, stored, message, 40, hmac);
+		SSCP_AuthKeyHMAC(ctx, stored, message, 20, hmac);
+		SSCP_ComputeSessionKeys_Ctx(ctx, &stored->kp, rnd, rnd);
+	}
+	t3 = nowSeconds();
+	for (i = 0; i < loops / 256; i++)
+	{
+		SSCP_KeyStoreFree(store);
+		store = SSCP_KeyStoreAlloc(257);
+		SSCP_KeyStoreAdd(store, DIVERSIFY_MASTER, &master);
+		SSCP_KeyStoreDiversify(store, master, SERIALS, 256, handles);
+	}
+	t4 = nowSeconds();
+
+	printf("authentication crypto: one-shot %5.0f ns, raw key %5.0f ns, key store %5.0f ns\n", (t1 - t0) / loops * 1e9, (t2 - t1) / loops * 1e9, (t3 - t2) / loops * 1e9);
+	printf("diversified key: %5.0f ns per reader, batch of 256\n", (t4 - t3) / ((loops / 256) * 256) * 1e9);
+
+	memset(&authKey, 0, sizeof(authKey));
+	SSCP_KeyStoreFree(store);
+	SSCP_Free(ctx);
+}
+
+/* The cryptography of the host for one MACed command with its response, then the same command in full mode */
+static void benchDESFire(void)
+{
+	AES_CMAC_CTX_ST sesMac;
+	AES_CTX_ST sesEnc;
+	AES_CMAC_STATE_ST state;
+	BYTE frame[64] = { 0 }, iv[16], mac[16];
+	DWORD i, loops = 200000;
+	double t0, t1, t2;
+
+	AES_CMAC_Prepare(&sesMac, FIXTURE_KEY_C);
+	AES_Init(&sesEnc, FIXTURE_KEY_S);
+
+	t0 = nowSeconds();
+	for (i = 0; i < loops; i++)
+	{
+		AES_CMAC_Init(&state);
+		AES_CMAC_Update(&sesMac, &state, frame, 15);
+		AES_CMAC_Final(&sesMac, &state, mac);
+		AES_CMAC_Init(&state);
+		AES_CMAC_Update(&sesMac, &state, frame, 7 + 32);
+		AES_CMAC_Final(&sesMac, &state, mac);
+	}
+	t1 = nowSeconds();
+	for (i = 0; i < loops; i++)
+	{
+		memcpy(iv, FIXTURE_IV, 16);
+		AES_Encrypt(&sesEnc, iv);
+		AES_CMAC_Compute(&sesMac, frame, 15, mac);
+		memcpy(iv, FIXTURE_IV, 16);
+		AES_Encrypt(&sesEnc, iv);
+		AES_CMAC_Compute(&sesMac, frame, 7 + 48, mac);
+		AES_DecryptCBC(&sesEnc, iv, &frame[16], 3);
+	}
+	t2 = nowSeconds();
+
+	printf("DESFire EV2 ReadData, 32 bytes: MAC %5.0f ns, full %5.0f ns\n", (t1 - t0) / loops * 1e9, (t2 - t1) / loops * 1e9);
+}
+
+/* Cost of the protocol stack alone, per exchange */
+static void benchLoopback(void)
+{
+	SSCP_CTX_ST* ctx = openLoopback();
+	BYTE version, baudrate, address;
+	WORD voltage;
+	DWORD i, loops = 20000;
+	double t0, t1;
+
+	if (ctx == NULL)
+		return;
+
+	t0 = nowSeconds();
+	for (i = 0; i < loops; i++)
+		SSCP_GetInfos(ctx, &version, &baudrate, &address, &voltage);
+	t1 = nowSeconds();
+
+	/* The reader's own work (decipher, HMAC, cipher) is in the figure too */
+	printf("GET_INFOS over loopback: %5.0f ns per exchange, reader included\n", (t1 - t0) / loops * 1e9);
+
+	SSCP_Free(ctx);
+}
+
+/*
+ * Primitive suite
+ * ---------------
+ *
+ * Every primitive the protocol uses, with every backend compiled in, at the sizes of SSCP frames (16 bytes to 4 KB).
+ * Operations per second come from the monotonic clock, cycles from the time-stamp counter on x86 (reference cycles,
+ * they drift from core cycles when the CPU is not at its nominal frequency). --json <file> writes the results.
+ */
+
+#if SSCP_HAVE_X86_INTRINSICS
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+static const DWORD SUITE_SIZES[] = { 16, 64, 256, 1024, 4096 };
+
+#define SUITE_MAX_RESULTS 256
+
+typedef struct
+{
+	const char* primitive;
+	const char* backend;
+	DWORD size; /* Bytes per operation, 0 for a fixed-size operation */
+	double opsPerSecond;
+	double cyclesPerOp; /* 0 when there is no cycle counter */
+} SUITE_RESULT_ST;
+
+static SUITE_RESULT_ST suiteResults[SUITE_MAX_RESULTS];
+static DWORD suiteResultCount;
+
+/* What the operations work on */
+static BYTE suiteData[4096];
+static BYTE suiteOut[32];
+static AES_CTX_ST suiteAES;
+static SSCP_CTX_ST* suiteCtx;
+
+static BOOL haveCycles(void)
+{
+#if SSCP_HAVE_X86_INTRINSICS
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+static unsigned long long nowCycles(void)
+{
+#if SSCP_HAVE_X86_INTRINSICS
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void suiteAESEncrypt(DWORD size)
+{
+	DWORD j;
+
+	for (j = 0; j < size; j += 16)
+		AES_Encrypt(&suiteAES, &suiteData[j]);
+}
+
+static void suiteCipher(DWORD size)
+{
+	SSCP_Cipher(FIXTURE_KEY_C, FIXTURE_IV, suiteData, size);
+}
+
+static void suiteDecipher(DWORD size)
+{
+	SSCP_Decipher(FIXTURE_KEY_C, FIXTURE_IV, suiteData, size);
+}
+
+static void suiteSHA256(DWORD size)
+{
+	SHA256_CTX_ST sha256_ctx;
+
+	SHA256_Init(&sha256_ctx);
+	SHA256_Update(&sha256_ctx, suiteData, size);
+	SHA256_Final(&sha256_ctx, suiteOut);
+}
+
+static void suiteHMAC(DWORD size)
+{
+	SSCP_HMAC(FIXTURE_KEY_S, suiteData, size, suiteOut);
+}
+
+static void suiteSessionKeys(DWORD size)
+{
+	(void)size;
+	SSCP_ComputeSessionKeys(suiteCtx, FIXTURE_KEY_C, FIXTURE_IV, suiteData);
+}
+
+static void suiteCRC16(DWORD size)
+{
+	SSCP_CRC16_Final(SSCP_CRC16_Update(SSCP_CRC16_Init(), suiteData, size), suiteOut);
+}
+
+#if SSCP_WITH_OPENSSL
+static void suiteProviderCipher(DWORD size)
+{
+	suiteCtx->crypto->cipher(suiteCtx, FIXTURE_IV, suiteData, size);
+}
+
+static void suiteProviderDecipher(DWORD size)
+{
+	suiteCtx->crypto->decipher(suiteCtx, FIXTURE_IV, suiteData, size);
+}
+
+static void suiteProviderSign(DWORD size)
+{
+	suiteCtx->crypto->sign(suiteCtx, suiteData, size, suiteOut);
+}
+#endif
+
+/* Run fn until it has taken 20 ms at least, and keep the rate */
+static void suiteRun(const char* primitive, const char* backend, DWORD size, void (*fn)(DWORD size))
+{
+	SUITE_RESULT_ST* result;
+	unsigned long long c0, c1;
+	double t0, t1;
+	DWORD loops, i;
+
+	for (loops = 16; ; loops *= 4)
+	{
+		t0 = nowSeconds();
+		c0 = nowCycles();
+		for (i = 0; i < loops; i++)
+			fn(size);
+		c1 = nowCycles();
+		t1 = nowSeconds();
+
+		if ((t1 - t0 >= 0.02) || (loops >= (1UL << 28)))
+			break;
+	}
+
+	if (suiteResultCount >= SUITE_MAX_RESULTS)
+		return;
+	result = &suiteResults[suiteResultCount++];
+	result->primitive = primitive;
+	result->backend = backend;
+	result->size = size;
+	result->opsPerSecond = loops / (t1 - t0);
+	result->cyclesPerOp = haveCycles() ? (double)(c1 - c0) / loops : 0;
+
+	if (size > 0)
+		printf("%-14s %-8s %5lu bytes: %10.0f op/s", primitive, backend, (unsigned long)size, result->opsPerSecond);
+	else
+		printf("%-14s %-8s %11s: %10.0f op/s", primitive, backend, "", result->opsPerSecond);
+	if (size > 0)
+		printf(", %8.1f MB/s", result->opsPerSecond * size / 1e6);
+	if (haveCycles())
+	{
+		printf(", %9.0f cycles/op", result->cyclesPerOp);
+		if (size > 0)
+			printf(", %6.2f cycles/byte", result->cyclesPerOp / size);
+	}
+	printf("\n");
+}
+
+/* Same function, each size */
+static void suiteRunSizes(const char* primitive, const char* backend, void (*fn)(DWORD size))
+{
+	DWORD s;
+
+	for (s = 0; s < sizeof(SUITE_SIZES) / sizeof(SUITE_SIZES[0]); s++)
+		suiteRun(primitive, backend, SUITE_SIZES[s], fn);
+}
+
+static void benchSuite(void)
+{
+	DWORD b;
+
+	suiteResultCount = 0;
+	memset(suiteData, 0x3C, sizeof(suiteData));
+	suiteCtx = SSCP_Alloc();
+	if (suiteCtx == NULL)
+		return;
+
+	for (b = 0; b < sizeof(AES_BACKENDS) / sizeof(AES_BACKENDS[0]); b++)
+	{
+		if (!AES_SetBackend(AES_BACKENDS[b].backend))
+			continue;
+
+		AES_InitEncrypt(&suiteAES, FIXTURE_KEY_C);
+		suiteRunSizes("aes_encrypt", AES_BACKENDS[b].name, suiteAESEncrypt);
+		suiteRunSizes("sscp_cipher", AES_BACKENDS[b].name, suiteCipher);
+		suiteRunSizes("sscp_decipher", AES_BACKENDS[b].name, suiteDecipher);
+		suiteRun("session_keys", AES_BACKENDS[b].name, 0, suiteSessionKeys);
+	}
+	AES_SetBackend(AES_BACKEND_AUTO);
+
+	for (b = 0; b < sizeof(SHA256_BACKENDS) / sizeof(SHA256_BACKENDS[0]); b++)
+	{
+		if (!SHA256_SetBackend(SHA256_BACKENDS[b].backend))
+			continue;
+
+		suiteRunSizes("sha256", SHA256_BACKENDS[b].name, suiteSHA256);
+		suiteRunSizes("sscp_hmac", SHA256_BACKENDS[b].name, suiteHMAC);
+	}
+	SHA256_SetBackend(SHA256_BACKEND_AUTO);
+
+	for (b = 0; b < sizeof(CRC16_BACKENDS) / sizeof(CRC16_BACKENDS[0]); b++)
+	{
+		if (!SSCP_CRC16_SetBackend(CRC16_BACKENDS[b].backend))
+			continue;
+
+		suiteRunSizes("crc16", CRC16_BACKENDS[b].name, suiteCRC16);
+	}
+	SSCP_CRC16_SetBackend(SSCP_CRC16_BACKEND_AUTO);
+
+#if SSCP_WITH_OPENSSL
+	if (openProvider(suiteCtx, SSCP_CRYPTO_PROVIDER_OPENSSL))
+	{
+		suiteRunSizes("sscp_cipher", PROVIDER_NAMES[SSCP_CRYPTO_PROVIDER_OPENSSL], suiteProviderCipher);
+		suiteRunSizes("sscp_decipher", PROVIDER_NAMES[SSCP_CRYPTO_PROVIDER_OPENSSL], suiteProviderDecipher);
+		suiteRunSizes("sscp_hmac", PROVIDER_NAMES[SSCP_CRYPTO_PROVIDER_OPENSSL], suiteProviderSign);
+	}
+#endif
+
+	SSCP_Free(suiteCtx);
+	suiteCtx = NULL;
+}
+
+/* One object per result; a field that cannot be measured here is null */
+static BOOL writeSuiteJSON(const char* fileName)
+{
+	FILE* f = fopen(fileName, "w");
+	DWORD i;
+
+	if (f == NULL)
+		return FALSE;
+
+	fprintf(f, "{\n");
+	fprintf(f, "  \"benchmark\": \"sscp-bench-crypto\",\n");
+	fprintf(f, "  \"time\": %lu,\n", (unsigned long)time(NULL));
+#if defined(__VERSION__)
+	fprintf(f, "  \"compiler\": \"%s\",\n", __VERSION__);
+#else
+	fprintf(f, "  \"compiler\": null,\n");
+#endif
+	fprintf(f, "  \"cpu_features\": %lu,\n", (unsigned long)SSCP_GetCpuFeatures());
+	fprintf(f, "  \"cycle_counter\": %s,\n", haveCycles() ? "\"tsc\"" : "null");
+	fprintf(f, "  \"results\": [\n");
+
+	for (i = 0; i < suiteResultCount; i++)
+	{
+		const SUITE_RESULT_ST* r = &suiteResults[i];
+
+		fprintf(f, "    { \"primitive\": \"%s\", \"backend\": \"%s\", \"size\": %lu, \"ops_per_second\": %.1f", r->primitive, r->backend, (unsigned long)r->size, r->opsPerSecond);
+		if (r->size > 0)
+			fprintf(f, ", \"bytes_per_second\": %.0f", r->opsPerSecond * r->size);
+		else
+			fprintf(f, ", \"bytes_per_second\": null");
+		if (haveCycles())
+			fprintf(f, ", \"cycles_per_op\": %.1f", r->cyclesPerOp);
+		else
+			fprintf(f, ", \"cycles_per_op\": null");
+		if (haveCycles() && (r->size > 0))
+			fprintf(f, ", \"cycles_per_byte\": %.3f", r->cyclesPerOp / r->size);
+		else
+			fprintf(f, ", \"cycles_per_byte\": null");
+		fprintf(f, " }%s\n", (i + 1 < suiteResultCount) ? "," : "");
+	}
+
+	fprintf(f, "  ]\n");
+	fprintf(f, "}\n");
+
+	return (fclose(f) == 0) ? TRUE : FALSE;
+}
+
+/* Each comparison; the suite is the one --suite keeps */
+static const struct
+{
+	const char* name;
+	void (*bench)(void);
+} STEPS[] = {
+	{ "CRC16", benchCRC16 },
+	{ "AES", benchAES },
+	{ "SHA-256", benchSHA256 },
+	{ "HMAC batch", benchHMACBatch },
+	{ "Crypto provider", benchProviders },
+	{ "DRBG", benchRandom },
+	{ "Key store", benchKeyStore },
+	{ "DESFire EV2 crypto", benchDESFire },
+	{ "Loopback exchange", benchLoopback },
+	{ "Primitive suite", benchSuite }
+};
+
+/*
+ * sscp-bench-crypto [--suite] [--json <file>]
+ *
+ * --suite runs the primitive suite only, --json writes the results of the suite to a file. The results are checked by
+ * sscp-host-tests, not here.
+ */
+int main(int argc, char** argv)
+{
+	const char* jsonFileName = NULL;
+	BOOL suiteOnly = FALSE;
+	DWORD i;
+	int a;
+
+	for (a = 1; a < argc; a++)
+	{
+		if (!strcmp(argv[a], "--suite"))
+		{
+			suiteOnly = TRUE;
+		}
+		else if (!strcmp(argv[a], "--json") && (a + 1 < argc))
+		{
+			jsonFileName = argv[++a];
+		}
+		else
+		{
+			printf("usage: %s [--suite] [--json <file>]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < sizeof(STEPS) / sizeof(STEPS[0]); i++)
+	{
+		if (suiteOnly && (STEPS[i].bench != benchSuite))
+			continue;
+		printf("%s\n", STEPS[i].name);
+		STEPS[i].bench();
+	}
+
+	if (jsonFileName != NULL)
+	{
+		if (!writeSuiteJSON(jsonFileName))
+		{
+			printf("Failed to write %s\n", jsonFileName);
+			return -1;
+		}
+		printf("Results written to %s\n", jsonFileName);
+	}
+
+	return 0;
+}
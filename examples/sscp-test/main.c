@@ -9,6 +9,7 @@ extern BOOL SSCP_DEBUG_SERIAL;
 void showStatistics(SSCP_CTX_ST* ctx)
 {
 	SSCP_STATISTICS_ST stats;
+	DWORD i;
 
 	if (SSCP_GetStatistics(ctx, &stats) == 0)
 	{
@@ -19,6 +20,16 @@ void showStatistics(SSCP_CTX_ST* ctx)
 		printf("Number of sessions:    %d\n", stats.sessionCount);
 		printf("Last session time:     %ds\n", stats.sessionTime);
 		printf("Last session counter:  %d\n", stats.sessionCounter);
+		printf("Tracked allocations:   %d\n", stats.trackedAllocations);
+		printf("Frames sent:           %d\n", stats.framesSent);
+		printf("Write calls:           %d\n", stats.writeCalls);
+		printf("Frames received:       %d\n", stats.framesReceived);
+		printf("Read calls:            %d\n", stats.readCalls);
+		printf("Bytes dropped:         %d\n", stats.bytesDropped);
+		printf("Frames dropped:        %d\n", stats.framesDropped);
+		for (i = 0; i < SSCP_RTT_CLASS_COUNT; i++)
+			printf("Response time [%d]:     %dus +/- %dus, timeout %dms (%d samples)\n", i, stats.rtt[i].srttUs, stats.rtt[i].rttvarUs, stats.rtt[i].timeoutMs, stats.rtt[i].samples);
+		printf("Inter-byte timeout:    %dms\n", stats.interByteTimeoutMs);
 	}
 }
 
@@ -47,11 +58,25 @@ int main(int argc, char** argv)
 		return -1;
 	}
 
-	rc = SSCP_Outputs_SelfTest(ctx, 0x02, 0x0A, 0x00);
-	if (rc)
 	{
-		printf("SSCP_Outputs_SelfTest failed\n");
-		return -1;
+		SSCP_STATISTICS_ST before, after;
+
+		SSCP_GetStatistics(ctx, &before);
+
+		rc = SSCP_Outputs_SelfTest(ctx, 0x02, 0x0A, 0x00);
+		if (rc)
+		{
+			printf("SSCP_Outputs_SelfTest failed\n");
+			return -1;
+		}
+
+		/* The exchange must not allocate any buffer of the library's own */
+		SSCP_GetStatistics(ctx, &after);
+		if (after.trackedAllocations != before.trackedAllocations)
+		{
+			printf("SSCP_Outputs_SelfTest allocated memory\n");
+			return -1;
+		}
 	}
 
 	SSCP_Free(ctx);
@@ -7,6 +7,7 @@
 void showStatistics(SSCP_CTX_ST* ctx)
 {
 	SSCP_STATISTICS_ST stats;
+	DWORD i;
 
 	if (SSCP_GetStatistics(ctx, &stats) == 0)
 	{
@@ -17,6 +18,16 @@ void showStatistics(SSCP_CTX_ST* ctx)
 		printf("Number of sessions:    %d\n", stats.sessionCount);
 		printf("Last session time:     %ds\n", stats.sessionTime);
 		printf("Last session counter:  %d\n", stats.sessionCounter);
+		printf("Tracked allocations:   %d\n", stats.trackedAllocations);
+		printf("Frames sent:           %d\n", stats.framesSent);
+		printf("Write calls:           %d\n", stats.writeCalls);
+		printf("Frames received:       %d\n", stats.framesReceived);
+		printf("Read calls:            %d\n", stats.readCalls);
+		printf("Bytes dropped:         %d\n", stats.bytesDropped);
+		printf("Frames dropped:        %d\n", stats.framesDropped);
+		for (i = 0; i < SSCP_RTT_CLASS_COUNT; i++)
+			printf("Response time [%d]:     %dus +/- %dus, timeout %dms (%d samples)\n", i, stats.rtt[i].srttUs, stats.rtt[i].rttvarUs, stats.rtt[i].timeoutMs, stats.rtt[i].samples);
+		printf("Inter-byte timeout:    %dms\n", stats.interByteTimeoutMs);
 	}
 }
 
@@ -10,6 +10,7 @@
 
 #define SSCP_ERR_COMMAND_TOO_LONG -5 /* Library error: command is too long for the communication layer */
 #define SSCP_ERR_RESPONSE_TOO_LONG -6 /* Library error: response is too long for the communication layer */
+#define SSCP_ERR_KEYSTORE_FULL -7 /* Library error: no room left in the key store */
 
 #define SSCP_ERR_INTERNAL_FAILURE -8 /* Library error: an internal operation has failed */
 #define SSCP_ERR_OUT_OF_MEMORY -9 /* Library error: dynamic allocation failed */
@@ -18,6 +19,7 @@
 #define SSCP_ERR_COMM_NOT_OPEN -11 /* Comm error: the port is not open */
 #define SSCP_ERR_COMM_CONTROL_FAILED -12 /* Comm error: failed to configure the port */
 #define SSCP_ERR_COMM_SEND_FAILED -13 /* Comm error: failed to send through the serial port */
+#define SSCP_ERR_COMM_LINK_CHECK_FAILED -14 /* Comm error: no dialog at the new baud rate, the previous one is back */
 
 #define SSCP_ERR_COMM_RECV_FAILED -17 /* Comm error: unable to receive */
 #define SSCP_ERR_COMM_RECV_STOPPED -18 /* Comm error: device has stopped transmitting */
@@ -37,5 +39,7 @@
 
 #define SSCP_ERR_NFC_CARD_MUTE_OR_REMOVED -40 /* Card error: timeout */
 #define SSCP_ERR_NFC_CARD_COMM_ERROR -41 /* Card error: communication error */
+#define SSCP_ERR_NFC_CARD_STATUS -42 /* Card error: the card has returned an error status */
+#define SSCP_ERR_NFC_CARD_SIGNATURE -43 /* Card error: wrong MAC or challenge in the card's response */
 
 #endif
@@ -30,21 +30,117 @@ typedef struct _SSCP_CTX_ST SSCP_CTX_ST;
 SSCP_CTX_ST* SSCP_Alloc(void);
 void SSCP_Free(SSCP_CTX_ST* ctx);
 
+/* Flags for SSCP_Open */
+#define SSCP_COMM_FLAG_RESYNC 0x00000001 /* Skip garbage and late responses instead of failing */
+#define SSCP_COMM_FLAG_ECHO 0x00000002 /* The adapter echoes what is sent (2-wire RS485), drop the copy of each command */
+
 LONG SSCP_Open(SSCP_CTX_ST* ctx, const char* commName, DWORD commBaudrate, DWORD commFlags);
 LONG SSCP_Close(SSCP_CTX_ST* ctx);
+LONG SSCP_GetPollFd(SSCP_CTX_ST* ctx, int* fd);
+
+/*
+ * Peer of the in-memory transport (commName "loop:"), plays the reader: gets what the library sends, returns the
+ * number of bytes it has written in response.
+ */
+typedef DWORD (*SSCP_LOOPBACK_PEER_FN)(void* param, const BYTE data[], DWORD dataSz, BYTE response[], DWORD maxResponseSz);
+
+LONG SSCP_SetLoopbackPeer(SSCP_CTX_ST* ctx, SSCP_LOOPBACK_PEER_FN peer, void* param);
 
 LONG SSCP_SetAddress(SSCP_CTX_ST* ctx, BYTE address);
 
+/* Flags for SSCP_SetRS485, 0 to leave RS485 mode */
+#define SSCP_RS485_FLAG_ENABLE 0x00000001 /* The driver sets RTS to enable the RS485 transceiver while it sends */
+#define SSCP_RS485_FLAG_RTS_ON_SEND 0x00000002 /* RTS is high while sending (otherwise low) */
+#define SSCP_RS485_FLAG_RX_DURING_TX 0x00000004 /* Keep the receiver on while sending, see SSCP_COMM_FLAG_ECHO */
+
+LONG SSCP_SetRS485(SSCP_CTX_ST* ctx, DWORD rs485Flags, DWORD delayBeforeSendMs, DWORD delayAfterSendMs);
+
+/* A reader that has answered SSCP_Discover */
+typedef struct
+{
+	DWORD baudrate;
+	BYTE address;
+} SSCP_DISCOVERY_ST;
+
+/*
+ * SSCP_Discover stops with the first rate that gets an answer, or once maxFound readers have answered (1 for a
+ * point-to-point link). A silent address costs 30 ms plus 25 bytes on the line; when nothing answers, sweeping the 256
+ * addresses takes about 8.4 s at 115200, 9.5 s at 38400, 14.6 s at 9600 bauds, and 77 s over all the default rates.
+ */
+LONG SSCP_Discover(SSCP_CTX_ST* ctx, const DWORD baudrates[], DWORD baudrateCount, const BYTE addresses[], DWORD addressCount, SSCP_DISCOVERY_ST found[], DWORD maxFound, DWORD* actFound);
+LONG SSCP_SetCommandTimeout(SSCP_CTX_ST* ctx, DWORD command, DWORD firstByteTimeoutMs);
+LONG SSCP_SetTimeoutBounds(SSCP_CTX_ST* ctx, DWORD minTimeoutMs, DWORD maxTimeoutMs);
+
+/* Implementations of the session cryptography, for SSCP_SetCryptoProvider */
+#define SSCP_CRYPTO_PROVIDER_BUILTIN 0 /* The library's own AES and SHA-256 (default) */
+#define SSCP_CRYPTO_PROVIDER_OPENSSL 1 /* OpenSSL's EVP interface, if the library has been built with it */
+
+LONG SSCP_SetCryptoProvider(SSCP_CTX_ST* ctx, DWORD provider);
+
+/* One command of a polling sweep, for SSCP_ExchangeBatch */
+typedef struct
+{
+	SSCP_CTX_ST* ctx;
+	DWORD commandHeader; /* SSCP_CMD_xxx */
+	const BYTE* commandData;
+	DWORD commandDataSz;
+	BYTE* responseData;
+	DWORD maxResponseDataSz;
+	DWORD actResponseDataSz; /* Out */
+	LONG result; /* Out, what the exchange alone would have returned */
+} SSCP_BATCH_ITEM_ST;
+
+LONG SSCP_ExchangeBatch(SSCP_BATCH_ITEM_ST items[], DWORD count);
+
 LONG SSCP_Authenticate(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16]);
+
+/* Authentication keys prepared once, and referred to by a handle */
+typedef struct _SSCP_KEYSTORE_ST SSCP_KEYSTORE_ST;
+
+SSCP_KEYSTORE_ST* SSCP_KeyStoreAlloc(DWORD capacity);
+void SSCP_KeyStoreFree(SSCP_KEYSTORE_ST* store);
+LONG SSCP_KeyStoreAdd(SSCP_KEYSTORE_ST* store, const BYTE authKeyValue[16], DWORD* keyHandle);
+LONG SSCP_KeyStoreDiversify(SSCP_KEYSTORE_ST* store, DWORD masterKeyHandle, const char* const serialNumbers[], DWORD count, DWORD keyHandles[]);
+LONG SSCP_KeyStoreRemove(SSCP_KEYSTORE_ST* store, DWORD keyHandle);
+LONG SSCP_AuthenticateWithKey(SSCP_CTX_ST* ctx, SSCP_KEYSTORE_ST* store, DWORD keyHandle);
 LONG SSCP_Outputs(SSCP_CTX_ST* ctx, BYTE ledColor, BYTE ledDuration, BYTE buzzerDuration);
 LONG SSCP_GetInfos(SSCP_CTX_ST* ctx, BYTE* version, BYTE* baudrate, BYTE* address, WORD* voltage);
+LONG SSCP_SetBaudrate(SSCP_CTX_ST* ctx, DWORD baudrate);
+LONG SSCP_NegotiateBaudrate(SSCP_CTX_ST* ctx, DWORD maxBaudrate, DWORD* actBaudrate);
 LONG SSCP_GetSerialNumber(SSCP_CTX_ST* ctx, char *serialNumber, BYTE maxSerialNumberSz);
 LONG SSCP_GetReaderType(SSCP_CTX_ST* ctx, char *readerType, BYTE maxReaderTypeSz);
 
 LONG SSCP_ScanNFC(SSCP_CTX_ST* ctx, WORD *protocol, BYTE uid[], BYTE maxUidSz, BYTE* actUidSz, BYTE ats[], BYTE maxAtsSz, BYTE* actAtsSz);
 LONG SSCP_TransceiveNFC(SSCP_CTX_ST* ctx, const BYTE commandApdu[], DWORD commandApduSz, BYTE responseApdu[], DWORD maxResponseApduSz, DWORD *actResponseApduSz);
+LONG SSCP_TransceiveNFCView(SSCP_CTX_ST* ctx, const BYTE commandApdu[], DWORD commandApduSz, const BYTE** responseApdu, DWORD* responseApduSz);
 LONG SSCP_ReleaseNFC(SSCP_CTX_ST* ctx);
 
+/* DESFire EV2/EV3 with AES keys, secure messaging done by the host over SSCP_TransceiveNFC */
+#define SSCP_DESFIRE_COMM_PLAIN 0x00
+#define SSCP_DESFIRE_COMM_MAC 0x01 /* CMAC of the command and of the response */
+#define SSCP_DESFIRE_COMM_FULL 0x03 /* Data enciphered, and CMAC */
+
+LONG SSCP_DESFireAuthenticateEV2First(SSCP_CTX_ST* ctx, BYTE keyNo, const BYTE keyValue[16]);
+LONG SSCP_DESFireAuthenticateEV2NonFirst(SSCP_CTX_ST* ctx, BYTE keyNo, const BYTE keyValue[16]);
+LONG SSCP_DESFireCommand(SSCP_CTX_ST* ctx, BYTE command, const BYTE header[], DWORD headerSz, const BYTE data[], DWORD dataSz, BYTE commMode, BYTE response[], DWORD maxResponseSz, DWORD* actResponseSz);
+LONG SSCP_DESFireReadData(SSCP_CTX_ST* ctx, BYTE fileNo, DWORD offset, DWORD length, BYTE commMode, BYTE data[], DWORD maxDataSz, DWORD* actDataSz);
+LONG SSCP_DESFireGetStatus(SSCP_CTX_ST* ctx, BYTE* status);
+void SSCP_DESFireLogout(SSCP_CTX_ST* ctx);
+
+/* Classes of commands, each one has its own response time estimate */
+#define SSCP_RTT_CLASS_CONTROL 0 /* Handled by the reader alone; authentication and key or line changes are not measured */
+#define SSCP_RTT_CLASS_SCAN 1 /* SCAN_GLOBAL, the reader polls the RF field */
+#define SSCP_RTT_CLASS_CARD 2 /* TRANSCEIVE_APDU, the reader waits for the card */
+#define SSCP_RTT_CLASS_COUNT 3
+
+typedef struct
+{
+	DWORD samples;
+	DWORD srttUs; /* Smoothed time to the first byte of the response */
+	DWORD rttvarUs; /* Its mean deviation */
+	DWORD timeoutMs; /* First-byte timeout derived from the above, 0 until the first sample */
+} SSCP_RTT_STATISTICS_ST;
+
 typedef struct
 {
 	DWORD totalTime;
@@ -54,6 +150,17 @@ typedef struct
 	DWORD sessionCount;
 	DWORD sessionTime;
 	DWORD sessionCounter;
+	DWORD trackedAllocations; /* Buffers the library has allocated for this context; those of OpenSSL are not counted */
+	DWORD framesSent;
+	DWORD writeCalls; /* Write system calls, compare with framesSent */
+	DWORD framesReceived;
+	DWORD readCalls; /* Read system calls, compare with framesReceived */
+	DWORD bytesDropped; /* Garbage skipped in resync mode */
+	DWORD framesDropped; /* Late responses skipped in resync mode */
+	DWORD linkReconnects; /* Socket transports: connections made again after the server dropped one */
+	DWORD echoesDropped; /* Copies of the commands skipped, with SSCP_COMM_FLAG_ECHO */
+	SSCP_RTT_STATISTICS_ST rtt[SSCP_RTT_CLASS_COUNT];
+	DWORD interByteTimeoutMs; /* Inter-byte timeout currently in use */
 } SSCP_STATISTICS_ST;
 
 LONG SSCP_GetStatistics(SSCP_CTX_ST* ctx, SSCP_STATISTICS_ST *stats);
@@ -0,0 +1,71 @@
+#include "sscp-host_i.h"
+
+#if SSCP_HAVE_X86_INTRINSICS
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if SSCP_HAVE_X86_INTRINSICS
+/* Register state the OS saves on context switches (only valid if OSXSAVE is set) */
+static unsigned long long SSCP_GetXCR0(void)
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+/**
+ * \brief tell which optional instruction sets the CPU offers (bitmask of SSCP_CPU_xxx)
+ */
+DWORD SSCP_GetCpuFeatures(void)
+{
+	static volatile LONG features = -1;
+
+	if (features < 0)
+	{
+		DWORD result = 0;
+#if SSCP_HAVE_X86_INTRINSICS
+		unsigned int regs[4] = { 0 };
+		BOOL osxsave;
+
+#ifdef _MSC_VER
+		__cpuid((int*)regs, 1);
+#else
+		__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+		if (regs[2] & (1 << 9))
+			result |= SSCP_CPU_SSSE3;
+		if (regs[2] & (1 << 1))
+			result |= SSCP_CPU_PCLMUL;
+		if (regs[2] & (1 << 25))
+			result |= SSCP_CPU_AESNI;
+		if (regs[2] & (1 << 19))
+			result |= SSCP_CPU_SSE41;
+		/* The OS must save the YMM registers for AVX2 to be usable */
+		osxsave = (regs[2] & (1 << 27)) ? TRUE : FALSE;
+
+		/* Structured extended features */
+		regs[1] = 0;
+#ifdef _MSC_VER
+		__cpuidex((int*)regs, 7, 0);
+#else
+		__get_cpuid_count(7, 0, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+		if (regs[1] & (1 << 29))
+			result |= SSCP_CPU_SHA;
+		if ((regs[1] & (1 << 5)) && osxsave && ((SSCP_GetXCR0() & 0x06) == 0x06))
+			result |= SSCP_CPU_AVX2;
+#endif
+		features = (LONG)result;
+	}
+
+	return (DWORD)features;
+}
@@ -0,0 +1,237 @@
+#include "sscp-host-crypto_i.h"
+
+/*
+ * Compact AES
+ * -----------
+ *
+ * Byte-oriented implementation that only needs the S-box and its inverse (512 bytes of tables), where the portable
+ * code reads ten T-tables. MixColumns is computed with xtime. Slower than the T-tables on a big core, but it leaves the
+ * L1 cache to the rest of the application on small ones.
+ *
+ * The key schedule has the same layout as the portable one (big-endian words, dec_schd ready for the equivalent
+ * inverse cipher), so AES_CTX_ST is unchanged.
+ */
+
+static const BYTE AES_SBOX[256] = {
+	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+	0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+	0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+	0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+	0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+	0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+	0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+	0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+	0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+	0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+	0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static const BYTE AES_INV_SBOX[256] = {
+	0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
+	0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
+	0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+	0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
+	0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
+	0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+	0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
+	0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
+	0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+	0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
+	0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
+	0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+	0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+	0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
+	0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+	0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d
+};
+
+/* Multiplication by x in GF(2^8), without a branch: one byte, and the four bytes of a column at once */
+#define AES_XTIME(x) ((BYTE)(((x) << 1) ^ ((((x) >> 7) & 1) * 0x1b)))
+#define AES_XTIME4(w) ((((w) & 0x7f7f7f7fU) << 1) ^ ((((w) >> 7) & 0x01010101U) * 0x1b))
+
+#define AES_ROTL(w, n) (((w) << (n)) | ((w) >> (32 - (n))))
+
+/* A column is a 32-bit word, row 0 in the most significant byte (the layout of the key schedule) */
+typedef unsigned int AES_COLUMN;
+
+DWORD AES_Compact_TablesSize(void)
+{
+	return sizeof(AES_SBOX) + sizeof(AES_INV_SBOX);
+}
+
+static AES_COLUMN AES_Compact_SubWord(AES_COLUMN w)
+{
+	return ((AES_COLUMN)AES_SBOX[w >> 24] << 24) | ((AES_COLUMN)AES_SBOX[(w >> 16) & 0xff] << 16) |
+		((AES_COLUMN)AES_SBOX[(w >> 8) & 0xff] << 8) | (AES_COLUMN)AES_SBOX[w & 0xff];
+}
+
+/* Row i = 2 a[i] + 3 a[i+1] + a[i+2] + a[i+3] */
+static AES_COLUMN AES_Compact_MixColumn(AES_COLUMN a)
+{
+	AES_COLUMN r = AES_ROTL(a, 8);
+
+	return AES_XTIME4(a ^ r) ^ r ^ AES_ROTL(a, 16) ^ AES_ROTL(a, 24);
+}
+
+/* InvMixColumns = MixColumns after a multiplication by (04 x^2 + 05) */
+static AES_COLUMN AES_Compact_InvMixColumn(AES_COLUMN a)
+{
+	AES_COLUMN t = a ^ AES_ROTL(a, 16);
+
+	t = AES_XTIME4(t);
+	t = AES_XTIME4(t);
+	return AES_Compact_MixColumn(a ^ t);
+}
+
+static AES_COLUMN AES_Compact_Load(const BYTE p[4])
+{
+	return ((AES_COLUMN)p[0] << 24) | ((AES_COLUMN)p[1] << 16) | ((AES_COLUMN)p[2] << 8) | p[3];
+}
+
+static void AES_Compact_Store(BYTE p[4], AES_COLUMN w)
+{
+	p[0] = (BYTE)(w >> 24);
+	p[1] = (BYTE)(w >> 16);
+	p[2] = (BYTE)(w >> 8);
+	p[3] = (BYTE)w;
+}
+
+/* Same schedule as AES_ExpandKey and AES_InvertKey, computed with the S-box only */
+void AES_Compact_ExpandKey(AES_CTX_ST* aes_ctx, const BYTE key_data[], DWORD key_bits, BOOL decrypt)
+{
+	DWORD* w = aes_ctx->enc_schd;
+	DWORD nk, total, i;
+	AES_COLUMN t;
+	BYTE rcon = 0x01;
+
+	aes_ctx->rounds = 0;
+	if ((key_data == NULL) || ((key_bits != 128) && (key_bits != 192) && (key_bits != 256)))
+		return;
+
+	nk = key_bits / 32;
+	aes_ctx->rounds = nk + 6;
+	total = 4 * (aes_ctx->rounds + 1);
+
+	for (i = 0; i < nk; i++)
+		w[i] = AES_Compact_Load(&key_data[4 * i]);
+
+	for (i = nk; i < total; i++)
+	{
+		t = (AES_COLUMN)w[i - 1];
+		if ((i % nk) == 0)
+		{
+			t = AES_Compact_SubWord(AES_ROTL(t, 8)) ^ ((AES_COLUMN)rcon << 24);
+			rcon = AES_XTIME(rcon);
+		}
+		else if ((nk > 6) && ((i % nk) == 4))
+		{
+			t = AES_Compact_SubWord(t);
+		}
+		w[i] = w[i - nk] ^ t;
+	}
+
+	if (!decrypt)
+		return;
+
+	/* Round keys in reverse order, InvMixColumns applied to all but the first and the last */
+	for (i = 0; i <= aes_ctx->rounds; i++)
+		memcpy(&aes_ctx->dec_schd[4 * i], &w[4 * (aes_ctx->rounds - i)], 4 * sizeof(DWORD));
+
+	for (i = 4; i < 4 * aes_ctx->rounds; i++)
+		aes_ctx->dec_schd[i] = AES_Compact_InvMixColumn((AES_COLUMN)aes_ctx->dec_schd[i]);
+}
+
+void AES_Compact_Encrypt(const AES_CTX_ST* aes_ctx, BYTE data[16])
+{
+	const DWORD* rk = aes_ctx->enc_schd;
+	AES_COLUMN s0, s1, s2, s3, t0, t1, t2, t3;
+	DWORD r;
+
+	s0 = AES_Compact_Load(&data[0]) ^ (AES_COLUMN)rk[0];
+	s1 = AES_Compact_Load(&data[4]) ^ (AES_COLUMN)rk[1];
+	s2 = AES_Compact_Load(&data[8]) ^ (AES_COLUMN)rk[2];
+	s3 = AES_Compact_Load(&data[12]) ^ (AES_COLUMN)rk[3];
+
+	for (r = 1; r <= aes_ctx->rounds; r++)
+	{
+		rk += 4;
+
+		/* SubBytes and ShiftRows: row i of column c comes from column c + i */
+#define AES_COMPACT_SUB_SHIFT(a, b, c, d) \
+		(((AES_COLUMN)AES_SBOX[a >> 24] << 24) | ((AES_COLUMN)AES_SBOX[(b >> 16) & 0xff] << 16) | \
+		 ((AES_COLUMN)AES_SBOX[(c >> 8) & 0xff] << 8) | (AES_COLUMN)AES_SBOX[d & 0xff])
+		t0 = AES_COMPACT_SUB_SHIFT(s0, s1, s2, s3);
+		t1 = AES_COMPACT_SUB_SHIFT(s1, s2, s3, s0);
+		t2 = AES_COMPACT_SUB_SHIFT(s2, s3, s0, s1);
+		t3 = AES_COMPACT_SUB_SHIFT(s3, s0, s1, s2);
+#undef AES_COMPACT_SUB_SHIFT
+
+		if (r < aes_ctx->rounds)
+		{
+			t0 = AES_Compact_MixColumn(t0);
+			t1 = AES_Compact_MixColumn(t1);
+			t2 = AES_Compact_MixColumn(t2);
+			t3 = AES_Compact_MixColumn(t3);
+		}
+
+		s0 = t0 ^ (AES_COLUMN)rk[0];
+		s1 = t1 ^ (AES_COLUMN)rk[1];
+		s2 = t2 ^ (AES_COLUMN)rk[2];
+		s3 = t3 ^ (AES_COLUMN)rk[3];
+	}
+
+	AES_Compact_Store(&data[0], s0);
+	AES_Compact_Store(&data[4], s1);
+	AES_Compact_Store(&data[8], s2);
+	AES_Compact_Store(&data[12], s3);
+}
+
+void AES_Compact_Decrypt(const AES_CTX_ST* aes_ctx, BYTE data[16])
+{
+	const DWORD* rk = aes_ctx->dec_schd;
+	AES_COLUMN s0, s1, s2, s3, t0, t1, t2, t3;
+	DWORD r;
+
+	s0 = AES_Compact_Load(&data[0]) ^ (AES_COLUMN)rk[0];
+	s1 = AES_Compact_Load(&data[4]) ^ (AES_COLUMN)rk[1];
+	s2 = AES_Compact_Load(&data[8]) ^ (AES_COLUMN)rk[2];
+	s3 = AES_Compact_Load(&data[12]) ^ (AES_COLUMN)rk[3];
+
+	for (r = 1; r <= aes_ctx->rounds; r++)
+	{
+		rk += 4;
+
+		/* InvSubBytes and InvShiftRows: row i of column c comes from column c - i */
+#define AES_COMPACT_INV_SUB_SHIFT(a, b, c, d) \
+		(((AES_COLUMN)AES_INV_SBOX[a >> 24] << 24) | ((AES_COLUMN)AES_INV_SBOX[(b >> 16) & 0xff] << 16) | \
+		 ((AES_COLUMN)AES_INV_SBOX[(c >> 8) & 0xff] << 8) | (AES_COLUMN)AES_INV_SBOX[d & 0xff])
+		t0 = AES_COMPACT_INV_SUB_SHIFT(s0, s3, s2, s1);
+		t1 = AES_COMPACT_INV_SUB_SHIFT(s1, s0, s3, s2);
+		t2 = AES_COMPACT_INV_SUB_SHIFT(s2, s1, s0, s3);
+		t3 = AES_COMPACT_INV_SUB_SHIFT(s3, s2, s1, s0);
+#undef AES_COMPACT_INV_SUB_SHIFT
+
+		if (r < aes_ctx->rounds)
+		{
+			t0 = AES_Compact_InvMixColumn(t0);
+			t1 = AES_Compact_InvMixColumn(t1);
+			t2 = AES_Compact_InvMixColumn(t2);
+			t3 = AES_Compact_InvMixColumn(t3);
+		}
+
+		s0 = t0 ^ (AES_COLUMN)rk[0];
+		s1 = t1 ^ (AES_COLUMN)rk[1];
+		s2 = t2 ^ (AES_COLUMN)rk[2];
+		s3 = t3 ^ (AES_COLUMN)rk[3];
+	}
+
+	AES_Compact_Store(&data[0], s0);
+	AES_Compact_Store(&data[4], s1);
+	AES_Compact_Store(&data[8], s2);
+	AES_Compact_Store(&data[12], s3);
+}
@@ -3,22 +3,107 @@
 static DWORD AES_ExpandKey(DWORD key_schd[60], const BYTE key_data[], DWORD key_bits);
 static void AES_InvertKey(DWORD key_schd[60], DWORD rounds);
 
-void AES_InitEx(AES_CTX_ST* aes_ctx, const BYTE key_data[], DWORD key_bits)
+static void AES_ScheduleToBytes(BYTE out[240], const DWORD key_schd[60], DWORD rounds);
+
+#ifndef SSCP_AES_DEFAULT_BACKEND
+#define SSCP_AES_DEFAULT_BACKEND AES_BACKEND_AUTO
+#endif
+
+static DWORD AES_BACKEND = SSCP_AES_DEFAULT_BACKEND;
+
+/**
+ * \brief force the AES implementation used by the contexts initialized afterwards (for test and benchmark), returns
+ * FALSE if not available on this CPU
+ */
+BOOL AES_SetBackend(DWORD backend)
 {
-	if (aes_ctx == NULL)
-		return;
+	switch (backend)
+	{
+		case AES_BACKEND_AUTO:
+		case AES_BACKEND_PORTABLE:
+		case AES_BACKEND_COMPACT:
+		break;
+
+		case AES_BACKEND_AESNI:
+#if SSCP_HAVE_X86_INTRINSICS
+			if (!(SSCP_GetCpuFeatures() & SSCP_CPU_AESNI))
+				return FALSE;
+		break;
+#else
+			return FALSE;
+#endif
 
+		default:
+			return FALSE;
+	}
+
+	AES_BACKEND = backend;
+	return TRUE;
+}
+
+static DWORD AES_SelectBackend(void)
+{
+	if (AES_BACKEND == AES_BACKEND_COMPACT)
+		return AES_BACKEND_COMPACT;
+
+#if SSCP_HAVE_X86_INTRINSICS
+	/* A backend forced at build time falls back to the portable code if the CPU does not have it */
+	if ((AES_BACKEND == AES_BACKEND_AUTO) || (AES_BACKEND == AES_BACKEND_AESNI))
+		if (SSCP_GetCpuFeatures() & SSCP_CPU_AESNI)
+			return AES_BACKEND_AESNI;
+#endif
+	return AES_BACKEND_PORTABLE;
+}
+
+static void AES_Setup(AES_CTX_ST* aes_ctx, const BYTE key_data[], DWORD key_bits, BOOL decrypt)
+{
 	/* Remember size of key */
 	aes_ctx->key_bits = key_bits;
+	aes_ctx->backend = AES_SelectBackend();
+
+	if (aes_ctx->backend == AES_BACKEND_COMPACT)
+	{
+		/* Never touch the T-tables, not even for the key schedule */
+		AES_Compact_ExpandKey(aes_ctx, key_data, key_bits, decrypt);
+		return;
+	}
+
+#if SSCP_HAVE_X86_INTRINSICS
+	if ((aes_ctx->backend == AES_BACKEND_AESNI) && (key_bits == 128))
+	{
+		aes_ctx->rounds = 10;
+		AES_NI_ExpandKey128(aes_ctx, key_data, decrypt);
+		return;
+	}
+#endif
 
 	/* Expand the key into the ciphering context */
 	aes_ctx->rounds = AES_ExpandKey(aes_ctx->enc_schd, key_data, key_bits);
 	if (!aes_ctx->rounds)
 		return;
 
-	/* Invert the ciphering context to get the deciphering one */
-	memcpy(aes_ctx->dec_schd, aes_ctx->enc_schd, 60 * sizeof(DWORD));
-	AES_InvertKey(aes_ctx->dec_schd, aes_ctx->rounds);
+	if (decrypt)
+	{
+		/* Invert the ciphering context to get the deciphering one */
+		memcpy(aes_ctx->dec_schd, aes_ctx->enc_schd, 60 * sizeof(DWORD));
+		AES_InvertKey(aes_ctx->dec_schd, aes_ctx->rounds);
+	}
+
+	if (aes_ctx->backend == AES_BACKEND_AESNI)
+	{
+		/* 192 and 256-bit keys: the portable schedule, laid out for AES-NI */
+		AES_ScheduleToBytes(aes_ctx->ni_enc, aes_ctx->enc_schd, aes_ctx->rounds);
+		if (decrypt)
+			AES_ScheduleToBytes(aes_ctx->ni_dec, aes_ctx->dec_schd, aes_ctx->rounds);
+	}
+}
+
+void AES_InitEx(AES_CTX_ST* aes_ctx, const BYTE key_data[], DWORD key_bits)
+{
+	if (aes_ctx == NULL)
+		return;
+
+	AES_Setup(aes_ctx, key_data, key_bits, TRUE);
 }
 
 void AES_Init(AES_CTX_ST* aes_ctx, const BYTE key_data[16])
@@ -26,6 +111,15 @@ void AES_Init(AES_CTX_ST* aes_ctx, const BYTE key_data[16])
 	AES_InitEx(aes_ctx, key_data, 128);
 }
 
+void AES_InitEncrypt(AES_CTX_ST* aes_ctx, const BYTE key_data[16])
+{
+	if (aes_ctx == NULL)
+		return;
+
+	/* Only the ciphering context, don't waste time inverting the key */
+	AES_Setup(aes_ctx, key_data, 128, FALSE);
+}
+
 void AES_Encrypt2(AES_CTX_ST* context, BYTE outbuf[16], const BYTE inbuf[16])
 {
 	memcpy(outbuf, inbuf, 16);
@@ -38,6 +132,89 @@ void AES_Decrypt2(AES_CTX_ST* context, BYTE outbuf[16], const BYTE inbuf[16])
 	AES_Decrypt(context, outbuf);
 }
 
+void AES_EncryptBlocks(AES_CTX_ST* aes_ctx, BYTE data[], DWORD blocks)
+{
+#if SSCP_HAVE_X86_INTRINSICS
+	if (aes_ctx->backend == AES_BACKEND_AESNI)
+	{
+		AES_NI_EncryptBlocks(aes_ctx, data, blocks);
+		return;
+	}
+#endif
+
+	for (; blocks > 0; blocks--, data += 16)
+		AES_Encrypt(aes_ctx, data);
+}
+
+void AES_DecryptBlocks(AES_CTX_ST* aes_ctx, BYTE data[], DWORD blocks)
+{
+#if SSCP_HAVE_X86_INTRINSICS
+	if (aes_ctx->backend == AES_BACKEND_AESNI)
+	{
+		AES_NI_DecryptBlocks(aes_ctx, data, blocks);
+		return;
+	}
+#endif
+
+	for (; blocks > 0; blocks--, data += 16)
+		AES_Decrypt(aes_ctx, data);
+}
+
+void AES_EncryptCBC(AES_CTX_ST* aes_ctx, BYTE iv[16], BYTE data[], DWORD blocks)
+{
+	DWORD j;
+
+#if SSCP_HAVE_X86_INTRINSICS
+	if (aes_ctx->backend == AES_BACKEND_AESNI)
+	{
+		AES_NI_EncryptCBC(aes_ctx, iv, data, blocks);
+		return;
+	}
+#endif
+
+	for (; blocks > 0; blocks--, data += 16)
+	{
+		/* Cipher <- E ( Plain XOR IV ), IV <- Cipher */
+		for (j = 0; j < 16; j++)
+			data[j] ^= iv[j];
+		AES_Encrypt(aes_ctx, data);
+		memcpy(iv, data, 16);
+	}
+}
+
+void AES_DecryptCBC(AES_CTX_ST* aes_ctx, BYTE iv[16], BYTE data[], DWORD blocks)
+{
+	BYTE cipher[16 * (AES_INTERLEAVE_BLOCKS + 1)];
+	DWORD count, j;
+
+#if SSCP_HAVE_X86_INTRINSICS
+	if (aes_ctx->backend == AES_BACKEND_AESNI)
+	{
+		AES_NI_DecryptCBC(aes_ctx, iv, data, blocks);
+		return;
+	}
+#endif
+
+	/* The blocks of a chunk do not depend on each other, so their decryptions overlap in the CPU */
+	memcpy(cipher, iv, 16);
+	while (blocks > 0)
+	{
+		count = (blocks < AES_INTERLEAVE_BLOCKS) ? blocks : AES_INTERLEAVE_BLOCKS;
+
+		memcpy(&cipher[16], data, 16 * count);
+		AES_DecryptBlocks(aes_ctx, data, count);
+
+		/* Plain <- D ( Cipher ) XOR previous Cipher */
+		for (j = 0; j < 16 * count; j++)
+			data[j] ^= cipher[j];
+
+		memcpy(cipher, &cipher[16 * count], 16);
+		data += 16 * count;
+		blocks -= count;
+	}
+	memcpy(iv, cipher, 16);
+}
+
 DWORD AES_KVC(AES_CTX_ST* aes_ctx)
 {
 	BYTE buffer[16];
@@ -462,6 +639,31 @@ static void SET_DW(BYTE* p, DWORD dw)
 	p[0] = (BYTE)dw;
 }
 
+/**
+ * \brief size of the lookup tables an implementation reads while enciphering and deciphering
+ */
+DWORD AES_TablesSize(DWORD backend)
+{
+	switch (backend)
+	{
+		case AES_BACKEND_PORTABLE:
+			return sizeof(AES_TE0) + sizeof(AES_TE1) + sizeof(AES_TE2) + sizeof(AES_TE3) + sizeof(AES_TE4) +
+				sizeof(AES_TD0) + sizeof(AES_TD1) + sizeof(AES_TD2) + sizeof(AES_TD3) + sizeof(AES_TD4);
+		case AES_BACKEND_COMPACT:
+			return AES_Compact_TablesSize();
+		default:
+			return 0;
+	}
+}
+
+static void AES_ScheduleToBytes(BYTE out[240], const DWORD key_schd[60], DWORD rounds)
+{
+	DWORD i;
+
+	for (i = 0; i < 4 * (rounds + 1); i++)
+		SET_DW(&out[4 * i], key_schd[i]);
+}
+
 static DWORD AES_ExpandKey(DWORD key_schd[60], const BYTE key_data[], DWORD key_bits)
 {
 	register int k;
@@ -622,6 +824,19 @@ void AES_Encrypt(AES_CTX_ST* aes_ctx, BYTE data[16])
 	DWORD s0, s1, s2, s3;
 	DWORD k;
 
+	if (aes_ctx->backend == AES_BACKEND_COMPACT)
+	{
+		AES_Compact_Encrypt(aes_ctx, data);
+		return;
+	}
+#if SSCP_HAVE_X86_INTRINSICS
+	if (aes_ctx->backend == AES_BACKEND_AESNI)
+	{
+		AES_NI_Encrypt(aes_ctx, data, data);
+		return;
+	}
+#endif
+
 	//      map byte array block to cipher state and add initial round key:
 	s0 = GET_DW(data) ^ aes_ctx->enc_schd[0];
 	s1 = GET_DW(data + 4) ^ aes_ctx->enc_schd[1];
@@ -727,6 +942,19 @@ void AES_Decrypt(AES_CTX_ST* aes_ctx, BYTE data[16])
 	DWORD s0, s1, s2, s3;
 	DWORD k;
 
+	if (aes_ctx->backend == AES_BACKEND_COMPACT)
+	{
+		AES_Compact_Decrypt(aes_ctx, data);
+		return;
+	}
+#if SSCP_HAVE_X86_INTRINSICS
+	if (aes_ctx->backend == AES_BACKEND_AESNI)
+	{
+		AES_NI_Decrypt(aes_ctx, data, data);
+		return;
+	}
+#endif
+
 	//      map byte array block to cipher state and add initial round key:
 	s0 = GET_DW(data) ^ aes_ctx->dec_schd[0];
 	s1 = GET_DW(data + 4) ^ aes_ctx->dec_schd[1];
@@ -0,0 +1,241 @@
+#include "sscp-host-crypto_i.h"
+
+#if SSCP_HAVE_X86_INTRINSICS
+
+#include <immintrin.h>
+
+/*
+ * AES with the AES-NI instructions
+ * --------------------------------
+ *
+ * The round keys are stored as 16-byte blocks, in the order the state is loaded from memory. The decryption schedule
+ * is the one of the 'equivalent inverse cipher': encryption keys in reverse order, InvMixColumns applied to the
+ * inner ones. AES_InitEx only calls in here once it has checked the CPU supports it.
+ */
+
+SSCP_TARGET("aes,sse2")
+static __m128i AES_NI_Expand128(__m128i key, __m128i assist)
+{
+	assist = _mm_shuffle_epi32(assist, 0xFF);
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, assist);
+}
+
+/**
+ * \brief expand a 128-bit key, and prepare the decryption schedule as well if asked to
+ */
+SSCP_TARGET("aes,sse2")
+void AES_NI_ExpandKey128(AES_CTX_ST* aes_ctx, const BYTE key[16], BOOL decrypt)
+{
+	__m128i rk[11];
+	DWORD i;
+
+	/* The round constant of aeskeygenassist must be an immediate */
+	rk[0] = _mm_loadu_si128((const __m128i*)key);
+	rk[1] = AES_NI_Expand128(rk[0], _mm_aeskeygenassist_si128(rk[0], 0x01));
+	rk[2] = AES_NI_Expand128(rk[1], _mm_aeskeygenassist_si128(rk[1], 0x02));
+	rk[3] = AES_NI_Expand128(rk[2], _mm_aeskeygenassist_si128(rk[2], 0x04));
+	rk[4] = AES_NI_Expand128(rk[3], _mm_aeskeygenassist_si128(rk[3], 0x08));
+	rk[5] = AES_NI_Expand128(rk[4], _mm_aeskeygenassist_si128(rk[4], 0x10));
+	rk[6] = AES_NI_Expand128(rk[5], _mm_aeskeygenassist_si128(rk[5], 0x20));
+	rk[7] = AES_NI_Expand128(rk[6], _mm_aeskeygenassist_si128(rk[6], 0x40));
+	rk[8] = AES_NI_Expand128(rk[7], _mm_aeskeygenassist_si128(rk[7], 0x80));
+	rk[9] = AES_NI_Expand128(rk[8], _mm_aeskeygenassist_si128(rk[8], 0x1B));
+	rk[10] = AES_NI_Expand128(rk[9], _mm_aeskeygenassist_si128(rk[9], 0x36));
+
+	for (i = 0; i <= 10; i++)
+		_mm_storeu_si128((__m128i*)&aes_ctx->ni_enc[16 * i], rk[i]);
+
+	if (!decrypt)
+		return;
+
+	_mm_storeu_si128((__m128i*)&aes_ctx->ni_dec[0], rk[10]);
+	for (i = 1; i < 10; i++)
+		_mm_storeu_si128((__m128i*)&aes_ctx->ni_dec[16 * i], _mm_aesimc_si128(rk[10 - i]));
+	_mm_storeu_si128((__m128i*)&aes_ctx->ni_dec[16 * 10], rk[0]);
+}
+
+SSCP_TARGET("aes,sse2")
+void AES_NI_Encrypt(const AES_CTX_ST* aes_ctx, BYTE outbuf[16], const BYTE inbuf[16])
+{
+	const BYTE* rk = aes_ctx->ni_enc;
+	__m128i s;
+	DWORD r;
+
+	s = _mm_xor_si128(_mm_loadu_si128((const __m128i*)inbuf), _mm_loadu_si128((const __m128i*)rk));
+	for (r = 1; r < aes_ctx->rounds; r++)
+		s = _mm_aesenc_si128(s, _mm_loadu_si128((const __m128i*)&rk[16 * r]));
+	s = _mm_aesenclast_si128(s, _mm_loadu_si128((const __m128i*)&rk[16 * r]));
+
+	_mm_storeu_si128((__m128i*)outbuf, s);
+}
+
+SSCP_TARGET("aes,sse2")
+void AES_NI_Decrypt(const AES_CTX_ST* aes_ctx, BYTE outbuf[16], const BYTE inbuf[16])
+{
+	const BYTE* rk = aes_ctx->ni_dec;
+	__m128i s;
+	DWORD r;
+
+	s = _mm_xor_si128(_mm_loadu_si128((const __m128i*)inbuf), _mm_loadu_si128((const __m128i*)rk));
+	for (r = 1; r < aes_ctx->rounds; r++)
+		s = _mm_aesdec_si128(s, _mm_loadu_si128((const __m128i*)&rk[16 * r]));
+	s = _mm_aesdeclast_si128(s, _mm_loadu_si128((const __m128i*)&rk[16 * r]));
+
+	_mm_storeu_si128((__m128i*)outbuf, s);
+}
+
+#define AES_NI_LOAD8(p) \
+	b0 = _mm_loadu_si128((const __m128i*)&(p)[0]); b1 = _mm_loadu_si128((const __m128i*)&(p)[16]); \
+	b2 = _mm_loadu_si128((const __m128i*)&(p)[32]); b3 = _mm_loadu_si128((const __m128i*)&(p)[48]); \
+	b4 = _mm_loadu_si128((const __m128i*)&(p)[64]); b5 = _mm_loadu_si128((const __m128i*)&(p)[80]); \
+	b6 = _mm_loadu_si128((const __m128i*)&(p)[96]); b7 = _mm_loadu_si128((const __m128i*)&(p)[112])
+
+#define AES_NI_STORE8(p) \
+	_mm_storeu_si128((__m128i*)&(p)[0], b0); _mm_storeu_si128((__m128i*)&(p)[16], b1); \
+	_mm_storeu_si128((__m128i*)&(p)[32], b2); _mm_storeu_si128((__m128i*)&(p)[48], b3); \
+	_mm_storeu_si128((__m128i*)&(p)[64], b4); _mm_storeu_si128((__m128i*)&(p)[80], b5); \
+	_mm_storeu_si128((__m128i*)&(p)[96], b6); _mm_storeu_si128((__m128i*)&(p)[112], b7)
+
+#define AES_NI_ROUND8(op, k) \
+	b0 = op(b0, k); b1 = op(b1, k); b2 = op(b2, k); b3 = op(b3, k); \
+	b4 = op(b4, k); b5 = op(b5, k); b6 = op(b6, k); b7 = op(b7, k)
+
+/**
+ * \brief ECB encryption of 'blocks' blocks in place, 8 at a time so the AES unit is never waiting for a result
+ */
+SSCP_TARGET("aes,sse2")
+void AES_NI_EncryptBlocks(const AES_CTX_ST* aes_ctx, BYTE data[], DWORD blocks)
+{
+	const BYTE* rk = aes_ctx->ni_enc;
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7, k;
+	DWORD r;
+
+	for (; blocks >= 8; blocks -= 8, data += 8 * 16)
+	{
+		AES_NI_LOAD8(data);
+		k = _mm_loadu_si128((const __m128i*)rk);
+		AES_NI_ROUND8(_mm_xor_si128, k);
+		for (r = 1; r < aes_ctx->rounds; r++)
+		{
+			k = _mm_loadu_si128((const __m128i*)&rk[16 * r]);
+			AES_NI_ROUND8(_mm_aesenc_si128, k);
+		}
+		k = _mm_loadu_si128((const __m128i*)&rk[16 * r]);
+		AES_NI_ROUND8(_mm_aesenclast_si128, k);
+		AES_NI_STORE8(data);
+	}
+
+	for (; blocks > 0; blocks--, data += 16)
+		AES_NI_Encrypt(aes_ctx, data, data);
+}
+
+/**
+ * \brief ECB decryption of 'blocks' blocks in place, 8 at a time
+ */
+SSCP_TARGET("aes,sse2")
+void AES_NI_DecryptBlocks(const AES_CTX_ST* aes_ctx, BYTE data[], DWORD blocks)
+{
+	const BYTE* rk = aes_ctx->ni_dec;
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7, k;
+	DWORD r;
+
+	for (; blocks >= 8; blocks -= 8, data += 8 * 16)
+	{
+		AES_NI_LOAD8(data);
+		k = _mm_loadu_si128((const __m128i*)rk);
+		AES_NI_ROUND8(_mm_xor_si128, k);
+		for (r = 1; r < aes_ctx->rounds; r++)
+		{
+			k = _mm_loadu_si128((const __m128i*)&rk[16 * r]);
+			AES_NI_ROUND8(_mm_aesdec_si128, k);
+		}
+		k = _mm_loadu_si128((const __m128i*)&rk[16 * r]);
+		AES_NI_ROUND8(_mm_aesdeclast_si128, k);
+		AES_NI_STORE8(data);
+	}
+
+	for (; blocks > 0; blocks--, data += 16)
+		AES_NI_Decrypt(aes_ctx, data, data);
+}
+
+/**
+ * \brief CBC encryption in place; serial by nature, but the chaining value and the round keys stay in registers
+ */
+SSCP_TARGET("aes,sse2")
+void AES_NI_EncryptCBC(const AES_CTX_ST* aes_ctx, BYTE iv[16], BYTE data[], DWORD blocks)
+{
+	const BYTE* rk = aes_ctx->ni_enc;
+	__m128i k[15];
+	__m128i s;
+	DWORD r;
+
+	for (r = 0; r <= aes_ctx->rounds; r++)
+		k[r] = _mm_loadu_si128((const __m128i*)&rk[16 * r]);
+
+	s = _mm_loadu_si128((const __m128i*)iv);
+	for (; blocks > 0; blocks--, data += 16)
+	{
+		s = _mm_xor_si128(s, _mm_loadu_si128((const __m128i*)data));
+		s = _mm_xor_si128(s, k[0]);
+		for (r = 1; r < aes_ctx->rounds; r++)
+			s = _mm_aesenc_si128(s, k[r]);
+		s = _mm_aesenclast_si128(s, k[r]);
+		_mm_storeu_si128((__m128i*)data, s);
+	}
+	_mm_storeu_si128((__m128i*)iv, s);
+}
+
+/**
+ * \brief CBC decryption in place, 8 blocks interleaved
+ */
+SSCP_TARGET("aes,sse2")
+void AES_NI_DecryptCBC(const AES_CTX_ST* aes_ctx, BYTE iv[16], BYTE data[], DWORD blocks)
+{
+	const BYTE* rk = aes_ctx->ni_dec;
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7, k;
+	__m128i c0, c1, c2, c3, c4, c5, c6, c7;
+	__m128i carry = _mm_loadu_si128((const __m128i*)iv);
+	DWORD r;
+
+	for (; blocks >= 8; blocks -= 8, data += 8 * 16)
+	{
+		AES_NI_LOAD8(data);
+		c0 = b0; c1 = b1; c2 = b2; c3 = b3; c4 = b4; c5 = b5; c6 = b6; c7 = b7;
+
+		k = _mm_loadu_si128((const __m128i*)rk);
+		AES_NI_ROUND8(_mm_xor_si128, k);
+		for (r = 1; r < aes_ctx->rounds; r++)
+		{
+			k = _mm_loadu_si128((const __m128i*)&rk[16 * r]);
+			AES_NI_ROUND8(_mm_aesdec_si128, k);
+		}
+		k = _mm_loadu_si128((const __m128i*)&rk[16 * r]);
+		AES_NI_ROUND8(_mm_aesdeclast_si128, k);
+
+		b0 = _mm_xor_si128(b0, carry); b1 = _mm_xor_si128(b1, c0);
+		b2 = _mm_xor_si128(b2, c1); b3 = _mm_xor_si128(b3, c2);
+		b4 = _mm_xor_si128(b4, c3); b5 = _mm_xor_si128(b5, c4);
+		b6 = _mm_xor_si128(b6, c5); b7 = _mm_xor_si128(b7, c6);
+		carry = c7;
+
+		AES_NI_STORE8(data);
+	}
+
+	for (; blocks > 0; blocks--, data += 16)
+	{
+		c0 = _mm_loadu_si128((const __m128i*)data);
+		b0 = _mm_xor_si128(c0, _mm_loadu_si128((const __m128i*)rk));
+		for (r = 1; r < aes_ctx->rounds; r++)
+			b0 = _mm_aesdec_si128(b0, _mm_loadu_si128((const __m128i*)&rk[16 * r]));
+		b0 = _mm_aesdeclast_si128(b0, _mm_loadu_si128((const __m128i*)&rk[16 * r]));
+		_mm_storeu_si128((__m128i*)data, _mm_xor_si128(b0, carry));
+		carry = c0;
+	}
+
+	_mm_storeu_si128((__m128i*)iv, carry);
+}
+
+#endif
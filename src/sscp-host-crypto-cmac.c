@@ -0,0 +1,92 @@
+#include "sscp-host-crypto_i.h"
+
+/*
+ * AES-CMAC (NIST SP 800-38B, RFC 4493)
+ * ------------------------------------
+ *
+ * The key schedule and the subkeys K1 and K2 are computed once by AES_CMAC_Prepare. The last block of the message is
+ * held back by AES_CMAC_Update until AES_CMAC_Final knows whether it is complete (masked with K1) or padded (K2).
+ */
+
+/* Doubling in GF(2^128) */
+static void AES_CMAC_Double(BYTE k[16])
+{
+	BYTE msb = k[0] & 0x80;
+	DWORD i;
+
+	for (i = 0; i < 15; i++)
+		k[i] = (BYTE)((k[i] << 1) | (k[i + 1] >> 7));
+	k[15] = (BYTE)(k[15] << 1);
+	if (msb)
+		k[15] ^= 0x87;
+}
+
+void AES_CMAC_Prepare(AES_CMAC_CTX_ST* cmac_ctx, const BYTE key[16])
+{
+	AES_Init(&cmac_ctx->aes, key);
+
+	/* L = AES (K, 0), K1 = 2.L, K2 = 2.K1 */
+	memset(cmac_ctx->k1, 0, 16);
+	AES_Encrypt(&cmac_ctx->aes, cmac_ctx->k1);
+	AES_CMAC_Double(cmac_ctx->k1);
+	memcpy(cmac_ctx->k2, cmac_ctx->k1, 16);
+	AES_CMAC_Double(cmac_ctx->k2);
+}
+
+void AES_CMAC_Init(AES_CMAC_STATE_ST* state)
+{
+	memset(state, 0, sizeof(AES_CMAC_STATE_ST));
+}
+
+void AES_CMAC_Update(AES_CMAC_CTX_ST* cmac_ctx, AES_CMAC_STATE_ST* state, const BYTE data[], DWORD length)
+{
+	DWORD i;
+
+	while (length > 0)
+	{
+		/* The block held back is not the last one after all */
+		if (state->blockSz == 16)
+		{
+			for (i = 0; i < 16; i++)
+				state->mac[i] ^= state->block[i];
+			AES_Encrypt(&cmac_ctx->aes, state->mac);
+			state->blockSz = 0;
+		}
+
+		while ((state->blockSz < 16) && (length > 0))
+		{
+			state->block[state->blockSz++] = *data++;
+			length--;
+		}
+	}
+}
+
+void AES_CMAC_Final(AES_CMAC_CTX_ST* cmac_ctx, AES_CMAC_STATE_ST* state, BYTE mac[16])
+{
+	const BYTE* subkey = cmac_ctx->k1;
+	DWORD i;
+
+	if (state->blockSz < 16)
+	{
+		state->block[state->blockSz++] = 0x80;
+		while (state->blockSz < 16)
+			state->block[state->blockSz++] = 0x00;
+		subkey = cmac_ctx->k2;
+	}
+
+	for (i = 0; i < 16; i++)
+		state->mac[i] ^= state->block[i] ^ subkey[i];
+	AES_Encrypt(&cmac_ctx->aes, state->mac);
+
+	memcpy(mac, state->mac, 16);
+	memset(state, 0, sizeof(AES_CMAC_STATE_ST));
+}
+
+void AES_CMAC_Compute(AES_CMAC_CTX_ST* cmac_ctx, const BYTE data[], DWORD length, BYTE mac[16])
+{
+	AES_CMAC_STATE_ST state;
+
+	AES_CMAC_Init(&state);
+	AES_CMAC_Update(cmac_ctx, &state, data, length);
+	AES_CMAC_Final(cmac_ctx, &state, mac);
+}
@@ -0,0 +1,222 @@
+#include "sscp-host_i.h"
+
+#if SSCP_WITH_OPENSSL
+
+#include <limits.h>
+#include <openssl/evp.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/rand.h>
+
+/*
+ * OpenSSL provider
+ * ----------------
+ *
+ * The cipher and MAC contexts are created when the session opens and reused for every exchange: a new IV (or a
+ * restart of the HMAC) does not expand the key again.
+ */
+
+typedef struct
+{
+    EVP_CIPHER_CTX* cipherAB;
+    EVP_CIPHER_CTX* decipherBA;
+    EVP_MAC_CTX* signAB;
+    EVP_MAC_CTX* signBA;
+} SSCP_OPENSSL_SESSION_ST;
+
+static EVP_MAC_CTX* SSCP_OpenSSL_NewHMAC(EVP_MAC* mac, const BYTE key[16])
+{
+    OSSL_PARAM params[2];
+    EVP_MAC_CTX* mac_ctx;
+
+    mac_ctx = EVP_MAC_CTX_new(mac);
+    if (mac_ctx == NULL)
+        return NULL;
+
+    params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char*)"SHA256", 0);
+    params[1] = OSSL_PARAM_construct_end();
+
+    if (!EVP_MAC_init(mac_ctx, key, 16, params))
+    {
+        EVP_MAC_CTX_free(mac_ctx);
+        return NULL;
+    }
+
+    return mac_ctx;
+}
+
+static EVP_CIPHER_CTX* SSCP_OpenSSL_NewCipher(const BYTE key[16], BOOL encrypt)
+{
+    EVP_CIPHER_CTX* cipher_ctx;
+
+    cipher_ctx = EVP_CIPHER_CTX_new();
+    if (cipher_ctx == NULL)
+        return NULL;
+
+    if (!EVP_CipherInit_ex(cipher_ctx, EVP_aes_128_cbc(), NULL, key, NULL, encrypt ? 1 : 0))
+    {
+        EVP_CIPHER_CTX_free(cipher_ctx);
+        return NULL;
+    }
+
+    /* SSCP does its own padding */
+    EVP_CIPHER_CTX_set_padding(cipher_ctx, 0);
+
+    return cipher_ctx;
+}
+
+static void SSCP_OpenSSL_Close(SSCP_CTX_ST* ctx)
+{
+    SSCP_OPENSSL_SESSION_ST* session = ctx->cryptoSession;
+
+    if (session == NULL)
+        return;
+
+    EVP_CIPHER_CTX_free(session->cipherAB);
+    EVP_CIPHER_CTX_free(session->decipherBA);
+    EVP_MAC_CTX_free(session->signAB);
+    EVP_MAC_CTX_free(session->signBA);
+    free(session);
+
+    ctx->cryptoSession = NULL;
+}
+
+static BOOL SSCP_OpenSSL_Open(SSCP_CTX_ST* ctx)
+{
+    SSCP_OPENSSL_SESSION_ST* session;
+    EVP_MAC* mac;
+
+    session = calloc(1, sizeof(SSCP_OPENSSL_SESSION_ST));
+    if (session == NULL)
+        return FALSE;
+    ctx->cryptoSession = session;
+    ctx->stats.trackedAllocations++;
+
+    session->cipherAB = SSCP_OpenSSL_NewCipher(ctx->sessionKeyCipherAB, TRUE);
+    session->decipherBA = SSCP_OpenSSL_NewCipher(ctx->sessionKeyCipherBA, FALSE);
+
+    mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+    if (mac != NULL)
+    {
+        session->signAB = SSCP_OpenSSL_NewHMAC(mac, ctx->sessionKeySignAB);
+        session->signBA = SSCP_OpenSSL_NewHMAC(mac, ctx->sessionKeySignBA);
+        EVP_MAC_free(mac); /* The contexts hold their own reference */
+    }
+
+    if ((session->cipherAB == NULL) || (session->decipherBA == NULL) || (session->signAB == NULL) || (session->signBA == NULL))
+    {
+        SSCP_OpenSSL_Close(ctx);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static BOOL SSCP_OpenSSL_CBC(EVP_CIPHER_CTX* cipher_ctx, const BYTE initVector[16], BYTE buffer[], DWORD length)
+{
+    int outl = 0;
+
+    if ((initVector == NULL) || (buffer == NULL) || ((length % 16) != 0) || (length > INT_MAX))
+        return FALSE;
+
+    /* Same key, new IV */
+    if (!EVP_CipherInit_ex(cipher_ctx, NULL, NULL, NULL, initVector, -1))
+        return FALSE;
+    if (!EVP_CipherUpdate(cipher_ctx, buffer, &outl, buffer, (int)length))
+        return FALSE;
+
+    return ((DWORD)outl == length) ? TRUE : FALSE;
+}
+
+static BOOL SSCP_OpenSSL_HMAC(EVP_MAC_CTX* mac_ctx, const BYTE buffer[], DWORD length, BYTE hmac[32])
+{
+    size_t outl = 0;
+
+    /* Same key, new message */
+    if (!EVP_MAC_init(mac_ctx, NULL, 0, NULL))
+        return FALSE;
+    if (!EVP_MAC_update(mac_ctx, buffer, length))
+        return FALSE;
+    if (!EVP_MAC_final(mac_ctx, hmac, &outl, 32))
+        return FALSE;
+
+    return (outl == 32) ? TRUE : FALSE;
+}
+
+static BOOL SSCP_OpenSSL_Cipher(SSCP_CTX_ST* ctx, const BYTE initVector[16], BYTE buffer[], DWORD length)
+{
+    SSCP_OPENSSL_SESSION_ST* session = ctx->cryptoSession;
+
+    if (session == NULL)
+        return FALSE;
+
+    return SSCP_OpenSSL_CBC(session->cipherAB, initVector, buffer, length);
+}
+
+static BOOL SSCP_OpenSSL_Decipher(SSCP_CTX_ST* ctx, const BYTE initVector[16], BYTE buffer[], DWORD length)
+{
+    SSCP_OPENSSL_SESSION_ST* session = ctx->cryptoSession;
+
+    if (session == NULL)
+        return FALSE;
+
+    return SSCP_OpenSSL_CBC(session->decipherBA, initVector, buffer, length);
+}
+
+static BOOL SSCP_OpenSSL_Sign(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length, BYTE hmac[32])
+{
+    SSCP_OPENSSL_SESSION_ST* session = ctx->cryptoSession;
+
+    if ((session == NULL) || (buffer == NULL) || (hmac == NULL))
+        return FALSE;
+
+    return SSCP_OpenSSL_HMAC(session->signAB, buffer, length, hmac);
+}
+
+static BOOL SSCP_OpenSSL_Verify(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length, BYTE hmac[32])
+{
+    SSCP_OPENSSL_SESSION_ST* session = ctx->cryptoSession;
+
+    if ((session == NULL) || (buffer == NULL) || (hmac == NULL))
+        return FALSE;
+
+    return SSCP_OpenSSL_HMAC(session->signBA, buffer, length, hmac);
+}
+
+static BOOL SSCP_OpenSSL_OneShotHMAC(const BYTE keyValue[16], const BYTE buffer[], DWORD length, BYTE hmac[32])
+{
+    size_t outl = 0;
+
+    if ((keyValue == NULL) || (buffer == NULL) || (hmac == NULL))
+        return FALSE;
+
+    if (EVP_Q_mac(NULL, "HMAC", NULL, "SHA256", NULL, keyValue, 16, buffer, length, hmac, 32, &outl) == NULL)
+        return FALSE;
+
+    return (outl == 32) ? TRUE : FALSE;
+}
+
+/* OpenSSL has its own DRBG, per thread and reseeded after fork() */
+static BOOL SSCP_OpenSSL_Random(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD length)
+{
+    (void)ctx;
+
+    if ((buffer == NULL) || (length > INT_MAX))
+        return FALSE;
+
+    return (RAND_bytes(buffer, (int)length) == 1) ? TRUE : FALSE;
+}
+
+const SSCP_CRYPTO_PROVIDER_ST SSCP_CRYPTO_OPENSSL = {
+    SSCP_CRYPTO_PROVIDER_OPENSSL,
+    SSCP_OpenSSL_Open,
+    SSCP_OpenSSL_Close,
+    SSCP_OpenSSL_Cipher,
+    SSCP_OpenSSL_Decipher,
+    SSCP_OpenSSL_Sign,
+    SSCP_OpenSSL_Verify,
+    SSCP_OpenSSL_OneShotHMAC,
+    SSCP_OpenSSL_Random
+};
+
+#endif
@@ -71,3 +71,168 @@ BOOL SSCP_GetRandom(BYTE buffer[], DWORD bufferSz)
 }
 
 #endif
+
+/*
+ * Per-context DRBG
+ * ----------------
+ *
+ * CTR_DRBG of SP 800-90A with AES-128 and no derivation function. The system's RNG is only used for the seed: at
+ * first use, every SSCP_DRBG_RESEED_INTERVAL bytes, and in the child after a fork() (the child would otherwise hand
+ * out the same IVs as its parent). The key is replaced after every refill of the buffer, and served bytes are wiped,
+ * so the state never allows to find output that has already been used.
+ */
+
+#ifdef _WIN32
+
+static DWORD SSCP_GetForkCount(void)
+{
+    return 0;
+}
+
+#else
+
+#include <pthread.h>
+
+static volatile DWORD SSCP_ForkCount = 0;
+static pthread_once_t SSCP_ForkOnce = PTHREAD_ONCE_INIT;
+
+static void SSCP_ForkChild(void)
+{
+    SSCP_ForkCount++;
+}
+
+static void SSCP_ForkRegister(void)
+{
+    pthread_atfork(NULL, NULL, SSCP_ForkChild);
+}
+
+/* Cheaper than getpid(), which is a system call with recent C libraries */
+static DWORD SSCP_GetForkCount(void)
+{
+    pthread_once(&SSCP_ForkOnce, SSCP_ForkRegister);
+    return SSCP_ForkCount;
+}
+
+#endif
+
+static void SSCP_DRBG_Increment(BYTE v[16])
+{
+    int i;
+
+    for (i = 15; i >= 0; i--)
+        if (++v[i] != 0)
+            break;
+}
+
+/* CTR_DRBG_Update: new K and V from the next two blocks of output, XORed with provided (if any) */
+static void SSCP_DRBG_Update(SSCP_DRBG_ST* drbg, const BYTE provided[32])
+{
+    BYTE temp[32];
+    int i;
+
+    SSCP_DRBG_Increment(drbg->v);
+    memcpy(&temp[0], drbg->v, 16);
+    SSCP_DRBG_Increment(drbg->v);
+    memcpy(&temp[16], drbg->v, 16);
+    AES_EncryptBlocks(&drbg->aes, temp, 2);
+
+    if (provided != NULL)
+        for (i = 0; i < 32; i++)
+            temp[i] ^= provided[i];
+
+    AES_InitEncrypt(&drbg->aes, &temp[0]);
+    memcpy(drbg->v, &temp[16], 16);
+
+    memset(temp, 0, sizeof(temp));
+}
+
+static BOOL SSCP_DRBG_Reseed(SSCP_DRBG_ST* drbg)
+{
+    BYTE seed[32];
+
+    /* Register for fork() before the first output may exist */
+    drbg->forkCount = SSCP_GetForkCount();
+
+    if (!SSCP_GetRandom(seed, sizeof(seed)))
+        return FALSE;
+
+    if (!drbg->seeded)
+    {
+        /* Instantiate: K = 0, V = 0 */
+        BYTE zero[16] = { 0 };
+        AES_InitEncrypt(&drbg->aes, zero);
+        memset(drbg->v, 0, sizeof(drbg->v));
+    }
+
+    SSCP_DRBG_Update(drbg, seed);
+    memset(seed, 0, sizeof(seed));
+
+    /* What was computed with the previous state is dropped (it is known to the parent after a fork) */
+    memset(drbg->buffer, 0, sizeof(drbg->buffer));
+    drbg->available = 0;
+    drbg->served = 0;
+    drbg->seeded = TRUE;
+
+    return TRUE;
+}
+
+static void SSCP_DRBG_Refill(SSCP_DRBG_ST* drbg)
+{
+    DWORD i;
+
+    for (i = 0; i < SSCP_DRBG_BUFFER_SIZE; i += 16)
+    {
+        SSCP_DRBG_Increment(drbg->v);
+        memcpy(&drbg->buffer[i], drbg->v, 16);
+    }
+    AES_EncryptBlocks(&drbg->aes, drbg->buffer, SSCP_DRBG_BUFFER_SIZE / 16);
+
+    /* Backtracking resistance */
+    SSCP_DRBG_Update(drbg, NULL);
+
+    drbg->available = SSCP_DRBG_BUFFER_SIZE;
+}
+
+/**
+ * \brief random bytes from the context's DRBG, seeding or reseeding it when needed
+ */
+BOOL SSCP_DRBG_Generate(SSCP_DRBG_ST* drbg, BYTE buffer[], DWORD length)
+{
+    if ((drbg == NULL) || ((buffer == NULL) && (length != 0)))
+        return FALSE;
+
+    if (!drbg->seeded || (drbg->forkCount != SSCP_GetForkCount()) || (drbg->served >= SSCP_DRBG_RESEED_INTERVAL))
+    {
+        if (!SSCP_DRBG_Reseed(drbg))
+            return FALSE;
+    }
+
+    drbg->served += length;
+
+    while (length > 0)
+    {
+        BYTE* p;
+        DWORD chunk;
+
+        if (drbg->available == 0)
+            SSCP_DRBG_Refill(drbg);
+
+        chunk = (length < drbg->available) ? length : drbg->available;
+        p = &drbg->buffer[SSCP_DRBG_BUFFER_SIZE - drbg->available];
+
+        memcpy(buffer, p, chunk);
+        memset(p, 0, chunk);
+
+        drbg->available -= chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+
+    return TRUE;
+}
+
+void SSCP_DRBG_Clear(SSCP_DRBG_ST* drbg)
+{
+    if (drbg != NULL)
+        memset(drbg, 0, sizeof(SSCP_DRBG_ST));
+}
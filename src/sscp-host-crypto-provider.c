@@ -0,0 +1,133 @@
+#include "sscp-host_i.h"
+
+/*
+ * Built-in provider: the library's own AES and SHA-256, with the session keys expanded into the context
+ */
+
+static BOOL SSCP_Builtin_Open(SSCP_CTX_ST* ctx)
+{
+    /* We only encrypt with Kcab, only decrypt with Kcba */
+    AES_InitEncrypt(&ctx->sessionCipherAB, ctx->sessionKeyCipherAB);
+    AES_Init(&ctx->sessionDecipherBA, ctx->sessionKeyCipherBA);
+    HMAC_SHA256_Prepare(&ctx->sessionSignAB, ctx->sessionKeySignAB, 16);
+    HMAC_SHA256_Prepare(&ctx->sessionSignBA, ctx->sessionKeySignBA, 16);
+    return TRUE;
+}
+
+static void SSCP_Builtin_Close(SSCP_CTX_ST* ctx)
+{
+    memset(&ctx->sessionCipherAB, 0, sizeof(ctx->sessionCipherAB));
+    memset(&ctx->sessionDecipherBA, 0, sizeof(ctx->sessionDecipherBA));
+    memset(&ctx->sessionSignAB, 0, sizeof(ctx->sessionSignAB));
+    memset(&ctx->sessionSignBA, 0, sizeof(ctx->sessionSignBA));
+}
+
+static BOOL SSCP_Builtin_Cipher(SSCP_CTX_ST* ctx, const BYTE initVector[16], BYTE buffer[], DWORD length)
+{
+    return SSCP_Cipher_Ctx(&ctx->sessionCipherAB, initVector, buffer, length);
+}
+
+static BOOL SSCP_Builtin_Decipher(SSCP_CTX_ST* ctx, const BYTE initVector[16], BYTE buffer[], DWORD length)
+{
+    return SSCP_Decipher_Ctx(&ctx->sessionDecipherBA, initVector, buffer, length);
+}
+
+static BOOL SSCP_Builtin_Sign(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length, BYTE hmac[32])
+{
+    return SSCP_HMAC_Ctx(&ctx->sessionSignAB, buffer, length, hmac);
+}
+
+static BOOL SSCP_Builtin_Verify(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length, BYTE hmac[32])
+{
+    return SSCP_HMAC_Ctx(&ctx->sessionSignBA, buffer, length, hmac);
+}
+
+static BOOL SSCP_Builtin_Random(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD length)
+{
+    return SSCP_DRBG_Generate(&ctx->drbg, buffer, length);
+}
+
+const SSCP_CRYPTO_PROVIDER_ST SSCP_CRYPTO_BUILTIN = {
+    SSCP_CRYPTO_PROVIDER_BUILTIN,
+    SSCP_Builtin_Open,
+    SSCP_Builtin_Close,
+    SSCP_Builtin_Cipher,
+    SSCP_Builtin_Decipher,
+    SSCP_Builtin_Sign,
+    SSCP_Builtin_Verify,
+    SSCP_HMAC,
+    SSCP_Builtin_Random
+};
+
+/**
+ * \brief the provider for a SSCP_CRYPTO_PROVIDER_xxx, NULL if it has not been compiled in
+ */
+const SSCP_CRYPTO_PROVIDER_ST* SSCP_GetCryptoProvider(DWORD provider)
+{
+    switch (provider)
+    {
+        case SSCP_CRYPTO_PROVIDER_BUILTIN:
+            return &SSCP_CRYPTO_BUILTIN;
+#if SSCP_WITH_OPENSSL
+        case SSCP_CRYPTO_PROVIDER_OPENSSL:
+            return &SSCP_CRYPTO_OPENSSL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * \brief let the provider of the context prepare the session keys (once per session)
+ */
+BOOL SSCP_CryptoOpen(SSCP_CTX_ST* ctx)
+{
+    SSCP_CryptoClose(ctx);
+
+    if (ctx->crypto == NULL)
+        ctx->crypto = &SSCP_CRYPTO_BUILTIN;
+
+    if (!ctx->crypto->open(ctx))
+        return FALSE;
+
+    ctx->cryptoOpen = TRUE;
+    return TRUE;
+}
+
+void SSCP_CryptoClose(SSCP_CTX_ST* ctx)
+{
+    if (!ctx->cryptoOpen)
+        return;
+
+    ctx->crypto->close(ctx);
+    ctx->cryptoOpen = FALSE;
+}
+
+/**
+ * \brief choose the implementation of the session cryptography (SSCP_CRYPTO_PROVIDER_xxx)
+ *
+ * May be called at any time: if a session is open, its keys are handed over to the new provider.
+ */
+LONG SSCP_SetCryptoProvider(SSCP_CTX_ST* ctx, DWORD provider)
+{
+    const SSCP_CRYPTO_PROVIDER_ST* crypto;
+    BOOL wasOpen;
+
+    if (ctx == NULL)
+        return SSCP_ERR_INVALID_CONTEXT;
+
+    crypto = SSCP_GetCryptoProvider(provider);
+    if (crypto == NULL)
+        return SSCP_ERR_INVALID_PARAMETER;
+    if (crypto == ctx->crypto)
+        return SSCP_SUCCESS;
+
+    wasOpen = ctx->cryptoOpen;
+    SSCP_CryptoClose(ctx);
+    ctx->crypto = crypto;
+
+    if (wasOpen && !SSCP_CryptoOpen(ctx))
+        return SSCP_ERR_INTERNAL_FAILURE;
+
+    return SSCP_SUCCESS;
+}
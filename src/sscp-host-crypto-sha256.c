@@ -47,7 +47,7 @@
  /* This is based on SHA256 implementation in LibTomCrypt that was released into
   * public domain by Tom St Denis. */
   /* the K array */
-static const unsigned long K[64] = {
+static const unsigned int K[64] = {
 	0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL, 0x3956c25bUL,
 	0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL, 0xd807aa98UL, 0x12835b01UL,
 	0x243185beUL, 0x550c7dc3UL, 0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL,
@@ -63,14 +63,12 @@ static const unsigned long K[64] = {
 	0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL
 };
 
-/* Various logical functions */
-#define RORc(x, y) \
-( ((((unsigned long) (x) & 0xFFFFFFFFUL) >> (unsigned long) ((y) & 31)) | \
-   ((unsigned long) (x) << (unsigned long) (32 - ((y) & 31)))) & 0xFFFFFFFFUL)
+/* Various logical functions, on 32-bit words (DWORD is 64-bit on some platforms, masking it every time is costly) */
+#define RORc(x, y)      (((x) >> (y)) | ((x) << (32 - (y))))
 #define Ch(x,y,z)       (z ^ (x & (y ^ z)))
 #define Maj(x,y,z)      (((x | y) & z) | (x & y))
 #define S(x, n)         RORc((x), (n))
-#define R(x, n)         (((x)&0xFFFFFFFFUL)>>(n))
+#define R(x, n)         ((x) >> (n))
 #define Sigma0(x)       (S(x, 2) ^ S(x, 13) ^ S(x, 22))
 #define Sigma1(x)       (S(x, 6) ^ S(x, 11) ^ S(x, 25))
 #define Gamma0(x)       (S(x, 7) ^ S(x, 18) ^ R(x, 3))
@@ -78,52 +76,123 @@ static const unsigned long K[64] = {
 #ifndef MIN
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 #endif
-/* compress 512-bits */
-static int sha256_compress(SHA256_CTX_ST* ctx, unsigned char* buf)
-{
-	DWORD S[8], W[64], t0, t1;
-	DWORD t;
-	int i;
 
-	/* copy state into S */
-	for (i = 0; i < 8; i++)
-	{
-		S[i] = ctx->state[i];
-	}
-	/* copy the state into 512-bits into W[0..15] */
-	for (i = 0; i < 16; i++)
-		W[i] = WPA_GET_BE32(buf + (4 * i));
+#ifndef SSCP_SHA256_DEFAULT_BACKEND
+#define SSCP_SHA256_DEFAULT_BACKEND SHA256_BACKEND_AUTO
+#endif
 
-	/* fill W[16..63] */
-	for (i = 16; i < 64; i++)
+static DWORD SHA256_BACKEND = SSCP_SHA256_DEFAULT_BACKEND;
+
+/**
+ * \brief force the SHA-256 implementation (for test and benchmark), returns FALSE if not available on this CPU
+ */
+BOOL SHA256_SetBackend(DWORD backend)
+{
+	switch (backend)
 	{
-		W[i] = Gamma1(W[i - 2]) + W[i - 7] + Gamma0(W[i - 15]) + W[i - 16];
+		case SHA256_BACKEND_AUTO:
+		case SHA256_BACKEND_PORTABLE:
+		break;
+
+		case SHA256_BACKEND_SHANI:
+#if SSCP_HAVE_X86_INTRINSICS
+			if ((SSCP_GetCpuFeatures() & (SSCP_CPU_SHA | SSCP_CPU_SSE41)) != (SSCP_CPU_SHA | SSCP_CPU_SSE41))
+				return FALSE;
+		break;
+#else
+			return FALSE;
+#endif
+
+		default:
+			return FALSE;
 	}
-	/* Compress */
+
+	SHA256_BACKEND = backend;
+	return TRUE;
+}
+
+/* Compress, fully unrolled: the eight working variables are renamed from one round to the next instead of moved */
 #define RND(a,b,c,d,e,f,g,h,i)                          \
 	t0 = h + Sigma1(e) + Ch(e, f, g) + K[i] + W[i];	\
 	t1 = Sigma0(a) + Maj(a, b, c);			\
 	d += t0;					\
 	h  = t0 + t1;
-	for (i = 0; i < 64; ++i)
+
+#define RND8(i)                                         \
+	RND(a, b, c, d, e, f, g, h, (i) + 0);		\
+	RND(h, a, b, c, d, e, f, g, (i) + 1);		\
+	RND(g, h, a, b, c, d, e, f, (i) + 2);		\
+	RND(f, g, h, a, b, c, d, e, (i) + 3);		\
+	RND(e, f, g, h, a, b, c, d, (i) + 4);		\
+	RND(d, e, f, g, h, a, b, c, (i) + 5);		\
+	RND(c, d, e, f, g, h, a, b, (i) + 6);		\
+	RND(b, c, d, e, f, g, h, a, (i) + 7);
+
+static void sha256_compress_portable(DWORD state[8], const BYTE* buf, size_t blocks)
+{
+	unsigned int a, b, c, d, e, f, g, h;
+	unsigned int W[64], t0, t1;
+	int i;
+
+	for (; blocks > 0; blocks--, buf += 64)
 	{
-		RND(S[0], S[1], S[2], S[3], S[4], S[5], S[6], S[7], i);
-		t = S[7];
-		S[7] = S[6];
-		S[6] = S[5];
-		S[5] = S[4];
-		S[4] = S[3];
-		S[3] = S[2];
-		S[2] = S[1];
-		S[1] = S[0];
-		S[0] = t;
+		/* copy the state into 512-bits into W[0..15] */
+		for (i = 0; i < 16; i++)
+			W[i] = (unsigned int) WPA_GET_BE32(buf + (4 * i));
+
+		/* fill W[16..63] */
+		for (i = 16; i < 64; i++)
+			W[i] = Gamma1(W[i - 2]) + W[i - 7] + Gamma0(W[i - 15]) + W[i - 16];
+
+		a = (unsigned int) state[0]; b = (unsigned int) state[1];
+		c = (unsigned int) state[2]; d = (unsigned int) state[3];
+		e = (unsigned int) state[4]; f = (unsigned int) state[5];
+		g = (unsigned int) state[6]; h = (unsigned int) state[7];
+
+		RND8(0);
+		RND8(8);
+		RND8(16);
+		RND8(24);
+		RND8(32);
+		RND8(40);
+		RND8(48);
+		RND8(56);
+
+		/* feedback */
+		state[0] = (unsigned int) (state[0] + a);
+		state[1] = (unsigned int) (state[1] + b);
+		state[2] = (unsigned int) (state[2] + c);
+		state[3] = (unsigned int) (state[3] + d);
+		state[4] = (unsigned int) (state[4] + e);
+		state[5] = (unsigned int) (state[5] + f);
+		state[6] = (unsigned int) (state[6] + g);
+		state[7] = (unsigned int) (state[7] + h);
 	}
-	/* feedback */
-	for (i = 0; i < 8; i++)
+}
+
+/**
+ * \brief TRUE when sha256_compress runs on the SHA extensions
+ */
+BOOL SHA256_UsesSHANI(void)
+{
+#if SSCP_HAVE_X86_INTRINSICS
+	return (SHA256_BACKEND != SHA256_BACKEND_PORTABLE) && ((SSCP_GetCpuFeatures() & (SSCP_CPU_SHA | SSCP_CPU_SSE41)) == (SSCP_CPU_SHA | SSCP_CPU_SSE41));
+#else
+	return FALSE;
+#endif
+}
+
+/* compress 'blocks' times 512-bits */
+static void sha256_compress(SHA256_CTX_ST* ctx, const BYTE* buf, size_t blocks)
+{
+#if SSCP_HAVE_X86_INTRINSICS
+	if (SHA256_UsesSHANI())
 	{
-		ctx->state[i] = ctx->state[i] + S[i];
+		SHA256_NI_Compress(ctx->state, buf, blocks);
+		return;
 	}
-	return 0;
+#endif
+	sha256_compress_portable(ctx->state, buf, blocks);
 }
 
 /* Initialize the hash state */
@@ -155,32 +224,35 @@ void SHA256_Update(SHA256_CTX_ST* ctx, const BYTE data[], size_t len)
 #define block_size 64
 	if (ctx->curlen > sizeof(ctx->buf))
 		return;
-	while (len > 0)
+
+	/* Complete the pending block */
+	if (ctx->curlen > 0)
 	{
-		if (ctx->curlen == 0 && len >= block_size)
-		{
-			if (sha256_compress(ctx, (unsigned char*)data) < 0)
-				return;
-			ctx->length += block_size * 8;
-			data += block_size;
-			len -= block_size;
-		}
-		else
-		{
-			n = MIN(len, (block_size - ctx->curlen));
-			memcpy(ctx->buf + ctx->curlen, data, n);
-			ctx->curlen += (DWORD) n;
-			data += n;
-			len -= n;
-			if (ctx->curlen == block_size)
-			{
-				if (sha256_compress(ctx, ctx->buf) < 0)
-					return;
-				ctx->length += 8 * block_size;
-				ctx->curlen = 0;
-			}
-		}
+		n = MIN(len, (block_size - ctx->curlen));
+		memcpy(ctx->buf + ctx->curlen, data, n);
+		ctx->curlen += (DWORD) n;
+		data += n;
+		len -= n;
+		if (ctx->curlen < block_size)
+			return;
+		sha256_compress(ctx, ctx->buf, 1);
+		ctx->length += 8 * block_size;
+		ctx->curlen = 0;
 	}
+
+	/* Whole blocks are hashed in place */
+	n = len / block_size;
+	if (n > 0)
+	{
+		sha256_compress(ctx, data, n);
+		ctx->length += (DWORD) (8 * block_size * n);
+		data += block_size * n;
+		len -= block_size * n;
+	}
+
+	/* Keep the tail for later */
+	memcpy(ctx->buf, data, len);
+	ctx->curlen = (DWORD) len;
 }
 
 /**
@@ -210,7 +282,7 @@ void SHA256_Final(SHA256_CTX_ST* ctx, BYTE hash[SHA256_DIGEST_SIZE])
 		{
 			ctx->buf[ctx->curlen++] = (unsigned char)0;
 		}
-		sha256_compress(ctx, ctx->buf);
+		sha256_compress(ctx, ctx->buf, 1);
 		ctx->curlen = 0;
 	}
 	/* pad upto 56 bytes of zeroes */
@@ -221,7 +293,7 @@ void SHA256_Final(SHA256_CTX_ST* ctx, BYTE hash[SHA256_DIGEST_SIZE])
 	/* store length */
 	WPA_PUT_BE64(ctx->buf + 56, ctx->length);
 
-	sha256_compress(ctx, ctx->buf);
+	sha256_compress(ctx, ctx->buf, 1);
 
 	/* copy output */
 	for (i = 0; i < 8; i++)
@@ -0,0 +1,122 @@
+#include "sscp-host-crypto_i.h"
+
+#if SSCP_HAVE_X86_INTRINSICS
+
+#include <immintrin.h>
+
+/*
+ * SHA-256, 8 messages at once with AVX2
+ * -------------------------------------
+ *
+ * Each 32-bit element of a YMM register belongs to a different message ("lane"), so the rounds are the textbook ones
+ * with every operation done for the 8 messages. The blocks are transposed on load. The caller (HMAC_SHA256_ComputeBatch)
+ * has checked the CPU offers AVX2.
+ */
+
+static const unsigned int SHA256_X8_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define X8_ROR(x, n)	_mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define X8_XOR3(a, b, c)	_mm256_xor_si256(_mm256_xor_si256(a, b), c)
+#define X8_ADD3(a, b, c)	_mm256_add_epi32(_mm256_add_epi32(a, b), c)
+
+#define X8_S0(x)	X8_XOR3(X8_ROR(x, 2), X8_ROR(x, 13), X8_ROR(x, 22))
+#define X8_S1(x)	X8_XOR3(X8_ROR(x, 6), X8_ROR(x, 11), X8_ROR(x, 25))
+#define X8_G0(x)	X8_XOR3(X8_ROR(x, 7), X8_ROR(x, 18), _mm256_srli_epi32(x, 3))
+#define X8_G1(x)	X8_XOR3(X8_ROR(x, 17), X8_ROR(x, 19), _mm256_srli_epi32(x, 10))
+#define X8_CH(x, y, z)	_mm256_xor_si256(_mm256_and_si256(x, _mm256_xor_si256(y, z)), z)
+#define X8_MAJ(x, y, z)	_mm256_or_si256(_mm256_and_si256(x, y), _mm256_and_si256(z, _mm256_or_si256(x, y)))
+
+/* Round i; W[i & 15] must already hold w[i] */
+#define X8_ROUND(a, b, c, d, e, f, g, h, i) \
+	t1 = X8_ADD3(h, X8_S1(e), X8_CH(e, f, g)); \
+	t1 = X8_ADD3(t1, _mm256_set1_epi32((int)SHA256_X8_K[i]), W[(i) & 15]); \
+	d = _mm256_add_epi32(d, t1); \
+	h = X8_ADD3(t1, X8_S0(a), X8_MAJ(a, b, c))
+
+/* w[i] for i >= 16, in place of w[i - 16] */
+#define X8_SCHEDULE(i) \
+	W[(i) & 15] = _mm256_add_epi32(X8_ADD3(W[(i) & 15], X8_G1(W[((i) - 2) & 15]), W[((i) - 7) & 15]), X8_G0(W[((i) - 15) & 15]))
+
+/* 8 rows of 8 words (one per lane) become 8 words of 8 lanes */
+#define X8_TRANSPOSE(r, out) \
+	do { \
+		__m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]); \
+		__m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]); \
+		__m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]); \
+		__m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]); \
+		__m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2); \
+		__m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3); \
+		__m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6); \
+		__m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7); \
+		out[0] = _mm256_permute2x128_si256(u0, u4, 0x20); \
+		out[1] = _mm256_permute2x128_si256(u1, u5, 0x20); \
+		out[2] = _mm256_permute2x128_si256(u2, u6, 0x20); \
+		out[3] = _mm256_permute2x128_si256(u3, u7, 0x20); \
+		out[4] = _mm256_permute2x128_si256(u0, u4, 0x31); \
+		out[5] = _mm256_permute2x128_si256(u1, u5, 0x31); \
+		out[6] = _mm256_permute2x128_si256(u2, u6, 0x31); \
+		out[7] = _mm256_permute2x128_si256(u3, u7, 0x31); \
+	} while (0)
+
+SSCP_TARGET("avx2")
+void SHA256_X8_Compress(unsigned int state[8][SHA256_X8_LANES], const BYTE* const blocks[SHA256_X8_LANES])
+{
+	const __m256i swap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	__m256i a, b, c, d, e, f, g, h, t1;
+	__m256i W[16], rows[8];
+	int i, half;
+
+	for (half = 0; half < 2; half++)
+	{
+		for (i = 0; i < SHA256_X8_LANES; i++)
+			rows[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)&blocks[i][32 * half]), swap);
+		X8_TRANSPOSE(rows, (&W[8 * half]));
+	}
+
+	a = _mm256_loadu_si256((const __m256i*)state[0]);
+	b = _mm256_loadu_si256((const __m256i*)state[1]);
+	c = _mm256_loadu_si256((const __m256i*)state[2]);
+	d = _mm256_loadu_si256((const __m256i*)state[3]);
+	e = _mm256_loadu_si256((const __m256i*)state[4]);
+	f = _mm256_loadu_si256((const __m256i*)state[5]);
+	g = _mm256_loadu_si256((const __m256i*)state[6]);
+	h = _mm256_loadu_si256((const __m256i*)state[7]);
+
+	for (i = 0; i < 64; i += 8)
+	{
+		if (i >= 16)
+		{
+			X8_SCHEDULE(i + 0); X8_SCHEDULE(i + 1); X8_SCHEDULE(i + 2); X8_SCHEDULE(i + 3);
+			X8_SCHEDULE(i + 4); X8_SCHEDULE(i + 5); X8_SCHEDULE(i + 6); X8_SCHEDULE(i + 7);
+		}
+		X8_ROUND(a, b, c, d, e, f, g, h, i + 0);
+		X8_ROUND(h, a, b, c, d, e, f, g, i + 1);
+		X8_ROUND(g, h, a, b, c, d, e, f, i + 2);
+		X8_ROUND(f, g, h, a, b, c, d, e, i + 3);
+		X8_ROUND(e, f, g, h, a, b, c, d, i + 4);
+		X8_ROUND(d, e, f, g, h, a, b, c, i + 5);
+		X8_ROUND(c, d, e, f, g, h, a, b, i + 6);
+		X8_ROUND(b, c, d, e, f, g, h, a, i + 7);
+	}
+
+	_mm256_storeu_si256((__m256i*)state[0], _mm256_add_epi32(a, _mm256_loadu_si256((const __m256i*)state[0])));
+	_mm256_storeu_si256((__m256i*)state[1], _mm256_add_epi32(b, _mm256_loadu_si256((const __m256i*)state[1])));
+	_mm256_storeu_si256((__m256i*)state[2], _mm256_add_epi32(c, _mm256_loadu_si256((const __m256i*)state[2])));
+	_mm256_storeu_si256((__m256i*)state[3], _mm256_add_epi32(d, _mm256_loadu_si256((const __m256i*)state[3])));
+	_mm256_storeu_si256((__m256i*)state[4], _mm256_add_epi32(e, _mm256_loadu_si256((const __m256i*)state[4])));
+	_mm256_storeu_si256((__m256i*)state[5], _mm256_add_epi32(f, _mm256_loadu_si256((const __m256i*)state[5])));
+	_mm256_storeu_si256((__m256i*)state[6], _mm256_add_epi32(g, _mm256_loadu_si256((const __m256i*)state[6])));
+	_mm256_storeu_si256((__m256i*)state[7], _mm256_add_epi32(h, _mm256_loadu_si256((const __m256i*)state[7])));
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include "sscp-host-crypto_i.h"
+
+#if SSCP_HAVE_X86_INTRINSICS
+
+#include <immintrin.h>
+
+/*
+ * SHA-256 with the SHA extensions
+ * -------------------------------
+ *
+ * sha256rnds2 does two rounds and wants the state split as ABEF and CDGH; sha256msg1/sha256msg2 extend the message
+ * schedule four words at a time. The caller (sha256_compress) has checked the CPU offers SHA and SSE4.1.
+ */
+
+static const unsigned int SHA256_NI_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* Four rounds with message words m */
+#define SHA256_NI_ROUNDS4(g, m) \
+	msg = _mm_add_epi32(m, _mm_loadu_si128((const __m128i*)&SHA256_NI_K[4 * (g)])); \
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+	msg = _mm_shuffle_epi32(msg, 0x0E); \
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg)
+
+/* next <- the four message words that follow cur */
+#define SHA256_NI_SCHEDULE(next, cur, prev) \
+	next = _mm_sha256msg2_epu32(_mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4)), cur)
+
+SSCP_TARGET("sha,sse4.1")
+void SHA256_NI_Compress(DWORD state[8], const BYTE data[], size_t blocks)
+{
+	const __m128i swap = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+	__m128i state0, state1, save0, save1, msg, tmp;
+	__m128i m0, m1, m2, m3;
+	unsigned int words[8];
+	int i;
+
+	/* DWORD may be wider than 32 bits */
+	for (i = 0; i < 8; i++)
+		words[i] = (unsigned int)state[i];
+
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&words[0]), 0xB1);    /* CDAB */
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&words[4]), 0x1B); /* EFGH */
+	state0 = _mm_alignr_epi8(tmp, state1, 8);                                      /* ABEF */
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);                                   /* CDGH */
+
+	for (; blocks > 0; blocks--, data += 64)
+	{
+		save0 = state0;
+		save1 = state1;
+
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&data[0]), swap);
+		SHA256_NI_ROUNDS4(0, m0);
+
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&data[16]), swap);
+		SHA256_NI_ROUNDS4(1, m1);
+		m0 = _mm_sha256msg1_epu32(m0, m1);
+
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&data[32]), swap);
+		SHA256_NI_ROUNDS4(2, m2);
+		m1 = _mm_sha256msg1_epu32(m1, m2);
+
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&data[48]), swap);
+		SHA256_NI_ROUNDS4(3, m3);
+		SHA256_NI_SCHEDULE(m0, m3, m2);
+		m2 = _mm_sha256msg1_epu32(m2, m3);
+
+		for (i = 4; i < 12; i += 4)
+		{
+			SHA256_NI_ROUNDS4(i, m0);
+			SHA256_NI_SCHEDULE(m1, m0, m3);
+			m3 = _mm_sha256msg1_epu32(m3, m0);
+
+			SHA256_NI_ROUNDS4(i + 1, m1);
+			SHA256_NI_SCHEDULE(m2, m1, m0);
+			m0 = _mm_sha256msg1_epu32(m0, m1);
+
+			SHA256_NI_ROUNDS4(i + 2, m2);
+			SHA256_NI_SCHEDULE(m3, m2, m1);
+			m1 = _mm_sha256msg1_epu32(m1, m2);
+
+			SHA256_NI_ROUNDS4(i + 3, m3);
+			SHA256_NI_SCHEDULE(m0, m3, m2);
+			m2 = _mm_sha256msg1_epu32(m2, m3);
+		}
+
+		SHA256_NI_ROUNDS4(12, m0);
+		SHA256_NI_SCHEDULE(m1, m0, m3);
+		m3 = _mm_sha256msg1_epu32(m3, m0);
+
+		SHA256_NI_ROUNDS4(13, m1);
+		SHA256_NI_SCHEDULE(m2, m1, m0);
+
+		SHA256_NI_ROUNDS4(14, m2);
+		SHA256_NI_SCHEDULE(m3, m2, m1);
+
+		SHA256_NI_ROUNDS4(15, m3);
+
+		state0 = _mm_add_epi32(state0, save0);
+		state1 = _mm_add_epi32(state1, save1);
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1B);      /* FEBA */
+	state1 = _mm_shuffle_epi32(state1, 0xB1);   /* DCHG */
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0); /* DCBA */
+	state1 = _mm_alignr_epi8(state1, tmp, 8);   /* HGFE */
+
+	_mm_storeu_si128((__m128i*)&words[0], state0);
+	_mm_storeu_si128((__m128i*)&words[4], state1);
+	for (i = 0; i < 8; i++)
+		state[i] = words[i];
+}
+
+#endif
@@ -2,24 +2,16 @@
 
 BOOL SSCP_DEBUG_CRYPTO = FALSE;
 
-BOOL SSCP_ComputeSessionKeys(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], const BYTE rndA[16], const BYTE rndB[16])
+/**
+ * \brief what the authentication with this key needs, computed once: K' = AES (K, K) expanded, and the HMAC midstates of K
+ */
+void SSCP_PrepareAuthKey(SSCP_AUTH_KEY_ST* authKey, const BYTE authKeyValue[16])
 {
     BYTE Kp[16];
-    BYTE W[16];
-    BYTE T[64];
     DWORD i;
 
-    if (ctx == NULL)
-        return FALSE;
-    if (authKeyValue == NULL)
-        return FALSE;
-    if (rndA == NULL)
-        return FALSE;
-    if (rndB == NULL)
-        return FALSE;
-
-    memcpy(Kp, authKeyValue, 16);
-    memcpy(W, rndB, 16);
+    memcpy(authKey->value, authKeyValue, 16);
+    HMAC_SHA256_Prepare(&authKey->hmac, authKeyValue, 16);
 
     /*
      * DON'T REVEAL THE AUTHENTICATION KEY !!!
@@ -27,17 +19,15 @@ BOOL SSCP_ComputeSessionKeys(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], cons
     {
         SSCP_Trace("K =");
         for (i = 0; i < 16; i++)
-            SSCP_Trace("%02X", Kp[i]);
+            SSCP_Trace("%02X", authKeyValue[i]);
         SSCP_Trace("\n");
     }
      */
 
     /* K' = AES (K, K) */
-    {
-        AES_CTX_ST aes_ctx;
-        AES_Init(&aes_ctx, Kp);
-        AES_Encrypt(&aes_ctx, Kp);
-    }
+    memcpy(Kp, authKeyValue, 16);
+    AES_InitEncrypt(&authKey->kp, Kp);
+    AES_Encrypt(&authKey->kp, Kp);
 
     if (SSCP_DEBUG_CRYPTO)
     {
@@ -47,12 +37,58 @@ BOOL SSCP_ComputeSessionKeys(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], cons
         SSCP_Trace("\n");
     }
 
+    AES_InitEncrypt(&authKey->kp, Kp);
+    memset(Kp, 0, sizeof(Kp));
+}
+
+/**
+ * \brief HMAC-SHA256 of an authentication message; the builtin provider starts from the midstates of the key
+ */
+BOOL SSCP_AuthKeyHMAC(SSCP_CTX_ST* ctx, const SSCP_AUTH_KEY_ST* authKey, const BYTE buffer[], DWORD length, BYTE hmac[32])
+{
+    if (ctx->crypto == &SSCP_CRYPTO_BUILTIN)
+        return SSCP_HMAC_Ctx(&authKey->hmac, buffer, length, hmac);
+
+    return ctx->crypto->hmac(authKey->value, buffer, length, hmac);
+}
+
+BOOL SSCP_ComputeSessionKeys(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], const BYTE rndA[16], const BYTE rndB[16])
+{
+    SSCP_AUTH_KEY_ST authKey;
+    BOOL done;
+
+    if (authKeyValue == NULL)
+        return FALSE;
+
+    SSCP_PrepareAuthKey(&authKey, authKeyValue);
+    done = SSCP_ComputeSessionKeys_Ctx(ctx, &authKey.kp, rndA, rndB);
+    memset(&authKey, 0, sizeof(authKey));
+
+    return done;
+}
+
+/**
+ * \brief same as SSCP_ComputeSessionKeys, from K' already expanded
+ */
+BOOL SSCP_ComputeSessionKeys_Ctx(SSCP_CTX_ST* ctx, AES_CTX_ST* kp_ctx, const BYTE rndA[16], const BYTE rndB[16])
+{
+    BYTE W[16];
+    BYTE T[64];
+    DWORD i;
+
+    if (ctx == NULL)
+        return FALSE;
+    if (kp_ctx == NULL)
+        return FALSE;
+    if (rndA == NULL)
+        return FALSE;
+    if (rndB == NULL)
+        return FALSE;
+
+    memcpy(W, rndB, 16);
+
     /* W = AES (K', RndB) */
-    {
-        AES_CTX_ST aes_ctx;
-        AES_Init(&aes_ctx, Kp);
-        AES_Encrypt(&aes_ctx, W);
-    }
+    AES_Encrypt(kp_ctx, W);
 
     if (SSCP_DEBUG_CRYPTO)
     {
@@ -125,6 +161,10 @@ BOOL SSCP_ComputeSessionKeys(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], cons
     memcpy(ctx->sessionKeySignAB, &T[32], 16);
     memcpy(ctx->sessionKeySignBA, &T[48], 16);
 
+    /* Prepare them for the whole session */
+    if (!SSCP_CryptoOpen(ctx))
+        return FALSE;
+
     if (SSCP_DEBUG_CRYPTO)
     {
         SSCP_Trace("Kcab=");
@@ -148,14 +188,70 @@ BOOL SSCP_ComputeSessionKeys(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], cons
     return TRUE;
 }
 
+/**
+ * \brief AES-128 key diversification as in NXP AN10922: Kd = CMAC (K, 0x01 | input), the message being padded to 32 bytes
+ *
+ * Every input is 1 to 31 bytes long. All the keys go through each of the two AES blocks together.
+ */
+BOOL SSCP_DiversifyKeys(const BYTE masterKeyValue[16], const BYTE* const inputs[], const DWORD inputSz[], DWORD count, BYTE keys[][16])
+{
+    AES_CMAC_CTX_ST cmac_ctx;
+    BYTE M[32];
+    DWORD i, j;
+
+    if ((masterKeyValue == NULL) || (inputs == NULL) || (inputSz == NULL) || (keys == NULL))
+        return FALSE;
+    for (i = 0; i < count; i++)
+        if ((inputs[i] == NULL) || (inputSz[i] < 1) || (inputSz[i] > 31))
+            return FALSE;
+
+    AES_CMAC_Prepare(&cmac_ctx, masterKeyValue);
+
+    /* First block of each message */
+    for (i = 0; i < count; i++)
+    {
+        memset(M, 0, sizeof(M));
+        M[0] = 0x01;
+        memcpy(&M[1], inputs[i], inputSz[i]);
+        memcpy(keys[i], M, 16);
+    }
+    AES_EncryptBlocks(&cmac_ctx.aes, keys[0], count);
+
+    /* Last block, chained, padded if needed and masked with the matching subkey */
+    for (i = 0; i < count; i++)
+    {
+        memset(M, 0, sizeof(M));
+        M[0] = 0x01;
+        memcpy(&M[1], inputs[i], inputSz[i]);
+        if (inputSz[i] < 31)
+            M[1 + inputSz[i]] = 0x80;
+        for (j = 0; j < 16; j++)
+            keys[i][j] ^= M[16 + j] ^ ((inputSz[i] < 31) ? cmac_ctx.k2[j] : cmac_ctx.k1[j]);
+    }
+    AES_EncryptBlocks(&cmac_ctx.aes, keys[0], count);
+
+    memset(&cmac_ctx, 0, sizeof(cmac_ctx));
+    return TRUE;
+}
+
 BOOL SSCP_Cipher(const BYTE keyValue[16], const BYTE initVector[16], BYTE buffer[], DWORD length)
 {
     AES_CTX_ST aes_ctx;
-    BYTE carry[16];
-    DWORD i, j;
 
     if (keyValue == NULL)
         return FALSE;
+
+    AES_InitEncrypt(&aes_ctx, keyValue);
+
+    return SSCP_Cipher_Ctx(&aes_ctx, initVector, buffer, length);
+}
+
+BOOL SSCP_Cipher_Ctx(AES_CTX_ST* aes_ctx, const BYTE initVector[16], BYTE buffer[], DWORD length)
+{
+    BYTE carry[16];
+
+    if (aes_ctx == NULL)
+        return FALSE;
     if (initVector == NULL)
         return FALSE;
     if (buffer == NULL)
@@ -163,22 +259,8 @@ BOOL SSCP_Cipher(const BYTE keyValue[16], const BYTE initVector[16], BYTE buffer
     if ((length % 16) != 0)
         return FALSE;
 
-    AES_Init(&aes_ctx, keyValue);
-
     memcpy(carry, initVector, 16);
-
-    for (i = 0; i < length; i += 16)
-    {
-        /* Plain <- Plain XOR IV */
-        for (j = 0; j < 16; j++)
-            buffer[i + j] ^= carry[j];
-
-        /* Cipher <- E ( Plain XOR IV ) */
-        AES_Encrypt(&aes_ctx, &buffer[i]);
-
-        /* IV <- Cipher */
-        memcpy(carry, &buffer[i], 16);
-    }
+    AES_EncryptCBC(aes_ctx, carry, buffer, length / 16);
 
     return TRUE;
 }
@@ -186,11 +268,21 @@ BOOL SSCP_Cipher(const BYTE keyValue[16], const BYTE initVector[16], BYTE buffer
 BOOL SSCP_Decipher(const BYTE keyValue[16], const BYTE initVector[16], BYTE buffer[], DWORD length)
 {
     AES_CTX_ST aes_ctx;
-    BYTE carry[16];
-    DWORD i, j;
 
     if (keyValue == NULL)
         return FALSE;
+
+    AES_Init(&aes_ctx, keyValue);
+
+    return SSCP_Decipher_Ctx(&aes_ctx, initVector, buffer, length);
+}
+
+BOOL SSCP_Decipher_Ctx(AES_CTX_ST* aes_ctx, const BYTE initVector[16], BYTE buffer[], DWORD length)
+{
+    BYTE carry[16];
+
+    if (aes_ctx == NULL)
+        return FALSE;
     if (initVector == NULL)
         return FALSE;
     if (buffer == NULL)
@@ -198,25 +290,29 @@ BOOL SSCP_Decipher(const BYTE keyValue[16], const BYTE initVector[16], BYTE buff
     if ((length % 16) != 0)
         return FALSE;
 
-    AES_Init(&aes_ctx, keyValue);
-
     memcpy(carry, initVector, 16);
+    AES_DecryptCBC(aes_ctx, carry, buffer, length / 16);
 
-    for (i = 0; i < length; i += 16)
-    {
-        BYTE next_carry[16];
-        memcpy(next_carry, &buffer[i], 16);
+    return TRUE;
+}
 
-        /* Plain XOR IV <- D ( Cipher ) */
-        AES_Decrypt(&aes_ctx, &buffer[i]);
+/**
+ * \brief size of the signed part of a deciphered response (counter, opcode, length, data, type and status), from the
+ * length field of its first block
+ */
+DWORD SSCP_SignedResponseSz(const BYTE response[], DWORD length)
+{
+    DWORD signedSz;
 
-        /* Plain <- ( Plain XOR IV ) XOR IV */
-        for (j = 0; j < 16; j++)
-            buffer[i + j] ^= carry[j];
+    if (length < 16)
+        return length;
 
-        /* IV <- Cipher */
-        memcpy(carry, next_carry, 16);
-    }
+    signedSz = response[6];
+    signedSz <<= 8;
+    signedSz |= response[7];
+    signedSz += 4 + 2 + 2 + 2;
+    if (signedSz > length)
+        signedSz = length;
 
-    return TRUE;
+    return signedSz;
 }
@@ -1,7 +1,7 @@
 #ifndef __SSCP_CRYPTO_I_H__
 #define __SSCP_CRYPTO_I_H__
 
-#include "sscp-host_i.h"
+#include <sscp-host.h>
 
 #define SHA256_BLOCK_SIZE 64  	// SHA256 works on 64 byte blocks
 #define SHA256_DIGEST_SIZE 32	// SHA256 outputs a 32 byte digest
@@ -14,22 +14,179 @@ typedef struct
 	BYTE buf[64];
 } SHA256_CTX_ST;
 
+/* libcrypto exports the same names with other prototypes, keep ours out of its way */
+#define SHA256_Init   SSCP_SHA256_Init
+#define SHA256_Update SSCP_SHA256_Update
+#define SHA256_Final  SSCP_SHA256_Final
+
 void SHA256_Init(SHA256_CTX_ST* ctx);
 void SHA256_Update(SHA256_CTX_ST* ctx, const BYTE data[], size_t len);
 void SHA256_Final(SHA256_CTX_ST* ctx, BYTE hash[SHA256_DIGEST_SIZE]);
 
+#define SHA256_BACKEND_AUTO     0
+#define SHA256_BACKEND_PORTABLE 1
+#define SHA256_BACKEND_SHANI    2
+BOOL SHA256_SetBackend(DWORD backend);
+BOOL SHA256_UsesSHANI(void);
+
+/* SHA extensions implementation (x86 only, see SHA256_SetBackend) */
+void SHA256_NI_Compress(DWORD state[8], const BYTE data[], size_t blocks);
+
+typedef struct
+{
+	SHA256_CTX_ST inner;	/* Hash state once key XOR ipad has been absorbed */
+	SHA256_CTX_ST outer;	/* Hash state once key XOR opad has been absorbed */
+} HMAC_SHA256_CTX_ST;
+
+void HMAC_SHA256_Prepare(HMAC_SHA256_CTX_ST* hmac_ctx, const BYTE key[], BYTE key_size);
+void HMAC_SHA256_Compute(const HMAC_SHA256_CTX_ST* hmac_ctx, const BYTE data[], DWORD length, BYTE digest[SHA256_DIGEST_SIZE]);
+
+/* Multi-buffer HMAC: independent messages, each one with its own prepared key */
+typedef struct
+{
+	const HMAC_SHA256_CTX_ST* key;
+	const BYTE* data;
+	DWORD length;
+	BYTE* digest;		/* SHA256_DIGEST_SIZE bytes, may be within data */
+} HMAC_SHA256_JOB_ST;
+
+/* Below this many messages, the 8-lane engine computes more empty lanes than it saves */
+#ifndef HMAC_SHA256_BATCH_THRESHOLD
+#define HMAC_SHA256_BATCH_THRESHOLD 3
+#endif
+void HMAC_SHA256_ComputeBatch(HMAC_SHA256_JOB_ST jobs[], DWORD count);
+
+/* AVX2 implementation, 8 messages at once (x86 only): state[word][lane], one block per lane */
+#define SHA256_X8_LANES 8
+void SHA256_X8_Compress(unsigned int state[8][SHA256_X8_LANES], const BYTE* const blocks[SHA256_X8_LANES]);
+
 typedef struct
 {
 	DWORD key_bits;		/* Size of the key (bits)                */
 	DWORD rounds;		/* Key-length-dependent number of rounds */
 	DWORD enc_schd[60];	/* Key schedule                          */
 	DWORD dec_schd[60];	/* Key schedule                          */
+	DWORD backend;		/* Implementation chosen at init time    */
+	BYTE ni_enc[240];	/* Key schedule, AES-NI layout           */
+	BYTE ni_dec[240];	/* Key schedule, AES-NI layout           */
 } AES_CTX_ST;
 
+#define AES_BACKEND_AUTO     0
+#define AES_BACKEND_PORTABLE 1
+#define AES_BACKEND_AESNI    2
+#define AES_BACKEND_COMPACT  3
+BOOL AES_SetBackend(DWORD backend);
+DWORD AES_TablesSize(DWORD backend);
+
+void AES_InitEx(AES_CTX_ST* aes_ctx, const BYTE key[], DWORD key_bits);
 void AES_Init(AES_CTX_ST* aes_ctx, const BYTE key[16]);
+void AES_InitEncrypt(AES_CTX_ST* aes_ctx, const BYTE key[16]);
 void AES_Encrypt(AES_CTX_ST* aes_ctx, BYTE data[16]);
 void AES_Encrypt2(AES_CTX_ST* aes_ctx, BYTE outbuf[16], const BYTE inbuf[16]);
 void AES_Decrypt(AES_CTX_ST* aes_ctx, BYTE data[16]);
 void AES_Decrypt2(AES_CTX_ST* aes_ctx, BYTE outbuf[16], const BYTE inbuf[16]);
 
+/* Several blocks in a row, in place; the CBC functions update the IV so that a long buffer may be processed in chunks */
+#define AES_INTERLEAVE_BLOCKS 8
+void AES_EncryptBlocks(AES_CTX_ST* aes_ctx, BYTE data[], DWORD blocks);
+void AES_DecryptBlocks(AES_CTX_ST* aes_ctx, BYTE data[], DWORD blocks);
+void AES_EncryptCBC(AES_CTX_ST* aes_ctx, BYTE iv[16], BYTE data[], DWORD blocks);
+void AES_DecryptCBC(AES_CTX_ST* aes_ctx, BYTE iv[16], BYTE data[], DWORD blocks);
+
+/* Compact implementation, S-box only (see AES_SetBackend) */
+void AES_Compact_ExpandKey(AES_CTX_ST* aes_ctx, const BYTE key[], DWORD key_bits, BOOL decrypt);
+void AES_Compact_Encrypt(const AES_CTX_ST* aes_ctx, BYTE data[16]);
+void AES_Compact_Decrypt(const AES_CTX_ST* aes_ctx, BYTE data[16]);
+DWORD AES_Compact_TablesSize(void);
+
+/* AES-NI implementation (x86 only, see AES_SetBackend) */
+void AES_NI_ExpandKey128(AES_CTX_ST* aes_ctx, const BYTE key[16], BOOL decrypt);
+void AES_NI_Encrypt(const AES_CTX_ST* aes_ctx, BYTE outbuf[16], const BYTE inbuf[16]);
+void AES_NI_Decrypt(const AES_CTX_ST* aes_ctx, BYTE outbuf[16], const BYTE inbuf[16]);
+void AES_NI_EncryptBlocks(const AES_CTX_ST* aes_ctx, BYTE data[], DWORD blocks);
+void AES_NI_DecryptBlocks(const AES_CTX_ST* aes_ctx, BYTE data[], DWORD blocks);
+void AES_NI_EncryptCBC(const AES_CTX_ST* aes_ctx, BYTE iv[16], BYTE data[], DWORD blocks);
+void AES_NI_DecryptCBC(const AES_CTX_ST* aes_ctx, BYTE iv[16], BYTE data[], DWORD blocks);
+
+BOOL SSCP_HMAC_Ctx(const HMAC_SHA256_CTX_ST* hmac_ctx, const BYTE buffer[], DWORD length, BYTE hmac[32]);
+BOOL SSCP_Cipher_Ctx(AES_CTX_ST* aes_ctx, const BYTE initVector[16], BYTE buffer[], DWORD length);
+BOOL SSCP_Decipher_Ctx(AES_CTX_ST* aes_ctx, const BYTE initVector[16], BYTE buffer[], DWORD length);
+DWORD SSCP_SignedResponseSz(const BYTE response[], DWORD length);
+
+/* AES-CMAC, key schedule and subkeys prepared once */
+typedef struct
+{
+	AES_CTX_ST aes;
+	BYTE k1[16];
+	BYTE k2[16];
+} AES_CMAC_CTX_ST;
+
+typedef struct
+{
+	BYTE mac[16];		/* Chaining value */
+	BYTE block[16];		/* Last block seen, not yet processed */
+	DWORD blockSz;
+} AES_CMAC_STATE_ST;
+
+void AES_CMAC_Prepare(AES_CMAC_CTX_ST* cmac_ctx, const BYTE key[16]);
+void AES_CMAC_Init(AES_CMAC_STATE_ST* state);
+void AES_CMAC_Update(AES_CMAC_CTX_ST* cmac_ctx, AES_CMAC_STATE_ST* state, const BYTE data[], DWORD length);
+void AES_CMAC_Final(AES_CMAC_CTX_ST* cmac_ctx, AES_CMAC_STATE_ST* state, BYTE mac[16]);
+void AES_CMAC_Compute(AES_CMAC_CTX_ST* cmac_ctx, const BYTE data[], DWORD length, BYTE mac[16]);
+
+/* Authentication key, with what its use needs computed once (see SSCP_PrepareAuthKey) */
+typedef struct
+{
+	BYTE value[16];				/* K, for a provider that wants the raw key */
+	AES_CTX_ST kp;				/* K' = AES (K, K), expanded to encrypt RndB */
+	HMAC_SHA256_CTX_ST hmac;	/* Midstates of K, for hA and hB */
+} SSCP_AUTH_KEY_ST;
+
+void SSCP_PrepareAuthKey(SSCP_AUTH_KEY_ST* authKey, const BYTE authKeyValue[16]);
+BOOL SSCP_DiversifyKeys(const BYTE masterKeyValue[16], const BYTE* const inputs[], const DWORD inputSz[], DWORD count, BYTE keys[][16]);
+
+/* AES-CTR DRBG, one per context, so that IVs and random challenges do not cost a system call each */
+#define SSCP_DRBG_BUFFER_SIZE      256			/* Output is computed this much at a time */
+#define SSCP_DRBG_RESEED_INTERVAL  (1UL << 20)	/* Bytes served before asking the system for a new seed */
+
+typedef struct
+{
+	AES_CTX_ST aes;		/* Key K                                  */
+	BYTE v[16];			/* Counter V                              */
+	BYTE buffer[SSCP_DRBG_BUFFER_SIZE];
+	DWORD available;	/* Not served yet, at the end of buffer   */
+	DWORD served;		/* Since the last reseed                  */
+	DWORD forkCount;	/* Value of SSCP_ForkCount when seeded    */
+	BOOL seeded;
+} SSCP_DRBG_ST;
+
+BOOL SSCP_DRBG_Generate(SSCP_DRBG_ST* drbg, BYTE buffer[], DWORD length);
+void SSCP_DRBG_Clear(SSCP_DRBG_ST* drbg);
+
+/*
+ * Crypto provider: the primitives of a secure session. open() prepares the session keys found in the context,
+ * the other functions use them; hmac() and random() do not need a session.
+ */
+typedef struct
+{
+	DWORD id;	/* SSCP_CRYPTO_PROVIDER_xxx */
+	BOOL (*open)(SSCP_CTX_ST* ctx);
+	void (*close)(SSCP_CTX_ST* ctx);
+	BOOL (*cipher)(SSCP_CTX_ST* ctx, const BYTE initVector[16], BYTE buffer[], DWORD length);	/* AES-CBC with Kcab */
+	BOOL (*decipher)(SSCP_CTX_ST* ctx, const BYTE initVector[16], BYTE buffer[], DWORD length);	/* AES-CBC with Kcba */
+	BOOL (*sign)(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length, BYTE hmac[32]);	/* HMAC-SHA256 with Ksab */
+	BOOL (*verify)(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length, BYTE hmac[32]);	/* HMAC-SHA256 with Ksba, to check a response against */
+	BOOL (*hmac)(const BYTE keyValue[16], const BYTE buffer[], DWORD length, BYTE hmac[32]);
+	BOOL (*random)(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD length);
+} SSCP_CRYPTO_PROVIDER_ST;
+
+extern const SSCP_CRYPTO_PROVIDER_ST SSCP_CRYPTO_BUILTIN;
+extern const SSCP_CRYPTO_PROVIDER_ST SSCP_CRYPTO_OPENSSL;
+
+const SSCP_CRYPTO_PROVIDER_ST* SSCP_GetCryptoProvider(DWORD provider);
+BOOL SSCP_CryptoOpen(SSCP_CTX_ST* ctx);
+void SSCP_CryptoClose(SSCP_CTX_ST* ctx);
+
+#include "sscp-host_i.h"
+
 #endif
@@ -0,0 +1,528 @@
+#include "sscp-host_i.h"
+
+/*
+ * DESFire EV2 secure messaging
+ * ----------------------------
+ *
+ * Native DESFire commands are wrapped in ISO 7816-4 APDUs (CLA 90, INS = command, SW1 91, SW2 = status) and sent with
+ * TRANSCEIVE_APDU. The C-APDU is built straight in the command buffer of the context and the R-APDU is checked and
+ * deciphered where the exchange has left it; only a response that spans several frames is gathered elsewhere.
+ *
+ * After AuthenticateEV2First, with TI the transaction identifier and CmdCtr the command counter (little endian):
+ *   MAC of a command  = CMACt (SesAuthMACKey, Cmd | CmdCtr | TI | header | data)
+ *   MAC of a response = CMACt (SesAuthMACKey, Status | CmdCtr + 1 | TI | data)
+ *   IV of a command   = AES (SesAuthENCKey, A5 5A | TI | CmdCtr | 00..00)
+ *   IV of a response  = AES (SesAuthENCKey, 5A A5 | TI | CmdCtr + 1 | 00..00)
+ * CMACt keeps the odd bytes of the CMAC. Data are padded with 80 00..00 before being enciphered.
+ *
+ * The card drops the authentication on any error, and so does the session here.
+ */
+
+#define DESFIRE_CMD_AUTHENTICATE_EV2_FIRST 0x71
+#define DESFIRE_CMD_AUTHENTICATE_EV2_NON_FIRST 0x77
+#define DESFIRE_CMD_READ_DATA 0xAD
+#define DESFIRE_CMD_ADDITIONAL_FRAME 0xAF
+
+#define DESFIRE_STATUS_OK 0x00
+#define DESFIRE_STATUS_ADDITIONAL_FRAME 0xAF
+
+/* CLA INS P1 P2 Lc before the data, Le after */
+#define DESFIRE_APDU_HEADER_SIZE 5
+#define DESFIRE_MAX_DATA_SIZE 255
+#define DESFIRE_MACT_SIZE 8
+
+static void SSCP_DESFireClear(SSCP_DESFIRE_ST* df)
+{
+	df->authenticated = FALSE;
+	df->cmdCtr = 0;
+	memset(df->ti, 0, sizeof(df->ti));
+	memset(&df->sesEnc, 0, sizeof(df->sesEnc));
+	memset(&df->sesMac, 0, sizeof(df->sesMac));
+}
+
+/**
+ * \brief forget the authentication, when another card may be in the field
+ */
+void SSCP_DESFireReset(SSCP_CTX_ST* ctx)
+{
+	SSCP_DESFireClear(&ctx->desfire);
+}
+
+void SSCP_DESFireFree(SSCP_CTX_ST* ctx)
+{
+	SSCP_DESFIRE_ST* df = &ctx->desfire;
+
+	if (df->chainBuffer != NULL)
+	{
+		memset(df->chainBuffer, 0, SSCP_MAX_PAYLOAD_SIZE);
+		free(df->chainBuffer);
+	}
+	memset(df, 0, sizeof(SSCP_DESFIRE_ST));
+}
+
+void SSCP_DESFireLogout(SSCP_CTX_ST* ctx)
+{
+	if (ctx != NULL)
+		SSCP_DESFireClear(&ctx->desfire);
+}
+
+LONG SSCP_DESFireGetStatus(SSCP_CTX_ST* ctx, BYTE* status)
+{
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (status == NULL)
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	*status = ctx->desfire.status;
+	return SSCP_SUCCESS;
+}
+
+/**
+ * \brief SesAuthENCKey and SesAuthMACKey, from the key of the authentication and the two challenges
+ */
+void SSCP_DESFireSessionKeys(AES_CMAC_CTX_ST* kx, const BYTE rndA[16], const BYTE rndB[16], BYTE encKey[16], BYTE macKey[16])
+{
+	BYTE sv[32];
+	DWORD i;
+
+	/* SV = A5 5A 00 01 00 80 | RndA[15..14] | RndA[13..8] ^ RndB[15..10] | RndB[9..0] | RndA[7..0] */
+	sv[0] = 0xA5;
+	sv[1] = 0x5A;
+	sv[2] = 0x00;
+	sv[3] = 0x01;
+	sv[4] = 0x00;
+	sv[5] = 0x80;
+	sv[6] = rndA[0];
+	sv[7] = rndA[1];
+	for (i = 0; i < 6; i++)
+		sv[8 + i] = rndA[2 + i] ^ rndB[i];
+	memcpy(&sv[14], &rndB[6], 10);
+	memcpy(&sv[24], &rndA[8], 8);
+	AES_CMAC_Compute(kx, sv, sizeof(sv), encKey);
+
+	sv[0] = 0x5A;
+	sv[1] = 0xA5;
+	AES_CMAC_Compute(kx, sv, sizeof(sv), macKey);
+
+	memset(sv, 0, sizeof(sv));
+}
+
+/* Where the data of the native command go, in the command buffer of the context */
+static BYTE* SSCP_DESFireData(SSCP_CTX_ST* ctx)
+{
+	return &SSCP_CommandDataBuffer(ctx)[DESFIRE_APDU_HEADER_SIZE];
+}
+
+/**
+ * \brief wrap the command whose data are already in place, and send it
+ *
+ * *response points to the data of the R-APDU (without SW1 SW2) in the response buffer of the context.
+ */
+static LONG SSCP_DESFireTransceive(SSCP_CTX_ST* ctx, BYTE command, DWORD dataSz, BYTE** response, DWORD* responseSz)
+{
+	BYTE* apdu = SSCP_CommandDataBuffer(ctx);
+	DWORD apduSz = 0;
+	const BYTE* rapdu;
+	DWORD rapduSz;
+	LONG rc;
+
+	if (dataSz > DESFIRE_MAX_DATA_SIZE)
+		return SSCP_ERR_COMMAND_TOO_LONG;
+
+	apdu[apduSz++] = 0x90;
+	apdu[apduSz++] = command;
+	apdu[apduSz++] = 0x00;
+	apdu[apduSz++] = 0x00;
+	if (dataSz > 0)
+	{
+		apdu[apduSz++] = (BYTE)dataSz;
+		apduSz += dataSz;
+	}
+	apdu[apduSz++] = 0x00;
+
+	rc = SSCP_TransceiveNFCView(ctx, apdu, apduSz, &rapdu, &rapduSz);
+	if (rc)
+		return rc;
+
+	if ((rapduSz < 2) || (rapdu[rapduSz - 2] != 0x91))
+		return SSCP_ERR_UNSUPPORTED_RESPONSE_VALUE;
+
+	ctx->desfire.status = rapdu[rapduSz - 1];
+	if ((ctx->desfire.status != DESFIRE_STATUS_OK) && (ctx->desfire.status != DESFIRE_STATUS_ADDITIONAL_FRAME))
+		return SSCP_ERR_NFC_CARD_STATUS;
+
+	/* The R-APDU is in our own buffer, deciphered in place */
+	*response = (BYTE*)rapdu;
+	*responseSz = rapduSz - 2;
+	return SSCP_SUCCESS;
+}
+
+static LONG SSCP_DESFireAuthenticateEx(SSCP_CTX_ST* ctx, BYTE keyNo, const BYTE keyValue[16], BOOL first)
+{
+	SSCP_DESFIRE_ST* df;
+	BYTE* data;
+	BYTE* response;
+	DWORD responseSz;
+	BYTE rndA[16];
+	BYTE rndB[16];
+	BYTE iv[16];
+	BYTE encKey[16];
+	BYTE macKey[16];
+	DWORD offset;
+	LONG rc;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (keyValue == NULL)
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	df = &ctx->desfire;
+	if (!first && !df->authenticated)
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	/* Same key as last time (a card is often read with one key only), keep the schedule */
+	if (!df->kxValid || memcmp(df->kxValue, keyValue, 16))
+	{
+		AES_CMAC_Prepare(&df->kx, keyValue);
+		memcpy(df->kxValue, keyValue, 16);
+		df->kxValid = TRUE;
+	}
+
+	/* Part 1, the card sends E (Kx, RndB) */
+	data = SSCP_DESFireData(ctx);
+	data[0] = keyNo;
+	if (first)
+	{
+		data[1] = 0x00; /* No PCD capabilities */
+		rc = SSCP_DESFireTransceive(ctx, DESFIRE_CMD_AUTHENTICATE_EV2_FIRST, 2, &response, &responseSz);
+	}
+	else
+	{
+		rc = SSCP_DESFireTransceive(ctx, DESFIRE_CMD_AUTHENTICATE_EV2_NON_FIRST, 1, &response, &responseSz);
+	}
+	if (rc)
+		goto failed;
+
+	if ((df->status != DESFIRE_STATUS_ADDITIONAL_FRAME) || (responseSz != 16))
+	{
+		rc = SSCP_ERR_UNSUPPORTED_RESPONSE_LENGTH;
+		goto failed;
+	}
+
+	/* Single block with a zero IV */
+	memcpy(rndB, response, 16);
+	AES_Decrypt(&df->kx.aes, rndB);
+
+	if (!ctx->crypto->random(ctx, rndA, 16))
+	{
+		rc = SSCP_ERR_INTERNAL_FAILURE;
+		goto failed;
+	}
+
+	/* Part 2, send E (Kx, RndA | RndB rotated left by one byte) */
+	data = SSCP_DESFireData(ctx);
+	memcpy(data, rndA, 16);
+	memcpy(&data[16], &rndB[1], 15);
+	data[31] = rndB[0];
+	memset(iv, 0, 16);
+	AES_EncryptCBC(&df->kx.aes, iv, data, 2);
+
+	rc = SSCP_DESFireTransceive(ctx, DESFIRE_CMD_ADDITIONAL_FRAME, 32, &response, &responseSz);
+	if (rc)
+		goto failed;
+
+	/* EV2First: TI | RndA' | PDcap2 | PCDcap2, EV2NonFirst: RndA' */
+	if ((df->status != DESFIRE_STATUS_OK) || (responseSz != (first ? 32 : 16)))
+	{
+		rc = SSCP_ERR_UNSUPPORTED_RESPONSE_LENGTH;
+		goto failed;
+	}
+
+	memset(iv, 0, 16);
+	AES_DecryptCBC(&df->kx.aes, iv, response, responseSz / 16);
+
+	/* The card proves it knows the key: RndA' is RndA rotated left by one byte */
+	offset = first ? 4 : 0;
+	if (memcmp(&response[offset], &rndA[1], 15) || (response[offset + 15] != rndA[0]))
+	{
+		rc = SSCP_ERR_NFC_CARD_SIGNATURE;
+		goto failed;
+	}
+
+	/* A new transaction starts with EV2First only */
+	if (first)
+	{
+		memcpy(df->ti, response, 4);
+		df->cmdCtr = 0;
+	}
+	memset(response, 0, responseSz);
+
+	SSCP_DESFireSessionKeys(&df->kx, rndA, rndB, encKey, macKey);
+	AES_Init(&df->sesEnc, encKey);
+	AES_CMAC_Prepare(&df->sesMac, macKey);
+
+	df->keyNo = keyNo;
+	df->authenticated = TRUE;
+	rc = SSCP_SUCCESS;
+	goto done;
+
+failed:
+	SSCP_DESFireClear(df);
+
+done:
+	memset(rndA, 0, sizeof(rndA));
+	memset(rndB, 0, sizeof(rndB));
+	memset(encKey, 0, sizeof(encKey));
+	memset(macKey, 0, sizeof(macKey));
+	return rc;
+}
+
+/**
+ * \brief AuthenticateEV2First, starts a new transaction with the card
+ */
+LONG SSCP_DESFireAuthenticateEV2First(SSCP_CTX_ST* ctx, BYTE keyNo, const BYTE keyValue[16])
+{
+	return SSCP_DESFireAuthenticateEx(ctx, keyNo, keyValue, TRUE);
+}
+
+/**
+ * \brief AuthenticateEV2NonFirst, changes the key within the transaction (TI and CmdCtr are kept)
+ */
+LONG SSCP_DESFireAuthenticateEV2NonFirst(SSCP_CTX_ST* ctx, BYTE keyNo, const BYTE keyValue[16])
+{
+	return SSCP_DESFireAuthenticateEx(ctx, keyNo, keyValue, FALSE);
+}
+
+/* IV of a command, or of the response to command number cmdCtr */
+static void SSCP_DESFireIV(SSCP_DESFIRE_ST* df, BOOL response, WORD cmdCtr, BYTE iv[16])
+{
+	iv[0] = response ? 0x5A : 0xA5;
+	iv[1] = response ? 0xA5 : 0x5A;
+	memcpy(&iv[2], df->ti, 4);
+	iv[6] = (BYTE)cmdCtr;
+	iv[7] = (BYTE)(cmdCtr >> 8);
+	memset(&iv[8], 0, 8);
+	AES_Encrypt(&df->sesEnc, iv);
+}
+
+/* Code (or status) | CmdCtr | TI, at the start of every MAC */
+static void SSCP_DESFireMACInit(SSCP_DESFIRE_ST* df, AES_CMAC_STATE_ST* state, BYTE code, WORD cmdCtr)
+{
+	BYTE head[7];
+
+	head[0] = code;
+	head[1] = (BYTE)cmdCtr;
+	head[2] = (BYTE)(cmdCtr >> 8);
+	memcpy(&head[3], df->ti, 4);
+
+	AES_CMAC_Init(state);
+	AES_CMAC_Update(&df->sesMac, state, head, sizeof(head));
+}
+
+static void SSCP_DESFireMACFinal(SSCP_DESFIRE_ST* df, AES_CMAC_STATE_ST* state, BYTE mact[DESFIRE_MACT_SIZE])
+{
+	BYTE mac[16];
+	DWORD i;
+
+	AES_CMAC_Final(&df->sesMac, state, mac);
+	for (i = 0; i < DESFIRE_MACT_SIZE; i++)
+		mact[i] = mac[2 * i + 1];
+}
+
+/* Gather the frames of a chained response, the first one is already there */
+static LONG SSCP_DESFireChain(SSCP_CTX_ST* ctx, BYTE** response, DWORD* responseSz)
+{
+	SSCP_DESFIRE_ST* df = &ctx->desfire;
+	BYTE* frame = *response;
+	DWORD frameSz = *responseSz;
+	DWORD length = 0;
+	LONG rc;
+
+	if (df->chainBuffer == NULL)
+	{
+		df->chainBuffer = malloc(SSCP_MAX_PAYLOAD_SIZE);
+		if (df->chainBuffer == NULL)
+			return SSCP_ERR_OUT_OF_MEMORY;
+		ctx->stats.trackedAllocations++;
+	}
+
+	for (;;)
+	{
+		if (length + frameSz > SSCP_MAX_PAYLOAD_SIZE)
+			return SSCP_ERR_RESPONSE_TOO_LONG;
+		memcpy(&df->chainBuffer[length], frame, frameSz);
+		length += frameSz;
+
+		if (df->status != DESFIRE_STATUS_ADDITIONAL_FRAME)
+			break;
+
+		rc = SSCP_DESFireTransceive(ctx, DESFIRE_CMD_ADDITIONAL_FRAME, 0, &frame, &frameSz);
+		if (rc)
+			return rc;
+	}
+
+	*response = df->chainBuffer;
+	*responseSz = length;
+	return SSCP_SUCCESS;
+}
+
+/**
+ * \brief send a native command to the card, in the communication mode of the file or of the command
+ *
+ * header is sent as it is (and MACed), data are enciphered in SSCP_DESFIRE_COMM_FULL. The command must fit in a single
+ * frame; the response may span several frames. SSCP_DESFIRE_COMM_MAC and SSCP_DESFIRE_COMM_FULL need an authentication.
+ */
+LONG SSCP_DESFireCommand(SSCP_CTX_ST* ctx, BYTE command, const BYTE header[], DWORD headerSz, const BYTE data[], DWORD dataSz, BYTE commMode, BYTE response[], DWORD maxResponseSz, DWORD* actResponseSz)
+{
+	SSCP_DESFIRE_ST* df;
+	AES_CMAC_STATE_ST state;
+	BYTE* apduData;
+	DWORD apduDataSz;
+	DWORD paddedSz;
+	BYTE* rdata;
+	DWORD rdataSz;
+	BYTE iv[16];
+	BYTE mact[DESFIRE_MACT_SIZE];
+	BOOL secure;
+	LONG rc;
+
+	if (actResponseSz != NULL)
+		*actResponseSz = 0;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (((header == NULL) && (headerSz > 0)) || ((data == NULL) && (dataSz > 0)))
+		return SSCP_ERR_INVALID_PARAMETER;
+	if ((commMode != SSCP_DESFIRE_COMM_PLAIN) && (commMode != SSCP_DESFIRE_COMM_MAC) && (commMode != SSCP_DESFIRE_COMM_FULL))
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	df = &ctx->desfire;
+	secure = (commMode != SSCP_DESFIRE_COMM_PLAIN) ? TRUE : FALSE;
+	if (secure && !df->authenticated)
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	paddedSz = dataSz;
+	if ((commMode == SSCP_DESFIRE_COMM_FULL) && (dataSz > 0))
+		paddedSz = (dataSz + 16) & ~15UL;
+	if (headerSz + paddedSz + (secure ? DESFIRE_MACT_SIZE : 0) > DESFIRE_MAX_DATA_SIZE)
+		return SSCP_ERR_COMMAND_TOO_LONG;
+
+	/* The counter must not wrap within a transaction */
+	if (df->authenticated && (df->cmdCtr == 0xFFFF))
+	{
+		SSCP_DESFireClear(df);
+		return SSCP_ERR_INVALID_PARAMETER;
+	}
+
+	/* Build the data of the C-APDU in place */
+	apduData = SSCP_DESFireData(ctx);
+	apduDataSz = 0;
+	if (headerSz > 0)
+		memcpy(apduData, header, headerSz);
+	apduDataSz += headerSz;
+	if (dataSz > 0)
+		memcpy(&apduData[apduDataSz], data, dataSz);
+
+	if (paddedSz > dataSz)
+	{
+		apduData[apduDataSz + dataSz] = 0x80;
+		memset(&apduData[apduDataSz + dataSz + 1], 0, paddedSz - dataSz - 1);
+		SSCP_DESFireIV(df, FALSE, df->cmdCtr, iv);
+		AES_EncryptCBC(&df->sesEnc, iv, &apduData[apduDataSz], paddedSz / 16);
+	}
+	apduDataSz += paddedSz;
+
+	if (secure)
+	{
+		SSCP_DESFireMACInit(df, &state, command, df->cmdCtr);
+		AES_CMAC_Update(&df->sesMac, &state, apduData, apduDataSz);
+		SSCP_DESFireMACFinal(df, &state, &apduData[apduDataSz]);
+		apduDataSz += DESFIRE_MACT_SIZE;
+	}
+
+	rc = SSCP_DESFireTransceive(ctx, command, apduDataSz, &rdata, &rdataSz);
+	if (!rc && (df->status == DESFIRE_STATUS_ADDITIONAL_FRAME))
+		rc = SSCP_DESFireChain(ctx, &rdata, &rdataSz);
+	if (rc)
+		goto failed;
+
+	/* Every command of an authenticated transaction counts, even in plain */
+	if (df->authenticated)
+		df->cmdCtr++;
+
+	if (secure)
+	{
+		if (rdataSz < DESFIRE_MACT_SIZE)
+		{
+			rc = SSCP_ERR_UNSUPPORTED_RESPONSE_LENGTH;
+			goto failed;
+		}
+		rdataSz -= DESFIRE_MACT_SIZE;
+
+		SSCP_DESFireMACInit(df, &state, df->status, df->cmdCtr);
+		AES_CMAC_Update(&df->sesMac, &state, rdata, rdataSz);
+		SSCP_DESFireMACFinal(df, &state, mact);
+		if (memcmp(mact, &rdata[rdataSz], DESFIRE_MACT_SIZE))
+		{
+			rc = SSCP_ERR_NFC_CARD_SIGNATURE;
+			goto failed;
+		}
+	}
+
+	if ((commMode == SSCP_DESFIRE_COMM_FULL) && (rdataSz > 0))
+	{
+		if (rdataSz % 16)
+		{
+			rc = SSCP_ERR_UNSUPPORTED_RESPONSE_LENGTH;
+			goto failed;
+		}
+
+		SSCP_DESFireIV(df, TRUE, df->cmdCtr, iv);
+		AES_DecryptCBC(&df->sesEnc, iv, rdata, rdataSz / 16);
+
+		/* Strip the padding, 80 00..00 */
+		while ((rdataSz > 0) && (rdata[rdataSz - 1] == 0x00))
+			rdataSz--;
+		if ((rdataSz == 0) || (rdata[rdataSz - 1] != 0x80))
+		{
+			rc = SSCP_ERR_UNSUPPORTED_RESPONSE_VALUE;
+			goto failed;
+		}
+		rdataSz--;
+	}
+
+	if (actResponseSz != NULL)
+		*actResponseSz = rdataSz;
+	if (rdataSz > maxResponseSz)
+		return SSCP_ERR_OUTPUT_BUFFER_OVERFLOW;
+	if ((response != NULL) && (rdataSz > 0))
+		memcpy(response, rdata, rdataSz);
+
+	return SSCP_SUCCESS;
+
+failed:
+	SSCP_DESFireClear(df);
+	return rc;
+}
+
+/**
+ * \brief ReadData from a standard or backup file, length 0 reads up to the end of the file
+ */
+LONG SSCP_DESFireReadData(SSCP_CTX_ST* ctx, BYTE fileNo, DWORD offset, DWORD length, BYTE commMode, BYTE data[], DWORD maxDataSz, DWORD* actDataSz)
+{
+	BYTE header[7];
+
+	if ((offset > 0xFFFFFF) || (length > 0xFFFFFF))
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	/* FileNo | Offset | Length, little endian on 3 bytes */
+	header[0] = fileNo;
+	header[1] = (BYTE)offset;
+	header[2] = (BYTE)(offset >> 8);
+	header[3] = (BYTE)(offset >> 16);
+	header[4] = (BYTE)length;
+	header[5] = (BYTE)(length >> 8);
+	header[6] = (BYTE)(length >> 16);
+
+	return SSCP_DESFireCommand(ctx, DESFIRE_CMD_READ_DATA, header, sizeof(header), NULL, 0, commMode, data, maxDataSz, actDataSz);
+}
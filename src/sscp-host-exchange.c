@@ -3,241 +3,231 @@
 BOOL SSCP_DEBUG_EXCHANGE = FALSE;
 
 /**
-  * \brief compute CRC
+ * \brief frame a command and send it, the response is not waited for
  */
-static void SSCP_SCR16(const BYTE part1[], DWORD part1Sz, const BYTE part2[], DWORD part2Sz, BYTE pcrc[2])
+LONG SSCP_SendFrame(SSCP_CTX_ST* ctx, BYTE address, BYTE protocol, const BYTE command[], DWORD commandSz)
 {
-    short crc = 0xFFFF;
-    DWORD i = 0;
-    unsigned char j = 0x00;
-    short dbyte = 0;
-    short mix = 0;
-
-    for (i = 0; i < part1Sz; ++i)
-    {
-        dbyte = part1[i];
-        crc ^= dbyte << 8;
-
-        for (j = 0; j < 8; ++j)
-        {
-            mix = crc & 0x8000;
-            crc = (crc << 1);
-            if (mix)
-                crc = crc ^ 0x1021;
-        }
-    }
+    BYTE* frame;
+    WORD crc;
+    LONG rc;
 
-    for (i = 0; i < part2Sz; ++i)
-    {
-        dbyte = part2[i];
-        crc ^= dbyte << 8;
+    if (ctx == NULL)
+        return SSCP_ERR_INVALID_CONTEXT;
+    if ((command == NULL) && (commandSz > 0))
+        return SSCP_ERR_INVALID_PARAMETER;
+    if (commandSz > SSCP_MAX_COMMAND_SIZE)
+        return SSCP_ERR_COMMAND_TOO_LONG;
 
-        for (j = 0; j < 8; ++j)
-        {
-            mix = crc & 0x8000;
-            crc = (crc << 1);
-            if (mix)
-                crc = crc ^ 0x1021;
-        }
-    }
+    /* The frame is built in the buffer of the context, the payload may already be in place */
+    frame = ctx->frameBuffer;
+    if (frame == NULL)
+        return SSCP_ERR_INVALID_CONTEXT;
+    if (commandSz > ctx->frameBufferSz - SSCP_FRAME_HEADER_SIZE - SSCP_FRAME_CRC_SIZE)
+        return SSCP_ERR_COMMAND_TOO_LONG;
+    if ((commandSz > 0) && (command != &frame[SSCP_FRAME_HEADER_SIZE]))
+        memmove(&frame[SSCP_FRAME_HEADER_SIZE], command, commandSz);
+
+    frame[0] = 0x02; /* SOF */
+    frame[1] = (BYTE)(commandSz >> 8);
+    frame[2] = (BYTE)(commandSz);
+    frame[3] = address;
+    frame[4] = protocol;
+
+    crc = SSCP_CRC16_Init();
+    crc = SSCP_CRC16_Update(crc, &frame[1], 4 + commandSz);
+    SSCP_CRC16_Final(crc, &frame[SSCP_FRAME_HEADER_SIZE + commandSz]);
+
+    /* An echoing adapter sends the frame back before the response, it stays in frameBuffer to be recognized */
+    ctx->echoSz = 0;
+    rc = SSCP_SerialSend(ctx, frame, SSCP_FRAME_HEADER_SIZE + commandSz + SSCP_FRAME_CRC_SIZE);
+    if (rc)
+        return rc;
+    if (ctx->commFlags & SSCP_COMM_FLAG_ECHO)
+        ctx->echoSz = SSCP_FRAME_HEADER_SIZE + commandSz + SSCP_FRAME_CRC_SIZE;
 
-	pcrc[0] = (BYTE)(crc >> 8);
-	pcrc[1] = (BYTE)(crc);
+    ctx->stats.framesSent++;
+    return SSCP_SUCCESS;
 }
 
-LONG SSCP_ExchangeRaw(SSCP_CTX_ST* ctx, BYTE address, BYTE protocol, const BYTE command[], DWORD commandSz, BYTE response[], DWORD maxResponseSz, DWORD* actResponseSz)
+/**
+ * \brief send a frame and receive the one that answers it; expectedResponseSz is the largest payload the response
+ * should have, for the timeout
+ */
+LONG SSCP_ExchangeRaw(SSCP_CTX_ST* ctx, BYTE address, BYTE protocol, WORD commandCode, const BYTE command[], DWORD commandSz, BYTE response[], DWORD maxResponseSz, DWORD expectedResponseSz, DWORD* actResponseSz)
 {
-    BYTE header[5];
-    BYTE crcA[2], crcB[2];
+    BYTE header[SSCP_FRAME_HEADER_SIZE];
+    DWORD commandClass = SSCP_GetCommandClass(commandCode);
+    DWORD startUs, sentUs, lineUs, lineMs;
     DWORD length;
     LONG rc;
 
     if (ctx == NULL)
         return SSCP_ERR_INVALID_CONTEXT;
-    if ((command == NULL) && (commandSz > 0))
-        return SSCP_ERR_INVALID_PARAMETER;
-    if (commandSz > 4096)
-        return SSCP_ERR_COMMAND_TOO_LONG;
 
-    /* Set the timeouts */
-    rc = SSCP_SerialSetTimeouts(ctx, SSCP_RESPONSE_FIRST_TIMEOUT, SSCP_RESPONSE_NEXT_TIMEOUT);
+    if (expectedResponseSz > maxResponseSz)
+        expectedResponseSz = maxResponseSz;
+
+    /* Set the timeouts, commandCode is 0 for the authentication; the first-byte timeout runs as soon as the frame is
+     * queued, so it also covers the command and the response on the line */
+    lineUs = SSCP_LineTime(ctx->baudrate, SSCP_FRAME_HEADER_SIZE + commandSz + SSCP_FRAME_CRC_SIZE);
+    lineMs = (lineUs + SSCP_LineTime(ctx->baudrate, SSCP_FRAME_HEADER_SIZE + expectedResponseSz + SSCP_FRAME_CRC_SIZE) + 999) / 1000;
+    rc = SSCP_SerialSetTimeouts(ctx, SSCP_GetCommandTimeout(ctx, commandCode) + lineMs, SSCP_RttInterByteTimeout(ctx));
     if (rc)
         return rc;
 
-    /* Prepare frame to be sent */
-    /* ------------------------ */
-
-    header[0] = 0x02; /* SOF */
-    header[1] = (BYTE)(commandSz >> 8);
-    header[2] = (BYTE)(commandSz);
-    header[3] = address;
-    header[4] = protocol;
-
-    SSCP_SCR16(&header[1], 4, command, commandSz, crcA);
-
     /* Send */
     /* ---- */
 
-    rc = SSCP_SerialSend(ctx, header, sizeof(header));
-    if (rc)
-        return rc;
+    startUs = SSCP_GetTimeUs();
 
-    rc = SSCP_SerialSend(ctx, command, commandSz);
+    rc = SSCP_SendFrame(ctx, address, protocol, command, commandSz);
     if (rc)
         return rc;
 
-    rc = SSCP_SerialSend(ctx, crcA, sizeof(crcA));
-    if (rc)
-        return rc;    
+    /* The write returns once the frame is queued: the reader only starts with its last byte */
+    sentUs = SSCP_GetTimeUs();
+    if (sentUs - startUs < lineUs)
+        sentUs = startUs + lineUs;
 
     /* Recv */
     /* ---- */
 
-    rc = SSCP_SerialRecv(ctx, header, sizeof(header));
+    rc = SSCP_SerialRecvFrame(ctx, header, response, maxResponseSz, &length);
+    SSCP_RttSample(ctx, commandClass, sentUs, rc);
     if (rc)
         return rc;
 
-    if (header[0] != 0x02)
-        return SSCP_ERR_WRONG_RESPONSE_COMMAND;
-    length = header[1];
-    length <<= 8;
-    length |= header[2];
-
-    if (length > maxResponseSz) /* Payload will not fit */
-        return SSCP_ERR_RESPONSE_TOO_LONG;
+    if (actResponseSz != NULL)
+        *actResponseSz = length;
 
-    /* Set the timeouts */
-    rc = SSCP_SerialSetTimeouts(ctx, SSCP_RESPONSE_NEXT_TIMEOUT, SSCP_RESPONSE_NEXT_TIMEOUT);
-    if (rc)
-        return rc;
+    return SSCP_SUCCESS;
+}
 
-    rc = SSCP_SerialRecv(ctx, response, length);
-    if (rc)
-    {
-        if (rc == SSCP_ERR_COMM_RECV_MUTE)
-            rc = SSCP_ERR_COMM_RECV_STOPPED; /* We already have the header, right? */
-        return rc;
-    }
+/**
+ * \brief is this secure response older than the command we have just sent? Only its first block is deciphered
+ */
+static BOOL SSCP_IsLateResponse(SSCP_CTX_ST* ctx, const BYTE response[], DWORD responseSz)
+{
+    BYTE block[16];
+    DWORD t;
 
-    rc = SSCP_SerialRecv(ctx, crcB, sizeof(crcB));
-    if (rc)
-    {
-        if (rc == SSCP_ERR_COMM_RECV_MUTE)
-            rc = SSCP_ERR_COMM_RECV_STOPPED; /* We already have the header and the payload, right? */
-        return rc;
-    }
+    if ((responseSz < 32) || ((responseSz % 16) != 0))
+        return FALSE; /* Let SSCP_ExchangeEx reject it */
 
-    /* Check CRC */
-    /* --------- */
+    /* The IV trails the response */
+    memcpy(block, response, 16);
+    if (!ctx->crypto->decipher(ctx, &response[responseSz - 16], block, 16))
+        return FALSE;
 
-    SSCP_SCR16(&header[1], 4, response, length, crcA);
-    if (memcmp(crcA, crcB, 2))
-        return SSCP_ERR_WRONG_RESPONSE_CRC;
+    t = block[0];
+    t <<= 8;
+    t |= block[1];
+    t <<= 8;
+    t |= block[2];
+    t <<= 8;
+    t |= block[3];
 
-    if (actResponseSz != NULL)
-        *actResponseSz = length;
+    return (t <= ctx->counter) ? TRUE : FALSE;
+}
 
-    return SSCP_SUCCESS;
+/**
+ * \brief where the data of the next command go in the buffer of the context
+ *
+ * Data built there (at most SSCP_MAX_PAYLOAD_SIZE bytes) are sent as they are, without a copy.
+ */
+BYTE* SSCP_CommandDataBuffer(SSCP_CTX_ST* ctx)
+{
+    return &ctx->commandBuffer[SSCP_COMMAND_HEADER_SIZE];
 }
 
-static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE commandData[], DWORD commandDataSz, BYTE responseData[], DWORD maxResponseDataSz, DWORD *actResponseDataSz, BOOL selftest)
+/* Counter, header and data of the command, in the buffer of the context */
+static LONG SSCP_BuildCommand(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE commandData[], DWORD commandDataSz, DWORD* commandSz)
 {
-    BYTE padding[16] = { 0 };
-    BYTE initVector[16] = { 0 };
     BYTE commandType = (BYTE)(commandHeader >> 16);
     WORD commandCode = (WORD)(commandHeader);
-    DWORD maxCommandSz = 0;
-    DWORD commandSz = 0;
-    BYTE* command = NULL;
-    const DWORD maxResponseSz = 4096;
-    DWORD responseSz = 0;
-    BYTE *response = NULL;
-    BYTE responseCode;
-    DWORD t, i;
-    LONG rc;
+    BYTE* command;
+    DWORD i;
 
     if (ctx == NULL)
         return SSCP_ERR_INVALID_CONTEXT;
     if ((commandData == NULL) && (commandDataSz > 0))
         return SSCP_ERR_INVALID_PARAMETER;
-    if (commandDataSz > 4096)
+    if (commandDataSz > SSCP_MAX_PAYLOAD_SIZE)
         return SSCP_ERR_COMMAND_TOO_LONG;
 
-    maxCommandSz = 4 + 1 + 2 + 2 + commandDataSz + 32 + 16 + 16; /* 16 for padding + 16 for IV */
-
-    /* Allocated the two buffers */
-    command = calloc(1, maxCommandSz);
-    if (command == NULL)
-        return SSCP_ERR_OUT_OF_MEMORY;
-    response = calloc(1, maxResponseSz);
-    if (response == NULL)
-    {
-        free(command);
-        return SSCP_ERR_OUT_OF_MEMORY;
-    }
+    /* Use the buffers of the context, they are large enough for any command and response */
+    command = ctx->commandBuffer;
+    if ((command == NULL) || (ctx->responseBuffer == NULL))
+        return SSCP_ERR_INVALID_CONTEXT;
 
     /* Prepare the command */
-    command[commandSz++] = (BYTE)(ctx->counter >> 24);
-    command[commandSz++] = (BYTE)(ctx->counter >> 16);
-    command[commandSz++] = (BYTE)(ctx->counter >> 8);
-    command[commandSz++] = (BYTE)(ctx->counter);
-    command[commandSz++] = commandType;
-    command[commandSz++] = (BYTE)(commandCode >> 8);
-    command[commandSz++] = (BYTE)(commandCode);
-    command[commandSz++] = (BYTE)(commandDataSz >> 8);
-    command[commandSz++] = (BYTE)(commandDataSz);
+    *commandSz = 0;
+    command[(*commandSz)++] = (BYTE)(ctx->counter >> 24);
+    command[(*commandSz)++] = (BYTE)(ctx->counter >> 16);
+    command[(*commandSz)++] = (BYTE)(ctx->counter >> 8);
+    command[(*commandSz)++] = (BYTE)(ctx->counter);
+    command[(*commandSz)++] = commandType;
+    command[(*commandSz)++] = (BYTE)(commandCode >> 8);
+    command[(*commandSz)++] = (BYTE)(commandCode);
+    command[(*commandSz)++] = (BYTE)(commandDataSz >> 8);
+    command[(*commandSz)++] = (BYTE)(commandDataSz);
     if (commandData != NULL)
     {
-        memcpy(&command[commandSz], commandData, commandDataSz);
-        commandSz += commandDataSz;
+        /* Nothing to copy when the caller has built the data in place */
+        if (commandData != &command[*commandSz])
+            memcpy(&command[*commandSz], commandData, commandDataSz);
+        *commandSz += commandDataSz;
     }
 
     if (SSCP_DEBUG_EXCHANGE)
     {
         SSCP_Trace("Command=");
-        for (i = 0; i < commandSz; i++)
+        for (i = 0; i < *commandSz; i++)
             SSCP_Trace("%02X", command[i]);
         SSCP_Trace("\n");
     }
 
-    /* Compute the signature of the command */
-    if (!SSCP_HMAC(ctx->sessionKeySignAB, command, commandSz, &command[commandSz]))
-    {
-        rc = SSCP_ERR_INTERNAL_FAILURE;
-        goto failed;
-    }
+    return SSCP_SUCCESS;
+}
+
+/* The signature follows the command: pad, cipher, and append the IV */
+static LONG SSCP_SealCommand(SSCP_CTX_ST* ctx, DWORD* commandSz, BOOL selftest)
+{
+    BYTE initVector[16] = { 0 };
+    BYTE* command = ctx->commandBuffer;
+    DWORD i;
 
     if (SSCP_DEBUG_EXCHANGE)
     {
         SSCP_Trace("Sign=   ");
         for (i = 0; i < 32; i++)
-            SSCP_Trace("%02X", command[commandSz + i]);
+            SSCP_Trace("%02X", command[*commandSz + i]);
         SSCP_Trace("\n");
     }
 
-    commandSz += 32;
+    *commandSz += 32;
 
     /* Padd the command to reach a multiple of 16 bytes */
     if (selftest)
     {
         static const BYTE PADD[4] = { 0xBA, 0x40, 0x5E, 0xDD };
         i = 0;
-        while ((commandSz % 16) != 0)
-            command[commandSz++] = PADD[i++ % sizeof(PADD)];
+        while ((*commandSz % 16) != 0)
+            command[(*commandSz)++] = PADD[i++ % sizeof(PADD)];
     }
     else
     {
         /* Standard padding */
-        if ((commandSz % 16) != 0)
-            command[commandSz++] = 0x80;
-        while ((commandSz % 16) != 0)
-            command[commandSz++] = 0x00;
+        if ((*commandSz % 16) != 0)
+            command[(*commandSz)++] = 0x80;
+        while ((*commandSz % 16) != 0)
+            command[(*commandSz)++] = 0x00;
     }
 
     if (SSCP_DEBUG_EXCHANGE)
     {
         SSCP_Trace("Padded= ");
-        for (i = 0; i < commandSz; i++)
+        for (i = 0; i < *commandSz; i++)
             SSCP_Trace("%02X", command[i]);
         SSCP_Trace("\n");
     }
@@ -250,40 +240,52 @@ static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE co
     else
     {
         /* Randomize the Init Vector */
-        if (!SSCP_GetRandom(initVector, 16))
-        {
-            rc = SSCP_ERR_INTERNAL_FAILURE;
-            goto failed;
-        }
+        if (!ctx->crypto->random(ctx, initVector, 16))
+            return SSCP_ERR_INTERNAL_FAILURE;
     }
 
     /* Encrypt the command */
-    if (!SSCP_Cipher(ctx->sessionKeyCipherAB, initVector, command, commandSz))
-    {
-        rc = SSCP_ERR_INTERNAL_FAILURE;
-        goto failed;
-    }
+    if (!ctx->crypto->cipher(ctx, initVector, command, *commandSz))
+        return SSCP_ERR_INTERNAL_FAILURE;
 
     if (SSCP_DEBUG_EXCHANGE)
     {
         SSCP_Trace("Crypted=");
-        for (i = 0; i < commandSz; i++)
+        for (i = 0; i < *commandSz; i++)
             SSCP_Trace("%02X", command[i]);
         SSCP_Trace("\n");
     }
 
     /* Don't forget to append the IV at the end */
-    memcpy(&command[commandSz], initVector, 16);
-    commandSz += 16;
+    memcpy(&command[*commandSz], initVector, 16);
+    *commandSz += 16;
 
     if (SSCP_DEBUG_EXCHANGE)
     {
         SSCP_Trace("Sending=");
-        for (i = 0; i < commandSz; i++)
+        for (i = 0; i < *commandSz; i++)
             SSCP_Trace("%02X", command[i]);
         SSCP_Trace("\n");
     }
 
+    return SSCP_SUCCESS;
+}
+
+/* Largest sealed response with up to dataSz bytes of data: counter, code, length, data, status, signature, padding, IV */
+static DWORD SSCP_SealedResponseSz(DWORD dataSz)
+{
+    if (dataSz > SSCP_MAX_PAYLOAD_SIZE)
+        dataSz = SSCP_MAX_PAYLOAD_SIZE;
+    return ((8 + dataSz + 2 + 32) / 16 + 1) * 16 + 16;
+}
+
+/* Send the sealed command and receive the response; *responseSz excludes the IV that ends it */
+static LONG SSCP_TransceiveSecure(SSCP_CTX_ST* ctx, WORD commandCode, DWORD commandSz, DWORD expectedResponseSz, DWORD* responseSz, BOOL selftest)
+{
+    BYTE* response = ctx->responseBuffer;
+    DWORD maxResponseSz = ctx->responseBufferSz;
+    DWORD i;
+    LONG rc;
 
     if (selftest)
     {
@@ -294,7 +296,7 @@ static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE co
             0xEC, 0x89, 0xEC, 0xA7, 0xB6, 0x33, 0xF3, 0x35, 0x77, 0xCE, 0xC2, 0x4A, 0x74, 0x85, 0x98, 0x5E
         };
         memcpy(response, R, sizeof(R));
-        responseSz = sizeof(R);
+        *responseSz = sizeof(R);
         rc = SSCP_SUCCESS;
     }
     else
@@ -302,9 +304,27 @@ static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE co
         /* Send the command (and get the response) */
         BYTE retry;
 
+        rc = SSCP_ERR_COMM_RECV_MUTE;
         for (retry = 0; retry < SSCP_MAX_TIMEOUT_RETRY; retry++)
         {
-            rc = SSCP_ExchangeRaw(ctx, ctx->address, SSCP_PROTOCOL_SECURE, command, commandSz, response, maxResponseSz, &responseSz);
+            /* What is left from the previous attempt would only disturb this one */
+            if (retry > 0)
+                SSCP_SerialFlush(ctx);
+
+            rc = SSCP_ExchangeRaw(ctx, ctx->address, SSCP_PROTOCOL_SECURE, commandCode, ctx->commandBuffer, commandSz, response, maxResponseSz, expectedResponseSz, responseSz);
+
+            /* In resync mode, skip the responses to the commands that have timed out before this one */
+            while ((rc == SSCP_SUCCESS) && (ctx->commFlags & SSCP_COMM_FLAG_RESYNC) && SSCP_IsLateResponse(ctx, response, *responseSz))
+            {
+                BYTE header[SSCP_FRAME_HEADER_SIZE];
+
+                if (SSCP_DEBUG_EXCHANGE)
+                    SSCP_Trace("Skipping a late response\n");
+                ctx->stats.framesDropped++;
+
+                rc = SSCP_SerialRecvFrame(ctx, header, response, maxResponseSz, responseSz);
+            }
+
             if (rc == SSCP_SUCCESS)
             {
                 if (retry > 0)
@@ -317,33 +337,38 @@ static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE co
     }
 
     if (rc)
-        goto failed;
+        return rc;
 
     if (SSCP_DEBUG_EXCHANGE)
     {
         SSCP_Trace("Received=");
-        for (i = 0; i < responseSz; i++)
+        for (i = 0; i < *responseSz; i++)
             SSCP_Trace("%02X", response[i]);
         SSCP_Trace("\n");
     }
 
     /* Verify that the length is correct */
-    if ((responseSz < 16) || ((responseSz % 16) != 0))
-    {
-        rc = SSCP_ERR_WRONG_RESPONSE_LENGTH;
-        goto failed;
-    }
+    if ((*responseSz < 16) || ((*responseSz % 16) != 0))
+        return SSCP_ERR_WRONG_RESPONSE_LENGTH;
+
+    *responseSz -= 16;
+    return SSCP_SUCCESS;
+}
+
+/* Decrypt the response in place, then compute the HMAC of its signed part unless hmac is NULL */
+static LONG SSCP_DecipherResponse(SSCP_CTX_ST* ctx, DWORD responseSz, BYTE hmac[32])
+{
+    BYTE initVector[16];
+    BYTE* response = ctx->responseBuffer;
+    DWORD i;
 
     /* Extract the init vector */
-    responseSz -= 16;
     memcpy(initVector, &response[responseSz], 16);
 
-    /* Decrypt the response */
-    if (!SSCP_Decipher(ctx->sessionKeyCipherBA, initVector, response, responseSz))
-    {
-        rc = SSCP_ERR_INTERNAL_FAILURE;
-        goto failed;
-    }
+    if (!ctx->crypto->decipher(ctx, initVector, response, responseSz))
+        return SSCP_ERR_INTERNAL_FAILURE;
+    if ((hmac != NULL) && !ctx->crypto->verify(ctx, response, SSCP_SignedResponseSz(response, responseSz), hmac))
+        return SSCP_ERR_INTERNAL_FAILURE;
 
     if (SSCP_DEBUG_EXCHANGE)
     {
@@ -353,6 +378,18 @@ static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE co
         SSCP_Trace("\n");
     }
 
+    return SSCP_SUCCESS;
+}
+
+/* Counter, opcode, length, signature and status of the deciphered response, then hand its data over */
+static LONG SSCP_CheckResponse(SSCP_CTX_ST* ctx, DWORD commandHeader, DWORD responseSz, const BYTE hmac[32], BYTE responseData[], DWORD maxResponseDataSz, DWORD *actResponseDataSz, const BYTE** responseView)
+{
+    BYTE commandType = (BYTE)(commandHeader >> 16);
+    WORD commandCode = (WORD)(commandHeader);
+    BYTE* response = ctx->responseBuffer;
+    BYTE responseCode;
+    DWORD t, i;
+
     /* Verify the counter */
     t = response[0];
     t <<= 8;
@@ -372,8 +409,7 @@ static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE co
         /* Counter has not been incremented by the device */
         if (SSCP_DEBUG_EXCHANGE)
             SSCP_Trace("Invalid response, current counter is %d, received %d\n", ctx->counter, t);
-        rc = SSCP_ERR_WRONG_RESPONSE_COUNTER;
-        goto failed;
+        return SSCP_ERR_WRONG_RESPONSE_COUNTER;
     }
 
     /* Verify the opcode */
@@ -381,8 +417,7 @@ static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE co
     {
         if (SSCP_DEBUG_EXCHANGE)
             SSCP_Trace("Invalid response, sent command %04X, received %02X%02X\n", commandCode, response[4], response[5]);
-        rc = SSCP_ERR_WRONG_RESPONSE_COMMAND;
-        goto failed;
+        return SSCP_ERR_WRONG_RESPONSE_COMMAND;
     }
 
     /* Gather the length */
@@ -395,8 +430,7 @@ static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE co
     {
         if (SSCP_DEBUG_EXCHANGE)
             SSCP_Trace("Invalid response, expected length >= %d and < %d, received %d\n", 4 + 2 + 2 + t + 2 + 32, 4 + 2 + 2 + t + 2 + 32 + 16, responseSz);
-        rc = SSCP_ERR_WRONG_RESPONSE_FORMAT;
-        goto failed;
+        return SSCP_ERR_WRONG_RESPONSE_FORMAT;
     }
 
     responseSz = 8 + t + 2;
@@ -409,35 +443,23 @@ static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE co
         SSCP_Trace("\n");
     }
 
-    /* Check the HMAC */
+    /* Check the HMAC (computed while decrypting) */
+    if (memcmp(hmac, &response[responseSz], 32))
     {
-        BYTE hmac[32];
-        if (!SSCP_HMAC(ctx->sessionKeySignBA, response, responseSz, hmac))
+        if (SSCP_DEBUG_EXCHANGE)
         {
-            if (SSCP_DEBUG_EXCHANGE)
-                SSCP_Trace("Failed to verify HMAC in Exchange\n");
-            rc = SSCP_ERR_INTERNAL_FAILURE;
-            goto failed;
+            SSCP_Trace("Wrong HMAC in Exchange\n");
+            SSCP_Trace("Received: ");
+            for (i = 0; i < 32; i++)
+                SSCP_Trace("%02X", response[i]);
+            SSCP_Trace("\n");
+            SSCP_Trace("Computed: ");
+            for (i = 0; i < 32; i++)
+                SSCP_Trace("%02X", hmac[i]);
+            SSCP_Trace("\n");
         }
 
-        if (memcmp(hmac, &response[responseSz], 32))
-        {
-            if (SSCP_DEBUG_EXCHANGE)
-            {
-                SSCP_Trace("Wrong HMAC in Exchange\n");
-                SSCP_Trace("Received: ");
-                for (i = 0; i < 32; i++)
-                    SSCP_Trace("%02X", response[i]);
-                SSCP_Trace("\n");
-                SSCP_Trace("Computed: ");
-                for (i = 0; i < 32; i++)
-                    SSCP_Trace("%02X", hmac[i]);
-                SSCP_Trace("\n");
-            }
-
-            rc = SSCP_ERR_WRONG_RESPONSE_SIGNATURE;
-            goto failed;
-        }
+        return SSCP_ERR_WRONG_RESPONSE_SIGNATURE;
     }
 
     /* Verify the status type */
@@ -445,8 +467,7 @@ static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE co
     {
         if (SSCP_DEBUG_EXCHANGE)
             SSCP_Trace("Wrong Response Type after Exchange\n");
-        rc = SSCP_ERR_WRONG_RESPONSE_TYPE;
-        goto failed;
+        return SSCP_ERR_WRONG_RESPONSE_TYPE;
     }
 
     /* Remember the status code */
@@ -456,26 +477,22 @@ static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE co
     if (actResponseDataSz != NULL)
         *actResponseDataSz = t;
 
-    /* Can we retrieve the length? */
-    if (t > 0)
+    if (responseView != NULL)
+    {
+        /* No copy, the caller reads the data in our buffer */
+        *responseView = &response[8];
+    }
+    else if (t > 0)
     {
+        /* Can we retrieve the length? */
         if (t > maxResponseDataSz)        
-        {
-            rc = SSCP_ERR_OUTPUT_BUFFER_OVERFLOW;
-            goto failed;
-        }
+            return SSCP_ERR_OUTPUT_BUFFER_OVERFLOW;
         if (responseData != NULL)
         {
             memcpy(responseData, &response[8], t);
         }
     }
 
-    /* Done with both buffers */
-    if (response != NULL)
-        free(response);
-    if (command != NULL)
-        free(command);
-
     if (responseCode != 0)
     {
         if (SSCP_DEBUG_EXCHANGE)
@@ -484,38 +501,199 @@ static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE co
     }
 
     return SSCP_SUCCESS;
+}
+
+static LONG SSCP_ExchangeEx(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE commandData[], DWORD commandDataSz, BYTE responseData[], DWORD maxResponseDataSz, DWORD *actResponseDataSz, const BYTE** responseView, BOOL selftest)
+{
+    BYTE hmac[32];
+    DWORD commandSz = 0;
+    DWORD responseSz = 0;
+    LONG rc;
+
+    rc = SSCP_BuildCommand(ctx, commandHeader, commandData, commandDataSz, &commandSz);
+    if (rc)
+        goto failed;
+
+    /* Compute the signature of the command */
+    if (!ctx->crypto->sign(ctx, ctx->commandBuffer, commandSz, &ctx->commandBuffer[commandSz]))
+    {
+        rc = SSCP_ERR_INTERNAL_FAILURE;
+        goto failed;
+    }
+
+    rc = SSCP_SealCommand(ctx, &commandSz, selftest);
+    if (rc)
+        goto failed;
+
+    /* Without a buffer for them, the data may be as large as the reader likes */
+    rc = SSCP_TransceiveSecure(ctx, (WORD)(commandHeader), commandSz, (responseView != NULL) ? ctx->responseBufferSz : SSCP_SealedResponseSz(maxResponseDataSz), &responseSz, selftest);
+    if (rc)
+        goto failed;
+
+    rc = SSCP_DecipherResponse(ctx, responseSz, hmac);
+    if (rc)
+        goto failed;
+
+    return SSCP_CheckResponse(ctx, commandHeader, responseSz, hmac, responseData, maxResponseDataSz, actResponseDataSz, responseView);
 
 failed:
-    if (response != NULL)
-        free(response);
-    if (command != NULL)
-        free(command);
+    return rc;
+}
+
+/* Items handled together, the signatures of a chunk are computed in two batches */
+#define SSCP_BATCH_CHUNK 32
+
+/**
+ * \brief one exchange on each context of a fleet, the HMACs of all the commands (then of all the responses) in one go
+ *
+ * The frames are still sent and received one after the other. A context may appear only once in items[].
+ * Returns SSCP_SUCCESS, or the first result that is not.
+ */
+LONG SSCP_ExchangeBatch(SSCP_BATCH_ITEM_ST items[], DWORD count)
+{
+    HMAC_SHA256_JOB_ST jobs[SSCP_BATCH_CHUNK];
+    BYTE hmacs[SSCP_BATCH_CHUNK][32];
+    DWORD sizes[SSCP_BATCH_CHUNK];
+    DWORD first, chunk, jobCount, i, j;
+    LONG rc = SSCP_SUCCESS;
+
+    if ((items == NULL) && (count > 0))
+        return SSCP_ERR_INVALID_PARAMETER;
+
+    for (first = 0; first < count; first += chunk)
+    {
+        SSCP_BATCH_ITEM_ST* batch = &items[first];
+
+        chunk = (count - first < SSCP_BATCH_CHUNK) ? count - first : SSCP_BATCH_CHUNK;
+
+        /* A second command on the same context would overwrite the first one in its buffer, refuse it before */
+        for (i = 0; i < chunk; i++)
+        {
+            batch[i].actResponseDataSz = 0;
+            batch[i].result = SSCP_SUCCESS;
+
+            for (j = 0; j < i; j++)
+                if (batch[j].ctx == batch[i].ctx)
+                    break;
+            if (j < i)
+                batch[i].result = SSCP_ERR_INVALID_PARAMETER;
+        }
+
+        /* Build the commands, and queue the signatures the builtin provider lets us compute ourselves */
+        jobCount = 0;
+        for (i = 0; i < chunk; i++)
+        {
+            SSCP_CTX_ST* ctx = batch[i].ctx;
+
+            if (batch[i].result)
+                continue;
+
+            batch[i].result = SSCP_BuildCommand(ctx, batch[i].commandHeader, batch[i].commandData, batch[i].commandDataSz, &sizes[i]);
+            if (batch[i].result)
+                continue;
+
+            if (ctx->crypto == &SSCP_CRYPTO_BUILTIN)
+            {
+                jobs[jobCount].key = &ctx->sessionSignAB;
+                jobs[jobCount].data = ctx->commandBuffer;
+                jobs[jobCount].length = sizes[i];
+                jobs[jobCount].digest = &ctx->commandBuffer[sizes[i]];
+                jobCount++;
+            }
+            else if (!ctx->crypto->sign(ctx, ctx->commandBuffer, sizes[i], &ctx->commandBuffer[sizes[i]]))
+            {
+                batch[i].result = SSCP_ERR_INTERNAL_FAILURE;
+            }
+        }
+
+        HMAC_SHA256_ComputeBatch(jobs, jobCount);
+
+        /* Talk to each reader, and queue the verification of its response */
+        jobCount = 0;
+        for (i = 0; i < chunk; i++)
+        {
+            SSCP_CTX_ST* ctx = batch[i].ctx;
+
+            if (batch[i].result)
+                continue;
+
+            batch[i].result = SSCP_SealCommand(ctx, &sizes[i], FALSE);
+            if (batch[i].result)
+                continue;
+
+            batch[i].result = SSCP_TransceiveSecure(ctx, (WORD)(batch[i].commandHeader), sizes[i], SSCP_SealedResponseSz(batch[i].maxResponseDataSz), &sizes[i], FALSE);
+            if (batch[i].result)
+                continue;
+
+            if (ctx->crypto == &SSCP_CRYPTO_BUILTIN)
+            {
+                batch[i].result = SSCP_DecipherResponse(ctx, sizes[i], NULL);
+                if (batch[i].result)
+                    continue;
+
+                jobs[jobCount].key = &ctx->sessionSignBA;
+                jobs[jobCount].data = ctx->responseBuffer;
+                jobs[jobCount].length = SSCP_SignedResponseSz(ctx->responseBuffer, sizes[i]);
+                jobs[jobCount].digest = hmacs[i];
+                jobCount++;
+            }
+            else
+            {
+                batch[i].result = SSCP_DecipherResponse(ctx, sizes[i], hmacs[i]);
+            }
+        }
+
+        HMAC_SHA256_ComputeBatch(jobs, jobCount);
+
+        for (i = 0; i < chunk; i++)
+        {
+            if (!batch[i].result)
+                batch[i].result = SSCP_CheckResponse(batch[i].ctx, batch[i].commandHeader, sizes[i], hmacs[i], batch[i].responseData, batch[i].maxResponseDataSz, &batch[i].actResponseDataSz, NULL);
+            if ((rc == SSCP_SUCCESS) && batch[i].result)
+                rc = batch[i].result;
+        }
+    }
+
     return rc;
 }
 
 LONG SSCP_Exchange(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE commandData[], DWORD commandDataSz, BYTE responseData[], DWORD maxResponseDataSz, DWORD* actResponseDataSz)
 {
-    return SSCP_ExchangeEx(ctx, commandHeader, commandData, commandDataSz, responseData, maxResponseDataSz, actResponseDataSz, FALSE);
+    return SSCP_ExchangeEx(ctx, commandHeader, commandData, commandDataSz, responseData, maxResponseDataSz, actResponseDataSz, NULL, FALSE);
+}
+
+/**
+ * \brief same as SSCP_Exchange, but the response data is left in the buffer of the context
+ *
+ * *responseView points to the data until the next exchange on this context.
+ */
+LONG SSCP_Exchange_View(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE commandData[], DWORD commandDataSz, const BYTE** responseView, DWORD* responseViewSz)
+{
+    if (responseView == NULL)
+        return SSCP_ERR_INVALID_PARAMETER;
+    *responseView = NULL;
+
+    return SSCP_ExchangeEx(ctx, commandHeader, commandData, commandDataSz, NULL, 0, responseViewSz, responseView, FALSE);
 }
 
 LONG SSCP_Exchange_SelfTest(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE commandData[], DWORD commandDataSz, BYTE responseData[], DWORD maxResponseDataSz, DWORD* actResponseDataSz)
 {
-    return SSCP_ExchangeEx(ctx, commandHeader, commandData, commandDataSz, responseData, maxResponseDataSz, actResponseDataSz, TRUE);
+    return SSCP_ExchangeEx(ctx, commandHeader, commandData, commandDataSz, responseData, maxResponseDataSz, actResponseDataSz, NULL, TRUE);
 }
 
 LONG SSCP_Exchange_NoDataIn(SSCP_CTX_ST* ctx, DWORD commandHeader, BYTE responseData[], DWORD maxResponseDataSz, DWORD* actResponseDataSz)
 {
-    return SSCP_ExchangeEx(ctx, commandHeader, NULL, 0, responseData, maxResponseDataSz, actResponseDataSz, FALSE);
+    return SSCP_ExchangeEx(ctx, commandHeader, NULL, 0, responseData, maxResponseDataSz, actResponseDataSz, NULL, FALSE);
 }
 
 LONG SSCP_Exchange_NoDataOut(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE commandData[], DWORD commandDataSz)
 {
-    return SSCP_ExchangeEx(ctx, commandHeader, commandData, commandDataSz, NULL, 0, NULL, FALSE);
+    return SSCP_ExchangeEx(ctx, commandHeader, commandData, commandDataSz, NULL, 0, NULL, NULL, FALSE);
 }
 
 LONG SSCP_Exchange_NoDataInOut(SSCP_CTX_ST* ctx, DWORD commandHeader)
 {
-    return SSCP_ExchangeEx(ctx, commandHeader, NULL, 0, NULL, 0, NULL, FALSE);
+    return SSCP_ExchangeEx(ctx, commandHeader, NULL, 0, NULL, 0, NULL, NULL, FALSE);
 }
 
 
@@ -2,6 +2,13 @@
 
 BOOL SSCP_DEBUG_AUTHENTICATE = FALSE;
 
+static const SSCP_COMMAND_TIMEOUT_ST SSCP_DEFAULT_COMMAND_TIMEOUTS[] = {
+	{ SSCP_CMD_OUTPUTS, FALSE, SSCP_OUTPUTS_FIRST_TIMEOUT },
+	{ SSCP_CMD_GET_INFOS, FALSE, SSCP_GET_INFOS_FIRST_TIMEOUT },
+	{ SSCP_CMD_SCAN_GLOBAL, FALSE, SSCP_SCAN_GLOBAL_FIRST_TIMEOUT },
+	{ SSCP_CMD_TRANSCEIVE_APDU, FALSE, SSCP_TRANSCEIVE_APDU_FIRST_TIMEOUT }
+};
+
 SSCP_CTX_ST* SSCP_Alloc(void)
 {
 	struct _SSCP_CTX_ST* ctx = calloc(1, sizeof(struct _SSCP_CTX_ST));
@@ -14,6 +21,30 @@ SSCP_CTX_ST* SSCP_Alloc(void)
 	ctx->commFd = -1;
 #endif
 
+	/* Allocate the exchange buffers once for all, so SSCP_Exchange never goes to the heap */
+	ctx->frameBufferSz = SSCP_FRAME_HEADER_SIZE + SSCP_MAX_COMMAND_SIZE + SSCP_FRAME_CRC_SIZE;
+	ctx->frameBuffer = calloc(1, ctx->frameBufferSz);
+	ctx->responseBufferSz = SSCP_MAX_RESPONSE_SIZE;
+	ctx->responseBuffer = calloc(1, ctx->responseBufferSz);
+	ctx->recvRing = calloc(1, SSCP_RECV_RING_SIZE);
+	if ((ctx->frameBuffer == NULL) || (ctx->responseBuffer == NULL) || (ctx->recvRing == NULL))
+	{
+		SSCP_Free(ctx);
+		return NULL;
+	}
+	ctx->stats.trackedAllocations += 3;
+
+	/* The command is built right after the room for the frame's header */
+	ctx->commandBuffer = &ctx->frameBuffer[SSCP_FRAME_HEADER_SIZE];
+	ctx->commandBufferSz = SSCP_MAX_COMMAND_SIZE;
+
+	memcpy(ctx->commandTimeouts, SSCP_DEFAULT_COMMAND_TIMEOUTS, sizeof(SSCP_DEFAULT_COMMAND_TIMEOUTS));
+	SSCP_RttInit(ctx);
+
+	ctx->crypto = SSCP_GetCryptoProvider(SSCP_CRYPTO_PROVIDER_DEFAULT);
+	if (ctx->crypto == NULL)
+		ctx->crypto = &SSCP_CRYPTO_BUILTIN;
+
 	return ctx;
 }
 
@@ -23,9 +54,30 @@ void SSCP_Free(SSCP_CTX_ST *ctx)
 	SSCP_Close(ctx);
 
 	if (ctx != NULL)
+	{
+		SSCP_CryptoClose(ctx);
+		SSCP_DRBG_Clear(&ctx->drbg);
+		SSCP_DESFireFree(ctx);
+		if (ctx->frameBuffer != NULL)
+		{
+			memset(ctx->frameBuffer, 0, ctx->frameBufferSz);
+			free(ctx->frameBuffer);
+		}
+		if (ctx->responseBuffer != NULL)
+		{
+			memset(ctx->responseBuffer, 0, ctx->responseBufferSz);
+			free(ctx->responseBuffer);
+		}
+		if (ctx->recvRing != NULL)
+			free(ctx->recvRing);
 		free(ctx);
+	}
 }
 
+/**
+ * \brief open the link to the reader: a serial port, "tcp:host:port" or "unix:path" (a socket), "rfc2217:host:port"
+ * (a Telnet COM port server, baud rate set remotely), "loop:" (in memory)
+ */
 LONG SSCP_Open(SSCP_CTX_ST* ctx, const char* commName, DWORD commBaudrate, DWORD commFlags)
 {
 	LONG rc;
@@ -56,6 +108,7 @@ LONG SSCP_Open(SSCP_CTX_ST* ctx, const char* commName, DWORD commBaudrate, DWORD
 	}
 
 	ctx->address = 0x00; /* Default is RS232 */
+	ctx->commFlags = commFlags;
 
 	ctx->stats.whenOpen = time(NULL);
 
@@ -84,9 +137,109 @@ LONG SSCP_SetAddress(SSCP_CTX_ST* ctx, BYTE address)
 	return SSCP_SUCCESS;
 }
 
-static LONG SSCP_AuthenticateEx(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], BOOL selftest)
+/**
+ * \brief let the serial driver drive the RS485 transceiver (SSCP_RS485_FLAG_xxx), until SSCP_Close
+ *
+ * The driver enable is raised delayBeforeSendMs before the first bit of a frame and dropped delayAfterSendMs after
+ * its last one, by the kernel. Not all ports and drivers can do it: SSCP_ERR_COMM_CONTROL_FAILED then.
+ */
+LONG SSCP_SetRS485(SSCP_CTX_ST* ctx, DWORD rs485Flags, DWORD delayBeforeSendMs, DWORD delayAfterSendMs)
+{
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+
+	return SSCP_SerialSetRS485(ctx, rs485Flags, delayBeforeSendMs, delayAfterSendMs);
+}
+
+/**
+ * \brief set how long to wait for the reader to start answering a given command (SSCP_CMD_xxx)
+ *
+ * The timeout is then fixed for this command. A firstByteTimeoutMs of 0 restores the library's default, which is
+ * adjusted to the measured response time of the reader.
+ */
+LONG SSCP_SetCommandTimeout(SSCP_CTX_ST* ctx, DWORD command, DWORD firstByteTimeoutMs)
+{
+	WORD commandCode = (WORD)command;
+	SSCP_COMMAND_TIMEOUT_ST* entry = NULL;
+	BOOL userDefined = (firstByteTimeoutMs != 0);
+	DWORD i;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (commandCode == 0)
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	if (firstByteTimeoutMs == 0)
+	{
+		firstByteTimeoutMs = SSCP_RESPONSE_FIRST_TIMEOUT;
+		for (i = 0; i < sizeof(SSCP_DEFAULT_COMMAND_TIMEOUTS) / sizeof(SSCP_DEFAULT_COMMAND_TIMEOUTS[0]); i++)
+			if (SSCP_DEFAULT_COMMAND_TIMEOUTS[i].commandCode == commandCode)
+				firstByteTimeoutMs = SSCP_DEFAULT_COMMAND_TIMEOUTS[i].firstByteTimeout;
+	}
+
+	for (i = 0; i < SSCP_MAX_COMMAND_TIMEOUTS; i++)
+	{
+		if (ctx->commandTimeouts[i].commandCode == commandCode)
+		{
+			entry = &ctx->commandTimeouts[i];
+			break;
+		}
+		if ((entry == NULL) && (ctx->commandTimeouts[i].commandCode == 0))
+			entry = &ctx->commandTimeouts[i];
+	}
+
+	if (entry == NULL) /* Table is full */
+		return SSCP_ERR_OUTPUT_BUFFER_OVERFLOW;
+
+	entry->commandCode = commandCode;
+	entry->userDefined = userDefined;
+	entry->firstByteTimeout = firstByteTimeoutMs;
+
+	return SSCP_SUCCESS;
+}
+
+/**
+ * \brief set the range of the timeouts computed from the response time of the reader
+ */
+LONG SSCP_SetTimeoutBounds(SSCP_CTX_ST* ctx, DWORD minTimeoutMs, DWORD maxTimeoutMs)
+{
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if ((minTimeoutMs == 0) || (minTimeoutMs > maxTimeoutMs))
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	ctx->timeoutFloor = minTimeoutMs;
+	ctx->timeoutCeiling = maxTimeoutMs;
+
+	return SSCP_SUCCESS;
+}
+
+DWORD SSCP_GetCommandTimeout(SSCP_CTX_ST* ctx, WORD commandCode)
+{
+	DWORD initial = SSCP_RESPONSE_FIRST_TIMEOUT;
+	DWORD i;
+
+	if (commandCode != 0)
+	{
+		for (i = 0; i < SSCP_MAX_COMMAND_TIMEOUTS; i++)
+		{
+			if (ctx->commandTimeouts[i].commandCode == commandCode)
+			{
+				if (ctx->commandTimeouts[i].userDefined)
+					return ctx->commandTimeouts[i].firstByteTimeout;
+				initial = ctx->commandTimeouts[i].firstByteTimeout;
+				break;
+			}
+		}
+	}
+
+	return SSCP_RttFirstByteTimeout(ctx, SSCP_GetCommandClass(commandCode), initial);
+}
+
+static const BYTE SSCP_DEFAULT_AUTH_KEY[16] = { 0xE7, 0x4A, 0x54, 0x0F, 0xA0, 0x7C, 0x4D, 0xB1, 0xB4, 0x64, 0x21, 0x12, 0x6D, 0xF7, 0xAD, 0x36 };	
+
+static LONG SSCP_AuthenticateEx(SSCP_CTX_ST* ctx, SSCP_AUTH_KEY_ST* authKey, BOOL selftest)
 {
-	static const BYTE SSCP_DEFAULT_AUTH_KEY[16] = { 0xE7, 0x4A, 0x54, 0x0F, 0xA0, 0x7C, 0x4D, 0xB1, 0xB4, 0x64, 0x21, 0x12, 0x6D, 0xF7, 0xAD, 0x36 };	
 	BYTE command[256] = { 0 };
 	DWORD commandSz = 0;
 	BYTE response[256] = { 0 };
@@ -104,9 +257,6 @@ static LONG SSCP_AuthenticateEx(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], B
 	if (ctx == NULL)
 		return SSCP_ERR_INVALID_CONTEXT;
 
-	if (authKeyValue == NULL)
-		authKeyValue = SSCP_DEFAULT_AUTH_KEY;
-
 	if (selftest)
 	{
 		static const BYTE R[] = { 0x75, 0xCC, 0xF7, 0xB1, 0xF7, 0xFE, 0xA6, 0xF7, 0x58, 0x71, 0xFC, 0xF6, 0xDC, 0x75, 0x59, 0x23 };
@@ -114,7 +264,7 @@ static LONG SSCP_AuthenticateEx(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], B
 	}
 	else
 	{
-		if (!SSCP_GetRandom(rndA, sizeof(rndA)))
+		if (!ctx->crypto->random(ctx, rndA, sizeof(rndA)))
 			return SSCP_ERR_INTERNAL_FAILURE;
 	}
 
@@ -160,7 +310,7 @@ static LONG SSCP_AuthenticateEx(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], B
 	}
 	else
 	{
-		rc = SSCP_ExchangeRaw(ctx, ctx->address, SSCP_PROTOCOL_AUTHENTICATE, command, commandSz, response, sizeof(response), &responseSz);
+		rc = SSCP_ExchangeRaw(ctx, ctx->address, SSCP_PROTOCOL_AUTHENTICATE, 0, command, commandSz, response, sizeof(response), sizeof(response), &responseSz);
 		if (rc)
 			return rc;
 	}
@@ -198,7 +348,7 @@ static LONG SSCP_AuthenticateEx(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], B
 	}
 
 	/* Compute hB on our side */
-	if (!SSCP_HMAC(authKeyValue, response, offset, hB))
+	if (!SSCP_AuthKeyHMAC(ctx, authKey, response, offset, hB))
 		return SSCP_ERR_INTERNAL_FAILURE;
 
 	/* Compare with received hB */
@@ -230,7 +380,7 @@ static LONG SSCP_AuthenticateEx(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], B
 	commandSz += 16;
 
 	/* Compute hA */
-	if (!SSCP_HMAC(authKeyValue, command, commandSz, hA))
+	if (!SSCP_AuthKeyHMAC(ctx, authKey, command, commandSz, hA))
 		return SSCP_ERR_INTERNAL_FAILURE;
 
 	/* Append hA to the command */
@@ -245,7 +395,7 @@ static LONG SSCP_AuthenticateEx(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], B
 	}
 	else
 	{
-		rc = SSCP_ExchangeRaw(ctx, ctx->address, 0x20, command, commandSz, response, sizeof(response), &responseSz);
+		rc = SSCP_ExchangeRaw(ctx, ctx->address, 0x20, 0, command, commandSz, response, sizeof(response), sizeof(response), &responseSz);
 		if (rc)
 			return rc;
 	}
@@ -254,7 +404,7 @@ static LONG SSCP_AuthenticateEx(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], B
 
 	/* Compute session keys */
 	/* -------------------- */
-	if (!SSCP_ComputeSessionKeys(ctx, authKeyValue, rndA, rndB))
+	if (!SSCP_ComputeSessionKeys_Ctx(ctx, &authKey->kp, rndA, rndB))
 		return SSCP_ERR_INTERNAL_FAILURE;
 
 	/* Initialize the counter to 1 */
@@ -266,14 +416,50 @@ static LONG SSCP_AuthenticateEx(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], B
 	return SSCP_SUCCESS;
 }
 
+/* Raw key: prepared for this authentication only */
+static LONG SSCP_AuthenticateValue(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], BOOL selftest)
+{
+	SSCP_AUTH_KEY_ST authKey;
+	LONG rc;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+
+	if (authKeyValue == NULL)
+		authKeyValue = SSCP_DEFAULT_AUTH_KEY;
+
+	SSCP_PrepareAuthKey(&authKey, authKeyValue);
+	rc = SSCP_AuthenticateEx(ctx, &authKey, selftest);
+	memset(&authKey, 0, sizeof(authKey));
+
+	return rc;
+}
+
 LONG SSCP_Authenticate(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16])
 {
-	return SSCP_AuthenticateEx(ctx, authKeyValue, FALSE);
+	return SSCP_AuthenticateValue(ctx, authKeyValue, FALSE);
+}
+
+/**
+ * \brief same as SSCP_Authenticate, with a key of the store: K' and the HMAC midstates are not computed again
+ */
+LONG SSCP_AuthenticateWithKey(SSCP_CTX_ST* ctx, SSCP_KEYSTORE_ST* store, DWORD keyHandle)
+{
+	SSCP_AUTH_KEY_ST* authKey;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+
+	authKey = SSCP_KeyStoreGet(store, keyHandle);
+	if (authKey == NULL)
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	return SSCP_AuthenticateEx(ctx, authKey, FALSE);
 }
 
 LONG SSCP_Authenticate_SelfTest(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16])
 {
-	return SSCP_AuthenticateEx(ctx, authKeyValue, TRUE);
+	return SSCP_AuthenticateValue(ctx, authKeyValue, TRUE);
 }
 
 static LONG SSCP_OutputsEx(SSCP_CTX_ST* ctx, BYTE ledColor, BYTE ledDuration, BYTE buzzerDuration, BOOL selftest)
@@ -336,6 +522,287 @@ LONG SSCP_GetInfos(SSCP_CTX_ST* ctx, BYTE *version, BYTE* baudrate, BYTE* addres
 	return SSCP_SUCCESS;
 }
 
+/* Rates of SSCP_CMD_SET_BAUDRATE by code, which is also the baudrate of SSCP_GetInfos */
+static const DWORD SSCP_BAUDRATES[] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600 };
+
+#define SSCP_BAUDRATE_COUNT (sizeof(SSCP_BAUDRATES) / sizeof(SSCP_BAUDRATES[0]))
+
+static BOOL SSCP_BaudrateCode(DWORD baudrate, BYTE* code)
+{
+	BYTE i;
+
+	for (i = 0; i < SSCP_BAUDRATE_COUNT; i++)
+	{
+		if (SSCP_BAUDRATES[i] == baudrate)
+		{
+			*code = i;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* A round trip, and the reader agrees on the rate */
+static LONG SSCP_CheckLink(SSCP_CTX_ST* ctx, BYTE code)
+{
+	BYTE baudrate;
+	LONG rc;
+
+	SSCP_SerialFlush(ctx);
+
+	rc = SSCP_GetInfos(ctx, NULL, &baudrate, NULL, NULL);
+	if (rc)
+		return rc;
+
+	if (baudrate != code)
+		return SSCP_ERR_UNSUPPORTED_RESPONSE_VALUE;
+
+	return SSCP_SUCCESS;
+}
+
+/**
+ * \brief move the reader, then the host, to baudrate; if they can't talk at this rate, both go back to the previous
+ * one and SSCP_ERR_COMM_LINK_CHECK_FAILED is returned
+ *
+ * When the response to SET_BAUDRATE is lost, the reader may have switched all the same: it is asked at the new rate,
+ * and the context stays there if it answers. Otherwise the context is left at the previous rate and the error of the
+ * exchange is returned; the reader is at the previous rate if it answers there.
+ */
+LONG SSCP_SetBaudrate(SSCP_CTX_ST* ctx, DWORD baudrate)
+{
+	DWORD previous;
+	BYTE code, previousCode;
+	LONG rc;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (!SSCP_BaudrateCode(baudrate, &code))
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	previous = ctx->baudrate;
+	if (baudrate == previous)
+		return SSCP_SUCCESS;
+
+	/* No way back from a rate the reader can't be asked for */
+	if (!SSCP_BaudrateCode(previous, &previousCode))
+		return SSCP_ERR_COMM_CONTROL_FAILED;
+
+	/* Don't leave the reader at a rate the port can't follow */
+	rc = SSCP_SerialCheckBaudrate(ctx, baudrate);
+	if (rc)
+		return rc;
+
+	rc = SSCP_Exchange(ctx, SSCP_CMD_SET_BAUDRATE, &code, 1, NULL, 0, NULL);
+	if (rc > 0)
+		return rc; /* Refused by the reader */
+	if (rc)
+	{
+		/* Only the response may have been lost */
+		if (!SSCP_SerialConfigure(ctx, baudrate) && !SSCP_CheckLink(ctx, code))
+			return SSCP_SUCCESS;
+
+		/* Not there: back to the previous rate, where it should still be */
+		SSCP_SerialConfigure(ctx, previous);
+		return rc;
+	}
+
+	/* The reader has answered at the previous rate, it is at the new one now */
+	rc = SSCP_SerialConfigure(ctx, baudrate);
+	if (!rc)
+		rc = SSCP_CheckLink(ctx, code);
+	if (!rc)
+		return SSCP_SUCCESS;
+
+	/* The line doesn't hold the rate: the command going back may get through even if its response doesn't */
+	SSCP_Exchange(ctx, SSCP_CMD_SET_BAUDRATE, &previousCode, 1, NULL, 0, NULL);
+
+	rc = SSCP_SerialConfigure(ctx, previous);
+	if (!rc)
+		rc = SSCP_CheckLink(ctx, previousCode);
+	if (rc)
+		return rc;
+
+	return SSCP_ERR_COMM_LINK_CHECK_FAILED;
+}
+
+/**
+ * \brief go to the highest rate, up to maxBaudrate, that the reader, the port and the line all take; *actBaudrate is
+ * where the link ends up. A no-op over a socket or the loopback.
+ */
+LONG SSCP_NegotiateBaudrate(SSCP_CTX_ST* ctx, DWORD maxBaudrate, DWORD* actBaudrate)
+{
+	DWORD i;
+	LONG rc;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+
+	for (i = SSCP_BAUDRATE_COUNT; i > 0; i--)
+	{
+		if (SSCP_BAUDRATES[i - 1] > maxBaudrate)
+			continue;
+		if (SSCP_BAUDRATES[i - 1] <= ctx->baudrate)
+			break;
+
+		rc = SSCP_SetBaudrate(ctx, SSCP_BAUDRATES[i - 1]);
+		if (rc == SSCP_SUCCESS)
+			break;
+
+		/* Refused by the reader (a status), not available on the port, or too fast for the line: one step down */
+		if ((rc < 0) && (rc != SSCP_ERR_COMM_CONTROL_FAILED) && (rc != SSCP_ERR_COMM_LINK_CHECK_FAILED))
+			return rc;
+	}
+
+	if (actBaudrate != NULL)
+		*actBaudrate = ctx->baudrate;
+
+	return SSCP_SUCCESS;
+}
+
+static BOOL SSCP_IsDiscovered(const SSCP_DISCOVERY_ST found[], DWORD count, BYTE address)
+{
+	DWORD i;
+
+	for (i = 0; i < count; i++)
+		if (found[i].address == address)
+			return TRUE;
+
+	return FALSE;
+}
+
+/* Rates of SSCP_Discover when none are given, the most likely first (after the current one) */
+static const DWORD SSCP_DISCOVER_BAUDRATES[] = { 115200, 38400, 9600, 57600, 19200, 230400, 460800, 921600 };
+
+#define SSCP_DISCOVER_BAUDRATE_COUNT (sizeof(SSCP_DISCOVER_BAUDRATES) / sizeof(SSCP_DISCOVER_BAUDRATES[0]))
+
+/**
+ * \brief find the readers on the line: the first step of the authentication is sent at each of the baudrates (NULL:
+ * the current rate, then 115200, 38400 and the other rates of SSCP_SetBaudrate) to each of the addresses (NULL: 0 to
+ * 255), and each reader that answers is returned
+ *
+ * The sweep ends with the first rate at which a valid frame comes back, or as soon as maxFound readers have answered.
+ * A silent address costs the time of the probe on the line plus SSCP_DISCOVER_REPLY_TIMEOUT, see sscp-host.h for the
+ * worst case. The link is left at the rate and address of the first reader found, or as it was.
+ */
+LONG SSCP_Discover(SSCP_CTX_ST* ctx, const DWORD baudrates[], DWORD baudrateCount, const BYTE addresses[], DWORD addressCount, SSCP_DISCOVERY_ST found[], DWORD maxFound, DWORD* actFound)
+{
+	BYTE probe[2 + 16];
+	BYTE header[SSCP_FRAME_HEADER_SIZE];
+	BYTE response[128];
+	DWORD likely[1 + SSCP_DISCOVER_BAUDRATE_COUNT];
+	DWORD previousBaudrate;
+	BYTE previousAddress;
+	DWORD count = 0;
+	DWORD b, a, length;
+	BOOL line, answered = FALSE;
+	LONG rc = SSCP_SUCCESS;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if ((found == NULL) || (maxFound == 0))
+		return SSCP_ERR_INVALID_PARAMETER;
+	if (ctx->transport == NULL)
+		return SSCP_ERR_COMM_NOT_OPEN;
+
+	previousBaudrate = ctx->baudrate;
+	previousAddress = ctx->address;
+
+	if (baudrates == NULL)
+	{
+		/* The reader is most likely still at the rate we are at */
+		likely[0] = previousBaudrate;
+		baudrateCount = 1;
+		for (b = 0; b < SSCP_DISCOVER_BAUDRATE_COUNT; b++)
+			if (SSCP_DISCOVER_BAUDRATES[b] != previousBaudrate)
+				likely[baudrateCount++] = SSCP_DISCOVER_BAUDRATES[b];
+		baudrates = likely;
+	}
+	if (addresses == NULL)
+		addressCount = 256;
+
+	/* Over a socket or the loopback, the rate is not ours to choose: a single pass */
+	line = (SSCP_SerialCheckBaudrate(ctx, previousBaudrate) == SSCP_SUCCESS);
+	if (!line)
+	{
+		baudrates = &previousBaudrate;
+		baudrateCount = 1;
+	}
+
+	/* The reader answers the first step before it knows who we are */
+	probe[0] = 0x00;
+	probe[1] = 0x00;
+	if (!SSCP_GetRandom(&probe[2], 16))
+		return SSCP_ERR_INTERNAL_FAILURE;
+
+	for (b = 0; (b < baudrateCount) && (count < maxFound) && !answered; b++)
+	{
+		if (line && SSCP_SerialConfigure(ctx, baudrates[b]))
+			continue; /* Not available on this port */
+		SSCP_SerialFlush(ctx);
+
+		for (a = 0; (a < addressCount) && (count < maxFound); a++)
+		{
+			BYTE address = (addresses != NULL) ? addresses[a] : (BYTE)a;
+
+			/* Already found, from a late answer */
+			if (SSCP_IsDiscovered(found, count, address))
+				continue;
+
+			/* Not SSCP_ExchangeRaw: the silence of the empty addresses must not count in the response times */
+			rc = SSCP_SerialSetTimeouts(ctx, (SSCP_LineTime(baudrates[b], SSCP_FRAME_HEADER_SIZE + sizeof(probe) + SSCP_FRAME_CRC_SIZE) + 999) / 1000 + SSCP_DISCOVER_REPLY_TIMEOUT, SSCP_RESPONSE_NEXT_TIMEOUT);
+			if (!rc)
+				rc = SSCP_SendFrame(ctx, address, SSCP_PROTOCOL_AUTHENTICATE, probe, sizeof(probe));
+			if (rc)
+				goto done;
+
+			rc = SSCP_SerialRecvFrame(ctx, header, response, sizeof(response), &length);
+			if (rc == SSCP_ERR_COMM_RECV_MUTE)
+				continue;
+			if (rc)
+			{
+				/* Noise, a reader at another rate maybe */
+				SSCP_SerialFlush(ctx);
+				continue;
+			}
+
+			/* The readers of a bus share its rate: no need to try the others */
+			answered = TRUE;
+
+			/* A late answer from the previous address is as good, the frame tells who it comes from */
+			if ((header[4] == SSCP_PROTOCOL_AUTHENTICATE) && !SSCP_IsDiscovered(found, count, header[3]))
+			{
+				found[count].baudrate = baudrates[b];
+				found[count].address = header[3];
+				count++;
+			}
+		}
+	}
+
+	rc = SSCP_SUCCESS;
+
+done:
+	/* Ready to authenticate with the first one found */
+	if (count > 0)
+	{
+		ctx->address = found[0].address;
+		if (line)
+			SSCP_SerialConfigure(ctx, found[0].baudrate);
+	}
+	else
+	{
+		ctx->address = previousAddress;
+		if (line)
+			SSCP_SerialConfigure(ctx, previousBaudrate);
+	}
+	SSCP_SerialFlush(ctx);
+
+	if (actFound != NULL)
+		*actFound = count;
+
+	return rc;
+}
+
 LONG SSCP_GetSerialNumber(SSCP_CTX_ST* ctx, char* serialNumber, BYTE maxSerialNumberSz)
 {
 	BYTE responseData[16] = { 0 };
@@ -413,6 +880,9 @@ LONG SSCP_ScanNFC(SSCP_CTX_ST* ctx, WORD* protocol, BYTE uid[], BYTE maxUidSz, B
 	if (actAtsSz != NULL)
 		*actAtsSz = 0;
 
+	/* Whatever is in the field now, it has not been authenticated */
+	SSCP_DESFireReset(ctx);
+
 	/* Make sure we don't call this function too often, because the reader is __slow__ */
 	SSCP_GuardTime(ctx, SSCP_SCAN_GLOBAL_GUARD_TIME);
 
@@ -496,21 +966,28 @@ LONG SSCP_ScanNFC(SSCP_CTX_ST* ctx, WORD* protocol, BYTE uid[], BYTE maxUidSz, B
 	return SSCP_SUCCESS;
 }
 
-LONG SSCP_TransceiveNFC(SSCP_CTX_ST* ctx, const BYTE commandApdu[], DWORD commandApduSz, BYTE responseApdu[], DWORD maxResponseApduSz, DWORD* actResponseApduSz)
+/**
+ * \brief send an APDU to the card, the R-APDU is left in the context
+ *
+ * *responseApdu points to the R-APDU until the next call on this context, no copy is made.
+ */
+LONG SSCP_TransceiveNFCView(SSCP_CTX_ST* ctx, const BYTE commandApdu[], DWORD commandApduSz, const BYTE** responseApdu, DWORD* responseApduSz)
 {
-	BYTE responseData[256] = { 0 };
+	const BYTE* responseData = NULL;
 	DWORD responseDataSz = 0;
 	BYTE responseStatus = 0;
 	LONG rc;
 
 	if (ctx == NULL)
 		return SSCP_ERR_INVALID_CONTEXT;
+	if ((responseApdu == NULL) || (responseApduSz == NULL))
+		return SSCP_ERR_INVALID_PARAMETER;
 
-	if (actResponseApduSz != NULL)
-		*actResponseApduSz = 0;
+	*responseApdu = NULL;
+	*responseApduSz = 0;
 
 	/* Command is TRANSCEIVE APDU */
-	rc = SSCP_Exchange(ctx, SSCP_CMD_TRANSCEIVE_APDU, commandApdu, commandApduSz, responseData, sizeof(responseData), &responseDataSz);
+	rc = SSCP_Exchange_View(ctx, SSCP_CMD_TRANSCEIVE_APDU, commandApdu, commandApduSz, &responseData, &responseDataSz);
 	if (rc)
 		return rc;
 
@@ -523,11 +1000,8 @@ LONG SSCP_TransceiveNFC(SSCP_CTX_ST* ctx, const BYTE commandApdu[], DWORD comman
 	{
 		case 0x00:
 			/* No error */
-			if (actResponseApduSz != NULL)
-				*actResponseApduSz = responseDataSz - 1;
-			if (responseDataSz - 1 > maxResponseApduSz)
-				return SSCP_ERR_OUTPUT_BUFFER_OVERFLOW;
-			memcpy(responseApdu, &responseData[1], responseDataSz - 1);
+			*responseApdu = &responseData[1];
+			*responseApduSz = responseDataSz - 1;
 		break;
 
 		case 0x01:
@@ -547,13 +1021,41 @@ LONG SSCP_TransceiveNFC(SSCP_CTX_ST* ctx, const BYTE commandApdu[], DWORD comman
 	return SSCP_SUCCESS;
 }
 
+LONG SSCP_TransceiveNFC(SSCP_CTX_ST* ctx, const BYTE commandApdu[], DWORD commandApduSz, BYTE responseApdu[], DWORD maxResponseApduSz, DWORD* actResponseApduSz)
+{
+	const BYTE* responseView = NULL;
+	DWORD responseViewSz = 0;
+	LONG rc;
+
+	if (actResponseApduSz != NULL)
+		*actResponseApduSz = 0;
+
+	rc = SSCP_TransceiveNFCView(ctx, commandApdu, commandApduSz, &responseView, &responseViewSz);
+	if (rc)
+		return rc;
+
+	if (actResponseApduSz != NULL)
+		*actResponseApduSz = responseViewSz;
+	if (responseViewSz > maxResponseApduSz)
+		return SSCP_ERR_OUTPUT_BUFFER_OVERFLOW;
+	memcpy(responseApdu, responseView, responseViewSz);
+
+	return SSCP_SUCCESS;
+}
+
 LONG SSCP_ReleaseNFC(SSCP_CTX_ST* ctx)
 {
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+
+	SSCP_DESFireReset(ctx);
 	return SSCP_Exchange_NoDataInOut(ctx, SSCP_CMD_RELEASE_RF);
 }
 
 LONG SSCP_GetStatistics(SSCP_CTX_ST* ctx, SSCP_STATISTICS_ST* stats)
 {
+	DWORD i;
+
 	if (ctx == NULL)
 		return SSCP_ERR_INVALID_CONTEXT;
 	if (stats == NULL)
@@ -570,6 +1072,25 @@ LONG SSCP_GetStatistics(SSCP_CTX_ST* ctx, SSCP_STATISTICS_ST* stats)
 	if (ctx->stats.whenSession)
 		stats->sessionTime = (DWORD)(time(NULL) - ctx->stats.whenSession);
 	stats->sessionCounter = ctx->counter;
+	stats->trackedAllocations = ctx->stats.trackedAllocations;
+	stats->framesSent = ctx->stats.framesSent;
+	stats->writeCalls = ctx->stats.writeCalls;
+	stats->framesReceived = ctx->stats.framesReceived;
+	stats->readCalls = ctx->stats.readCalls;
+	stats->bytesDropped = ctx->stats.bytesDropped;
+	stats->framesDropped = ctx->stats.framesDropped;
+	stats->linkReconnects = ctx->stats.reconnects;
+	stats->echoesDropped = ctx->stats.echoesDropped;
+
+	for (i = 0; i < SSCP_RTT_CLASS_COUNT; i++)
+	{
+		stats->rtt[i].samples = ctx->rtt[i].samples;
+		stats->rtt[i].srttUs = ctx->rtt[i].srtt;
+		stats->rtt[i].rttvarUs = ctx->rtt[i].rttvar;
+		if (ctx->rtt[i].samples)
+			stats->rtt[i].timeoutMs = SSCP_RttFirstByteTimeout(ctx, i, 0);
+	}
+	stats->interByteTimeoutMs = SSCP_RttInterByteTimeout(ctx);
 
 	return SSCP_SUCCESS;
 }
@@ -58,3 +58,20 @@ void SSCP_GuardTime(SSCP_CTX_ST* ctx, DWORD guardTimeMs)
         SSCP_WaitGuardTime(ctx);
     SSCP_InitGuardTime(ctx, guardTimeMs);
 }
+
+/**
+ * \brief a monotonic clock in microseconds, wrapping around, for measuring durations
+ */
+DWORD SSCP_GetTimeUs(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (DWORD)((now.QuadPart / freq.QuadPart) * 1000000 + ((now.QuadPart % freq.QuadPart) * 1000000) / freq.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (DWORD)((DWORD)now.tv_sec * 1000000UL + now.tv_nsec / 1000);
+#endif
+}
@@ -0,0 +1,265 @@
+#include "sscp-host_i.h"
+
+/*
+ * Key store
+ * ---------
+ *
+ * Authentication keys prepared once (K' expanded, HMAC midstates, see SSCP_PrepareAuthKey) and referred to by a
+ * handle: the index of the slot in the low word, a generation of the slot in the high word so that the handle of a
+ * removed key is refused even when its slot has been reused.
+ *
+ * Diversified keys (one per reader, from a master key and the reader's serial number) are evicted, least recently
+ * used first, when a new key needs room. Keys added by SSCP_KeyStoreAdd stay until SSCP_KeyStoreRemove.
+ *
+ * A store is not protected against concurrent use, as a context is not.
+ */
+
+#define SSCP_KEYSTORE_MAX_KEYS 0xFFFF
+#define SSCP_KEYSTORE_DIVERSIFY_CHUNK 32
+
+typedef struct
+{
+	SSCP_AUTH_KEY_ST key;
+	DWORD lastUsed;		/* Clock of the store when last added or used */
+	WORD generation;
+	BOOL used;
+	BOOL diversified;
+} SSCP_KEYSTORE_ENTRY_ST;
+
+struct _SSCP_KEYSTORE_ST
+{
+	DWORD capacity;
+	DWORD clock;
+	SSCP_KEYSTORE_ENTRY_ST* entries;
+};
+
+SSCP_KEYSTORE_ST* SSCP_KeyStoreAlloc(DWORD capacity)
+{
+	SSCP_KEYSTORE_ST* store;
+
+	if ((capacity == 0) || (capacity > SSCP_KEYSTORE_MAX_KEYS))
+		return NULL;
+
+	store = calloc(1, sizeof(SSCP_KEYSTORE_ST));
+	if (store == NULL)
+		return NULL;
+
+	store->entries = calloc(capacity, sizeof(SSCP_KEYSTORE_ENTRY_ST));
+	if (store->entries == NULL)
+	{
+		free(store);
+		return NULL;
+	}
+	store->capacity = capacity;
+
+	return store;
+}
+
+void SSCP_KeyStoreFree(SSCP_KEYSTORE_ST* store)
+{
+	if (store != NULL)
+	{
+		memset(store->entries, 0, store->capacity * sizeof(SSCP_KEYSTORE_ENTRY_ST));
+		free(store->entries);
+		free(store);
+	}
+}
+
+static SSCP_KEYSTORE_ENTRY_ST* SSCP_KeyStoreEntry(SSCP_KEYSTORE_ST* store, DWORD keyHandle)
+{
+	DWORD index = (keyHandle & 0xFFFF);
+	SSCP_KEYSTORE_ENTRY_ST* entry;
+
+	if ((store == NULL) || (index == 0) || (index > store->capacity))
+		return NULL;
+
+	entry = &store->entries[index - 1];
+	if (!entry->used || (entry->generation != (WORD)(keyHandle >> 16)))
+		return NULL;
+
+	return entry;
+}
+
+static DWORD SSCP_KeyStoreHandle(SSCP_KEYSTORE_ST* store, const SSCP_KEYSTORE_ENTRY_ST* entry)
+{
+	DWORD index = (DWORD)(entry - store->entries) + 1;
+
+	return ((DWORD)entry->generation << 16) | index;
+}
+
+/* Room for a new key: a free slot, otherwise the diversified key used the longest ago, not by the current call */
+static SSCP_KEYSTORE_ENTRY_ST* SSCP_KeyStoreSlot(SSCP_KEYSTORE_ST* store)
+{
+	SSCP_KEYSTORE_ENTRY_ST* victim = NULL;
+	DWORD i;
+
+	for (i = 0; i < store->capacity; i++)
+	{
+		SSCP_KEYSTORE_ENTRY_ST* entry = &store->entries[i];
+
+		if (!entry->used)
+			return entry;
+		if (entry->diversified && (entry->lastUsed != store->clock))
+			if ((victim == NULL) || ((store->clock - entry->lastUsed) > (store->clock - victim->lastUsed)))
+				victim = entry;
+	}
+
+	if (victim != NULL)
+	{
+		memset(&victim->key, 0, sizeof(victim->key));
+		victim->used = FALSE;
+	}
+	return victim;
+}
+
+/* Fill a slot, its generation changes so that the handles to what it held before are refused */
+static void SSCP_KeyStoreSet(SSCP_KEYSTORE_ST* store, SSCP_KEYSTORE_ENTRY_ST* entry, const BYTE keyValue[16], BOOL diversified)
+{
+	SSCP_PrepareAuthKey(&entry->key, keyValue);
+	entry->generation++;
+	if (entry->generation == 0)
+		entry->generation++;
+	entry->lastUsed = store->clock;
+	entry->diversified = diversified;
+	entry->used = TRUE;
+}
+
+/**
+ * \brief SSCP_AUTH_KEY_ST behind a handle, NULL if the handle is not (or no longer) valid
+ */
+SSCP_AUTH_KEY_ST* SSCP_KeyStoreGet(SSCP_KEYSTORE_ST* store, DWORD keyHandle)
+{
+	SSCP_KEYSTORE_ENTRY_ST* entry = SSCP_KeyStoreEntry(store, keyHandle);
+
+	if (entry == NULL)
+		return NULL;
+
+	entry->lastUsed = ++store->clock;
+	return &entry->key;
+}
+
+/**
+ * \brief prepare an authentication key, it stays in the store until SSCP_KeyStoreRemove
+ */
+LONG SSCP_KeyStoreAdd(SSCP_KEYSTORE_ST* store, const BYTE authKeyValue[16], DWORD* keyHandle)
+{
+	SSCP_KEYSTORE_ENTRY_ST* entry;
+
+	if (store == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if ((authKeyValue == NULL) || (keyHandle == NULL))
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	store->clock++;
+
+	entry = SSCP_KeyStoreSlot(store);
+	if (entry == NULL)
+		return SSCP_ERR_KEYSTORE_FULL;
+
+	SSCP_KeyStoreSet(store, entry, authKeyValue, FALSE);
+	*keyHandle = SSCP_KeyStoreHandle(store, entry);
+
+	return SSCP_SUCCESS;
+}
+
+/**
+ * \brief derive and prepare the keys of several readers from a master key of the store and their serial numbers
+ * (AES-128 diversification of NXP AN10922, the serial number as diversification input)
+ *
+ * A reader whose key is already in the store gets the same handle again. The diversified keys may be evicted to make
+ * room for newer ones; SSCP_AuthenticateWithKey then refuses the handle, call this function again.
+ */
+LONG SSCP_KeyStoreDiversify(SSCP_KEYSTORE_ST* store, DWORD masterKeyHandle, const char* const serialNumbers[], DWORD count, DWORD keyHandles[])
+{
+	const BYTE* inputs[SSCP_KEYSTORE_DIVERSIFY_CHUNK];
+	DWORD inputSz[SSCP_KEYSTORE_DIVERSIFY_CHUNK];
+	BYTE keys[SSCP_KEYSTORE_DIVERSIFY_CHUNK][16];
+	SSCP_KEYSTORE_ENTRY_ST* master;
+	DWORD first, chunk, i, j;
+	LONG rc = SSCP_SUCCESS;
+
+	if (store == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (((serialNumbers == NULL) || (keyHandles == NULL)) && (count > 0))
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	master = SSCP_KeyStoreEntry(store, masterKeyHandle);
+	if (master == NULL)
+		return SSCP_ERR_INVALID_PARAMETER;
+	for (i = 0; i < count; i++)
+	{
+		if ((serialNumbers[i] == NULL) || (strlen(serialNumbers[i]) < 1) || (strlen(serialNumbers[i]) > 31))
+			return SSCP_ERR_INVALID_PARAMETER;
+		keyHandles[i] = 0;
+	}
+
+	/* Used now, so the master key is not evicted below even if it is itself a diversified key */
+	store->clock++;
+	master->lastUsed = store->clock;
+
+	for (first = 0; first < count; first += chunk)
+	{
+		chunk = (count - first < SSCP_KEYSTORE_DIVERSIFY_CHUNK) ? count - first : SSCP_KEYSTORE_DIVERSIFY_CHUNK;
+
+		for (i = 0; i < chunk; i++)
+		{
+			inputs[i] = (const BYTE*)serialNumbers[first + i];
+			inputSz[i] = (DWORD)strlen(serialNumbers[first + i]);
+		}
+
+		if (!SSCP_DiversifyKeys(master->key.value, inputs, inputSz, chunk, keys))
+		{
+			rc = SSCP_ERR_INTERNAL_FAILURE;
+			goto done;
+		}
+
+		for (i = 0; i < chunk; i++)
+		{
+			SSCP_KEYSTORE_ENTRY_ST* entry = NULL;
+
+			for (j = 0; j < store->capacity; j++)
+			{
+				if (store->entries[j].used && store->entries[j].diversified && !memcmp(store->entries[j].key.value, keys[i], 16))
+				{
+					entry = &store->entries[j];
+					entry->lastUsed = store->clock;
+					break;
+				}
+			}
+
+			if (entry == NULL)
+			{
+				entry = SSCP_KeyStoreSlot(store);
+				if (entry == NULL)
+				{
+					rc = SSCP_ERR_KEYSTORE_FULL;
+					goto done;
+				}
+				SSCP_KeyStoreSet(store, entry, keys[i], TRUE);
+			}
+
+			keyHandles[first + i] = SSCP_KeyStoreHandle(store, entry);
+		}
+	}
+
+done:
+	memset(keys, 0, sizeof(keys));
+	return rc;
+}
+
+LONG SSCP_KeyStoreRemove(SSCP_KEYSTORE_ST* store, DWORD keyHandle)
+{
+	SSCP_KEYSTORE_ENTRY_ST* entry;
+
+	if (store == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+
+	entry = SSCP_KeyStoreEntry(store, keyHandle);
+	if (entry == NULL)
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	memset(&entry->key, 0, sizeof(entry->key));
+	entry->used = FALSE;
+
+	return SSCP_SUCCESS;
+}
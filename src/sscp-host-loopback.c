@@ -0,0 +1,151 @@
+#include "sscp-host-serial_i.h"
+
+/*
+ * Loopback transport
+ * ------------------
+ *
+ * No device at all: what the library sends goes to the peer set by SSCP_SetLoopbackPeer, and what the peer writes
+ * back is queued for the next reads. Without a peer, the bytes come back as they have been sent. Nothing can arrive
+ * later on, so an empty queue means a mute device straight away, whatever the timeout.
+ */
+
+typedef struct
+{
+	DWORD offset;	/* First byte not read yet */
+	DWORD length;
+	BYTE queue[SSCP_RECV_RING_SIZE];
+} SSCP_LOOPBACK_ST;
+
+static LONG SSCP_Loopback_Open(SSCP_CTX_ST* ctx, const char* commName)
+{
+	SSCP_LOOPBACK_ST* loopback;
+
+	(void)commName;
+
+	loopback = calloc(1, sizeof(SSCP_LOOPBACK_ST));
+	if (loopback == NULL)
+		return SSCP_ERR_OUT_OF_MEMORY;
+	ctx->stats.trackedAllocations++;
+
+	ctx->transportState = loopback;
+	return SSCP_SUCCESS;
+}
+
+static LONG SSCP_Loopback_Close(SSCP_CTX_ST* ctx)
+{
+	free(ctx->transportState);
+	ctx->transportState = NULL;
+	return SSCP_SUCCESS;
+}
+
+static LONG SSCP_Loopback_Configure(SSCP_CTX_ST* ctx, DWORD baudrate)
+{
+	(void)ctx;
+	(void)baudrate;
+
+	return SSCP_SUCCESS;
+}
+
+static LONG SSCP_Loopback_Send(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length)
+{
+	SSCP_LOOPBACK_ST* loopback = ctx->transportState;
+	DWORD room, written;
+
+	if (buffer == NULL)
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	/* Make room at the end of the queue */
+	if (loopback->offset > 0)
+	{
+		memmove(loopback->queue, &loopback->queue[loopback->offset], loopback->length);
+		loopback->offset = 0;
+	}
+	room = sizeof(loopback->queue) - loopback->length;
+
+	if (ctx->loopbackPeer != NULL)
+	{
+		written = ctx->loopbackPeer(ctx->loopbackParam, buffer, length, &loopback->queue[loopback->length], room);
+		if (written > room)
+			return SSCP_ERR_COMM_SEND_FAILED;
+	}
+	else
+	{
+		if (length > room)
+			return SSCP_ERR_COMM_SEND_FAILED;
+		memcpy(&loopback->queue[loopback->length], buffer, length);
+		written = length;
+	}
+	loopback->length += written;
+
+	ctx->stats.writeCalls++;
+	ctx->stats.bytesSent += length;
+
+	return SSCP_SUCCESS;
+}
+
+static LONG SSCP_Loopback_Read(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD maxLength, DWORD timeout, DWORD* actLength)
+{
+	SSCP_LOOPBACK_ST* loopback = ctx->transportState;
+	DWORD length;
+
+	(void)timeout;
+
+	if ((buffer == NULL) || (maxLength == 0) || (actLength == NULL))
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	*actLength = 0;
+	if (loopback->length == 0)
+		return SSCP_ERR_COMM_RECV_MUTE;
+
+	length = (loopback->length < maxLength) ? loopback->length : maxLength;
+	memcpy(buffer, &loopback->queue[loopback->offset], length);
+	loopback->offset += length;
+	loopback->length -= length;
+
+	ctx->stats.readCalls++;
+	ctx->stats.bytesReceived += length;
+	*actLength = length;
+
+	return SSCP_SUCCESS;
+}
+
+static LONG SSCP_Loopback_Flush(SSCP_CTX_ST* ctx)
+{
+	SSCP_LOOPBACK_ST* loopback = ctx->transportState;
+
+	loopback->offset = 0;
+	loopback->length = 0;
+	return SSCP_SUCCESS;
+}
+
+static int SSCP_Loopback_PollFd(SSCP_CTX_ST* ctx)
+{
+	(void)ctx;
+
+	return -1;
+}
+
+const SSCP_TRANSPORT_ST SSCP_TRANSPORT_LOOPBACK = {
+	SSCP_Loopback_Open,
+	SSCP_Loopback_Close,
+	SSCP_Loopback_Configure,
+	SSCP_Loopback_Send,
+	SSCP_Loopback_Read,
+	SSCP_Loopback_Flush,
+	SSCP_Loopback_PollFd,
+	NULL,
+	NULL
+};
+
+/**
+ * \brief function that plays the reader behind a "loop:" link, NULL to have the bytes sent back as they are
+ */
+LONG SSCP_SetLoopbackPeer(SSCP_CTX_ST* ctx, SSCP_LOOPBACK_PEER_FN peer, void* param)
+{
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+
+	ctx->loopbackPeer = peer;
+	ctx->loopbackParam = param;
+	return SSCP_SUCCESS;
+}
@@ -0,0 +1,178 @@
+#include "sscp-host-serial_i.h"
+
+/*
+ * Adaptive timeouts
+ * -----------------
+ *
+ * Jacobson/Karels estimator (RFC 6298) of the time the reader takes to start answering, one per class of command,
+ * plus one of the longest silence within a frame for the inter-byte timeout. Values are kept in microseconds.
+ *
+ * SRTT   <- SRTT + (M - SRTT) / 8
+ * RTTVAR <- RTTVAR + (|M - SRTT| - RTTVAR) / 4
+ * RTO    =  SRTT + 4 * RTTVAR, within the floor and ceiling of the context
+ *
+ * After a timeout the RTO of the class is doubled until a new sample is taken, and the first sample that follows is
+ * ignored since it may come from the late response to the previous attempt (Karn).
+ *
+ * M is counted from the moment the last byte of the command is on the line, not from the write that queued it, so
+ * that it does not grow with the command; SSCP_ExchangeRaw adds the line time of the command and of the largest
+ * response expected to the RTO instead.
+ *
+ * The authentication and the commands that change the keys or the line settings are rare, and much slower than the
+ * commands around them: they keep their fixed timeout (SSCP_RTT_CLASS_NONE) rather than share an estimate.
+ */
+
+static void SSCP_RttUpdate(SSCP_RTT_ST* rtt, DWORD sampleUs)
+{
+	if (rtt->skipNext)
+	{
+		rtt->skipNext = FALSE;
+		return;
+	}
+
+	rtt->backoff = 0;
+
+	if (rtt->samples == 0)
+	{
+		rtt->srtt = sampleUs;
+		rtt->rttvar = sampleUs / 2;
+	}
+	else
+	{
+		DWORD err = (sampleUs > rtt->srtt) ? (sampleUs - rtt->srtt) : (rtt->srtt - sampleUs);
+
+		if (sampleUs > rtt->srtt)
+			rtt->srtt += (sampleUs - rtt->srtt) / 8;
+		else
+			rtt->srtt -= (rtt->srtt - sampleUs) / 8;
+
+		if (err > rtt->rttvar)
+			rtt->rttvar += (err - rtt->rttvar) / 4;
+		else
+			rtt->rttvar -= (rtt->rttvar - err) / 4;
+	}
+
+	rtt->samples++;
+}
+
+static DWORD SSCP_RttTimeout(SSCP_CTX_ST* ctx, const SSCP_RTT_ST* rtt)
+{
+	DWORD timeout = (rtt->srtt + 4 * rtt->rttvar + 999) / 1000;
+
+	timeout <<= rtt->backoff;
+
+	if (timeout < ctx->timeoutFloor)
+		timeout = ctx->timeoutFloor;
+	if (timeout > ctx->timeoutCeiling)
+		timeout = ctx->timeoutCeiling;
+
+	return timeout;
+}
+
+DWORD SSCP_GetCommandClass(WORD commandCode)
+{
+	switch (commandCode)
+	{
+		case (WORD)SSCP_CMD_SCAN_GLOBAL:
+			return SSCP_RTT_CLASS_SCAN;
+		case (WORD)SSCP_CMD_TRANSCEIVE_APDU:
+			return SSCP_RTT_CLASS_CARD;
+		case 0: /* Authentication */
+		case (WORD)SSCP_CMD_CHANGE_READER_KEYS:
+		case (WORD)SSCP_CMD_SET_BAUDRATE:
+		case (WORD)SSCP_CMD_SET_RS485_ADDRESS:
+			return SSCP_RTT_CLASS_NONE;
+		default:
+			return SSCP_RTT_CLASS_CONTROL;
+	}
+}
+
+void SSCP_RttInit(SSCP_CTX_ST* ctx)
+{
+	memset(ctx->rtt, 0, sizeof(ctx->rtt));
+	memset(&ctx->rttGap, 0, sizeof(ctx->rttGap));
+	ctx->timeoutFloor = SSCP_RESPONSE_MIN_TIMEOUT;
+	ctx->timeoutCeiling = SSCP_RESPONSE_MAX_TIMEOUT;
+}
+
+/**
+ * \brief the first-byte timeout of a class, 'initial' until the class has been measured
+ */
+DWORD SSCP_RttFirstByteTimeout(SSCP_CTX_ST* ctx, DWORD commandClass, DWORD initial)
+{
+	const SSCP_RTT_ST* rtt;
+
+	if (commandClass == SSCP_RTT_CLASS_NONE)
+		return initial;
+
+	rtt = &ctx->rtt[commandClass];
+	if (rtt->samples == 0)
+	{
+		DWORD timeout = initial << rtt->backoff;
+		if ((timeout > ctx->timeoutCeiling) && (rtt->backoff > 0))
+			timeout = (initial > ctx->timeoutCeiling) ? initial : ctx->timeoutCeiling;
+		return timeout;
+	}
+
+	return SSCP_RttTimeout(ctx, rtt);
+}
+
+DWORD SSCP_RttInterByteTimeout(SSCP_CTX_ST* ctx)
+{
+	if (ctx->rttGap.samples == 0)
+		return SSCP_RESPONSE_NEXT_TIMEOUT;
+
+	return SSCP_RttTimeout(ctx, &ctx->rttGap);
+}
+
+/**
+ * \brief time to send 'bytes' at 'baudrate', 10 bits a byte, in microseconds
+ */
+DWORD SSCP_LineTime(DWORD baudrate, DWORD bytes)
+{
+	if (baudrate == 0)
+		return 0;
+
+	return (bytes * 10000 / baudrate) * 1000 + ((bytes * 10000 % baudrate) * 1000) / baudrate;
+}
+
+/**
+ * \brief account for a response that has been received, or for a timeout (rc is the result of SSCP_SerialRecvFrame)
+ */
+void SSCP_RttSample(SSCP_CTX_ST* ctx, DWORD commandClass, DWORD sentUs, LONG rc)
+{
+	SSCP_RTT_ST* rtt = (commandClass != SSCP_RTT_CLASS_NONE) ? &ctx->rtt[commandClass] : NULL;
+	DWORD sampleUs;
+
+	if ((rc == SSCP_ERR_COMM_RECV_MUTE) && (rtt != NULL))
+	{
+		if (rtt->backoff < SSCP_RTT_MAX_BACKOFF)
+			rtt->backoff++;
+		rtt->skipNext = TRUE;
+		return;
+	}
+
+	if (rc == SSCP_ERR_COMM_RECV_STOPPED)
+	{
+		if (ctx->rttGap.backoff < SSCP_RTT_MAX_BACKOFF)
+			ctx->rttGap.backoff++;
+		return;
+	}
+
+	if (rc != SSCP_SUCCESS)
+		return;
+
+	/* No sample when the response was already there (left over from a previous exchange); a response that starts
+	 * before the command is estimated to be off the line (a faster line, an adapter that buffers) counts as 0 */
+	if ((ctx->recvFirstUs != 0) && (rtt != NULL))
+	{
+		sampleUs = ctx->recvFirstUs - sentUs;
+		if (sampleUs > sentUs - ctx->recvFirstUs)
+			sampleUs = 0;
+		SSCP_RttUpdate(rtt, sampleUs);
+	}
+
+	/* Silence within the frame, only meaningful if it came in several reads */
+	if (ctx->recvReads > 1)
+		SSCP_RttUpdate(&ctx->rttGap, ctx->recvMaxGapUs);
+}
@@ -2,25 +2,30 @@
 
 #ifndef _WIN32
 
-#include <termios.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+#include <linux/serial.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <poll.h>
+#include <limits.h>
 
 BOOL SSCP_DEBUG_SERIAL = FALSE;
 
-LONG SSCP_SerialOpen(SSCP_CTX_ST* ctx, const char* commName)
+/*
+ * Serial transport, a tty
+ */
+
+static LONG SSCP_Tty_Open(SSCP_CTX_ST* ctx, const char* commName)
 {
 	if (ctx == NULL)
 		return SSCP_ERR_INVALID_CONTEXT;
 	if (commName == NULL)
 		return SSCP_ERR_INVALID_PARAMETER;
 
-	/* Don't forget to close in case of it were previously open */
-	SSCP_SerialClose(ctx);
-
 	/* Start-up here */
 	if (SSCP_DEBUG_SERIAL)
 		SSCP_Trace("Opening device %s...\n", commName);
@@ -35,12 +40,12 @@ LONG SSCP_SerialOpen(SSCP_CTX_ST* ctx, const char* commName)
 	}
 
 	/* Clear UART */
-	tcflush(ctx->commFd, TCIFLUSH);
+	ioctl(ctx->commFd, TCFLSH, TCIFLUSH);
     
     return SSCP_SUCCESS;
 }
 
-LONG SSCP_SerialClose(SSCP_CTX_ST* ctx)
+static LONG SSCP_Tty_Close(SSCP_CTX_ST* ctx)
 {
 	if (ctx == NULL)
 		return SSCP_ERR_INVALID_CONTEXT;
@@ -57,46 +62,23 @@ LONG SSCP_SerialClose(SSCP_CTX_ST* ctx)
 	return SSCP_SUCCESS;
 }
 
-LONG SSCP_SerialConfigure(SSCP_CTX_ST* ctx, DWORD baudrate)
-{
-    struct termios newtio;
+/* How far the rate the port really uses may be from the one asked for, in thousandths */
+#define SSCP_TTY_BAUDRATE_TOLERANCE 20
 
-	if (ctx == NULL)
-		return SSCP_ERR_INVALID_CONTEXT;
-	if (ctx->commFd < 0)
-		return SSCP_ERR_COMM_NOT_OPEN;
+/**
+ * \brief set the line to baudrate 8N1; any rate the UART can make, through termios2 and BOTHER
+ */
+static LONG SSCP_Tty_SetLine(SSCP_CTX_ST* ctx, DWORD baudrate)
+{
+	struct termios2 newtio;
 
-	bzero(&newtio, sizeof(newtio));
+	memset(&newtio, 0, sizeof(newtio));
 	// CS8  = 8n1 (8bit,no parity,1 stopbit
 	// CLOCAL= local connection, no modem control
 	// CREAD  = enable receiving characters
-	newtio.c_cflag = CS8 | CLOCAL | CREAD;
-	switch (baudrate)
-	{
-		case 115200:
-			newtio.c_cflag |= B115200;
-		break;
-		case 38400:
-			newtio.c_cflag |= B38400;
-		break;
-		case 19200:
-			newtio.c_cflag |= B19200;
-		break;
-		case 9600:
-			newtio.c_cflag |= B9600;
-		break;
-		case 4800:
-			newtio.c_cflag |= B4800;
-		break;
-		case 2400:
-			newtio.c_cflag |= B2400;
-		break;
-		case 1200:
-			newtio.c_cflag |= B1200;
-		break;
-		default:
-			return FALSE;
-	}
+	newtio.c_cflag = CS8 | CLOCAL | CREAD | BOTHER;
+	newtio.c_ispeed = baudrate;
+	newtio.c_ospeed = baudrate;
 	newtio.c_iflag = IGNPAR | IGNBRK;
 	newtio.c_oflag = 0;
 
@@ -106,32 +88,128 @@ LONG SSCP_SerialConfigure(SSCP_CTX_ST* ctx, DWORD baudrate)
 	newtio.c_cc[VTIME] = 0;	// inter-character timer unused
 	newtio.c_cc[VMIN] = 1;	// blocking read until 1 chars received
 
-	tcflush(ctx->commFd, TCIFLUSH);
+	if (ioctl(ctx->commFd, TCSETS2, &newtio))
+	{
+		if (SSCP_DEBUG_SERIAL)
+			SSCP_Trace("TCSETS2 failed (%d)\n", errno);
+		return SSCP_ERR_COMM_CONTROL_FAILED;
+	}
 
-	if (tcsetattr(ctx->commFd, TCSANOW, &newtio))
+	/* The driver rounds to what its divisor can do, or falls back to another rate */
+	if (ioctl(ctx->commFd, TCGETS2, &newtio))
+		return SSCP_ERR_COMM_CONTROL_FAILED;
+	if ((newtio.c_ospeed == 0) || ((newtio.c_ospeed > baudrate) ? newtio.c_ospeed - baudrate : baudrate - newtio.c_ospeed) > (baudrate * SSCP_TTY_BAUDRATE_TOLERANCE) / 1000)
 	{
 		if (SSCP_DEBUG_SERIAL)
-			SSCP_Trace("tcsetattr failed (%d)\n", errno);
+			SSCP_Trace("Baud rate %lu not available, the port runs at %u\n", baudrate, newtio.c_ospeed);
 		return SSCP_ERR_COMM_CONTROL_FAILED;
 	}
 
-    return SSCP_SUCCESS;
+	return SSCP_SUCCESS;
 }
 
-LONG SSCP_SerialSetTimeouts(SSCP_CTX_ST* ctx, DWORD first_byte, DWORD inter_byte)
+static LONG SSCP_Tty_Configure(SSCP_CTX_ST* ctx, DWORD baudrate)
 {
 	if (ctx == NULL)
 		return SSCP_ERR_INVALID_CONTEXT;
 	if (ctx->commFd < 0)
 		return SSCP_ERR_COMM_NOT_OPEN;
+	if (baudrate == 0)
+		return SSCP_ERR_INVALID_PARAMETER;
 
-	ctx->firstByteTimeout = first_byte;
-	ctx->interByteTimeout = inter_byte;
+	ioctl(ctx->commFd, TCFLSH, TCIFLUSH);
 
-    return SSCP_SUCCESS;
+	return SSCP_Tty_SetLine(ctx, baudrate);
+}
+
+/**
+ * \brief whether the port can run at baudrate; the line is left as it was
+ */
+static LONG SSCP_Tty_CheckBaudrate(SSCP_CTX_ST* ctx, DWORD baudrate)
+{
+	struct termios2 oldtio;
+	LONG rc;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (ctx->commFd < 0)
+		return SSCP_ERR_COMM_NOT_OPEN;
+	if (baudrate == 0)
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	if (ioctl(ctx->commFd, TCGETS2, &oldtio))
+		return SSCP_ERR_COMM_CONTROL_FAILED;
+
+	rc = SSCP_Tty_SetLine(ctx, baudrate);
+
+	if (ioctl(ctx->commFd, TCSETS2, &oldtio))
+		return SSCP_ERR_COMM_CONTROL_FAILED;
+
+	return rc;
+}
+
+/* Longest RTS delay the kernel accepts, in ms */
+#define SSCP_TTY_RS485_MAX_DELAY 100
+
+/**
+ * \brief RS485 mode of the UART driver (TIOCSRS485); the driver may not do it all, what it has kept is checked
+ */
+static LONG SSCP_Tty_SetRS485(SSCP_CTX_ST* ctx, DWORD rs485Flags, DWORD delayBeforeSendMs, DWORD delayAfterSendMs)
+{
+	struct serial_rs485 rs485;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (ctx->commFd < 0)
+		return SSCP_ERR_COMM_NOT_OPEN;
+	if ((delayBeforeSendMs > SSCP_TTY_RS485_MAX_DELAY) || (delayAfterSendMs > SSCP_TTY_RS485_MAX_DELAY))
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	memset(&rs485, 0, sizeof(rs485));
+	if (rs485Flags & SSCP_RS485_FLAG_ENABLE)
+	{
+		rs485.flags = SER_RS485_ENABLED;
+		rs485.flags |= (rs485Flags & SSCP_RS485_FLAG_RTS_ON_SEND) ? SER_RS485_RTS_ON_SEND : SER_RS485_RTS_AFTER_SEND;
+		if (rs485Flags & SSCP_RS485_FLAG_RX_DURING_TX)
+			rs485.flags |= SER_RS485_RX_DURING_TX;
+		rs485.delay_rts_before_send = (__u32) delayBeforeSendMs;
+		rs485.delay_rts_after_send = (__u32) delayAfterSendMs;
+	}
+
+	/* The driver writes back what it has applied */
+	if (ioctl(ctx->commFd, TIOCSRS485, &rs485))
+	{
+		if (SSCP_DEBUG_SERIAL)
+			SSCP_Trace("TIOCSRS485 failed (%d)\n", errno);
+		return SSCP_ERR_COMM_CONTROL_FAILED;
+	}
+
+	if (!(rs485Flags & SSCP_RS485_FLAG_ENABLE))
+		return SSCP_SUCCESS;
+
+	if (!(rs485.flags & SER_RS485_ENABLED) || (rs485.delay_rts_before_send != delayBeforeSendMs) || (rs485.delay_rts_after_send != delayAfterSendMs))
+	{
+		if (SSCP_DEBUG_SERIAL)
+			SSCP_Trace("RS485 mode not available as asked, flags %08X, delays %u/%u ms\n", rs485.flags, rs485.delay_rts_before_send, rs485.delay_rts_after_send);
+		return SSCP_ERR_COMM_CONTROL_FAILED;
+	}
+
+	return SSCP_SUCCESS;
 }
 
-LONG SSCP_SerialSend(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length)
+static LONG SSCP_Tty_Flush(SSCP_CTX_ST* ctx)
+{
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (ctx->commFd < 0)
+		return SSCP_ERR_COMM_NOT_OPEN;
+
+	ioctl(ctx->commFd, TCFLSH, TCIFLUSH);
+
+	return SSCP_SUCCESS;
+}
+
+static LONG SSCP_Tty_Send(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length)
 {
 	DWORD remainingLen = length;
 	DWORD offset = 0;
@@ -149,6 +227,8 @@ LONG SSCP_SerialSend(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length)
         int i;        
 		int written = write(ctx->commFd, &buffer[offset], writeLen);
 
+		ctx->stats.writeCalls++;
+
 		if (written <= 0)
 		{
 			if (SSCP_DEBUG_SERIAL)
@@ -171,6 +251,8 @@ LONG SSCP_SerialSend(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length)
 			return SSCP_ERR_COMM_SEND_FAILED;
 		}
 
+		ctx->stats.bytesSent += written;
+
 		remainingLen -= written;
 		offset += written;
 	}
@@ -178,78 +260,100 @@ LONG SSCP_SerialSend(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length)
 	return SSCP_SUCCESS;        
 }
 
-LONG SSCP_SerialRecv(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD length)
+static LONG SSCP_Tty_Read(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD maxLength, DWORD timeout, DWORD* actLength)
 {
-	size_t received = 0;
+	struct pollfd pfd;
+	DWORD start, elapsed;
+	int sel, done;
 
 	if (ctx == NULL)
 		return SSCP_ERR_INVALID_CONTEXT;
 	if (ctx->commFd < 0)
 		return SSCP_ERR_COMM_NOT_OPEN;
-	if (buffer == NULL)
+	if ((buffer == NULL) || (maxLength == 0) || (actLength == NULL))
 		return SSCP_ERR_INVALID_PARAMETER;
 
-    while (received < length)
-	{
-		struct timeval timeout;
-		fd_set read_fds;
-		int done;
+	*actLength = 0;
 
-        FD_ZERO(&read_fds);
-        FD_SET(ctx->commFd, &read_fds);
+	pfd.fd = ctx->commFd;
+	pfd.events = POLLIN;
 
-        if (received == 0)
-		{
-            timeout.tv_sec = 1;
-            timeout.tv_usec = 500000; // 1500ms
-        }
-		else
+	/* A signal must not restart the whole timeout, only what is left of it */
+	start = SSCP_GetTimeUs();
+	elapsed = 0;
+	do
+	{
+		pfd.revents = 0;
+		sel = poll(&pfd, 1, (timeout - elapsed > INT_MAX) ? INT_MAX : (int)(timeout - elapsed));
+		if ((sel < 0) && (errno == EINTR))
 		{
-            timeout.tv_sec = 0;
-            timeout.tv_usec = 50000; // 50ms
-        }
+			elapsed = (SSCP_GetTimeUs() - start) / 1000;
+			if (elapsed >= timeout)
+			{
+				sel = 0;
+				break;
+			}
+		}
+	} while ((sel < 0) && (errno == EINTR));
 
-        int sel = select(ctx->commFd + 1, &read_fds, NULL, NULL, &timeout);
-        if (sel < 0)
-		{
-			if (SSCP_DEBUG_SERIAL)
-				SSCP_Trace("select on read(%d/%d) failed (%d) [%d]\n", received, length, errno, sel);
-            return SSCP_ERR_COMM_RECV_FAILED;
-        }
-		else if (sel == 0)
-		{
-			if (SSCP_DEBUG_SERIAL)
-				SSCP_Trace("select on read(%d/%d) failed (%d)\n", received, length, errno);
-            return (received == 0) ? SSCP_ERR_COMM_RECV_MUTE : SSCP_ERR_COMM_RECV_STOPPED;
-        }
+	if (sel < 0)
+	{
+		if (SSCP_DEBUG_SERIAL)
+			SSCP_Trace("poll on read failed (%d) [%d]\n", errno, sel);
+		return SSCP_ERR_COMM_RECV_FAILED;
+	}
+	else if (sel == 0)
+	{
+		if (SSCP_DEBUG_SERIAL)
+			SSCP_Trace("read timeout (%dms)\n", timeout);
+		return SSCP_ERR_COMM_RECV_MUTE;
+	}
 
-        done = read(ctx->commFd, &buffer[received], length - received);
-        if (done < 0)
-		{
-			if (SSCP_DEBUG_SERIAL)
-				SSCP_Trace("read(%d/%d) failed (%d) [%d]\n", received, length, errno, done);
-            return SSCP_ERR_COMM_RECV_FAILED;
-        } 
-		else if (done == 0)
-		{
-			if (SSCP_DEBUG_SERIAL)
-				SSCP_Trace("read(%d/%d) failed (%d)\n", received, length, errno);
-            return SSCP_ERR_COMM_RECV_FAILED; // Shouldn’t happen, select said ready
-        }
+	/* Take everything that is already there */
+	do
+	{
+		done = read(ctx->commFd, buffer, maxLength);
+	} while ((done < 0) && (errno == EINTR));
+
+	ctx->stats.readCalls++;
 
+	if (done <= 0)
+	{
 		if (SSCP_DEBUG_SERIAL)
-		{
-			int i;
-			SSCP_Trace(">");
-			for (i = 0; i < done; i++)
-				SSCP_Trace("%02X", buffer[received + i]);
-			SSCP_Trace("\n");
-		}
+			SSCP_Trace("read(%d) failed (%d) [%d]\n", maxLength, errno, done);
+		return SSCP_ERR_COMM_RECV_FAILED; /* done == 0 shouldn't happen, poll said ready */
+	}
 
-        received += done;
-    }    
+	if (SSCP_DEBUG_SERIAL)
+	{
+		int i;
+		SSCP_Trace(">");
+		for (i = 0; i < done; i++)
+			SSCP_Trace("%02X", buffer[i]);
+		SSCP_Trace("\n");
+	}
+
+	ctx->stats.bytesReceived += done;
+	*actLength = done;
 
 	return SSCP_SUCCESS;
 }
 
+static int SSCP_Tty_PollFd(SSCP_CTX_ST* ctx)
+{
+	return ctx->commFd;
+}
+
+const SSCP_TRANSPORT_ST SSCP_TRANSPORT_SERIAL = {
+	SSCP_Tty_Open,
+	SSCP_Tty_Close,
+	SSCP_Tty_Configure,
+	SSCP_Tty_Send,
+	SSCP_Tty_Read,
+	SSCP_Tty_Flush,
+	SSCP_Tty_PollFd,
+	SSCP_Tty_CheckBaudrate,
+	SSCP_Tty_SetRS485
+};
+
 #endif
@@ -4,16 +4,17 @@
 
 BOOL SSCP_DEBUG_SERIAL = FALSE;
 
-LONG SSCP_SerialOpen(SSCP_CTX_ST* ctx, const char* commName)
+/*
+ * Serial transport, a COM port
+ */
+
+static LONG SSCP_Com_Open(SSCP_CTX_ST* ctx, const char* commName)
 {
 	if (ctx == NULL)
 		return SSCP_ERR_INVALID_CONTEXT;
 	if (commName == NULL)
 		return SSCP_ERR_INVALID_PARAMETER;
 
-	/* Don't forget to close in case of it were previously open */
-	SSCP_SerialClose(ctx);
-
 	/* Start-up here */
 	if (SSCP_DEBUG_SERIAL)
 		SSCP_Trace("Opening device %s...\n", commName);
@@ -30,10 +31,12 @@ LONG SSCP_SerialOpen(SSCP_CTX_ST* ctx, const char* commName)
 
 	SetupComm(ctx->commHandle, 512, 512);
 
+	ctx->readTimeout = 0; /* COMMTIMEOUTS to be set on first read */
+
 	return SSCP_SUCCESS;
 }
 
-LONG SSCP_SerialClose(SSCP_CTX_ST* ctx)
+static LONG SSCP_Com_Close(SSCP_CTX_ST* ctx)
 {
 	if (ctx == NULL)
 		return SSCP_ERR_INVALID_CONTEXT;
@@ -50,7 +53,7 @@ LONG SSCP_SerialClose(SSCP_CTX_ST* ctx)
 	return SSCP_SUCCESS;
 }
 
-LONG SSCP_SerialConfigure(SSCP_CTX_ST* ctx, DWORD baudrate)
+static LONG SSCP_Com_Configure(SSCP_CTX_ST* ctx, DWORD baudrate)
 {
 	DCB dcb;
 
@@ -95,32 +98,43 @@ LONG SSCP_SerialConfigure(SSCP_CTX_ST* ctx, DWORD baudrate)
 	return SSCP_SUCCESS;
 }
 
-LONG SSCP_SerialSetTimeouts(SSCP_CTX_ST* ctx, DWORD first_byte, DWORD inter_byte)
+/**
+ * \brief whether the driver takes baudrate; the line is left as it was
+ */
+static LONG SSCP_Com_CheckBaudrate(SSCP_CTX_ST* ctx, DWORD baudrate)
 {
-	COMMTIMEOUTS stTimeout = { 0 };
+	DCB olddcb;
+	LONG rc;
 
 	if (ctx == NULL)
 		return SSCP_ERR_INVALID_CONTEXT;
 	if (ctx->commHandle == INVALID_HANDLE_VALUE)
 		return SSCP_ERR_COMM_NOT_OPEN;
 
-	stTimeout.ReadIntervalTimeout = inter_byte;
-	stTimeout.ReadTotalTimeoutConstant = first_byte;
-	stTimeout.ReadTotalTimeoutMultiplier = inter_byte;
-	stTimeout.WriteTotalTimeoutConstant = inter_byte;
-	stTimeout.WriteTotalTimeoutMultiplier = inter_byte;
+	if (!GetCommState(ctx->commHandle, &olddcb))
+		return SSCP_ERR_COMM_CONTROL_FAILED;
 
-	if (!SetCommTimeouts(ctx->commHandle, &stTimeout))
-	{
-		if (SSCP_DEBUG_SERIAL)
-			SSCP_Trace("SetCommTimeouts failed (%d)\n", GetLastError());
+	rc = SSCP_Com_Configure(ctx, baudrate);
+
+	if (!SetCommState(ctx->commHandle, &olddcb))
 		return SSCP_ERR_COMM_CONTROL_FAILED;
-	}
+
+	return rc;
+}
+
+static LONG SSCP_Com_Flush(SSCP_CTX_ST* ctx)
+{
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (ctx->commHandle == INVALID_HANDLE_VALUE)
+		return SSCP_ERR_COMM_NOT_OPEN;
+
+	PurgeComm(ctx->commHandle, PURGE_RXCLEAR);
 
 	return SSCP_SUCCESS;
 }
 
-LONG SSCP_SerialSend(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length)
+static LONG SSCP_Com_Send(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length)
 {
 	const BYTE* pSendBuffer;
 	DWORD dwTotalLen;
@@ -146,6 +160,8 @@ LONG SSCP_SerialSend(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length)
 		else
 			dwWriteLen = 256;
 
+		ctx->stats.writeCalls++;
+
 		if (!WriteFile(ctx->commHandle, pSendBuffer, dwWriteLen, &dwWritten, 0))
 		{
 			if (SSCP_DEBUG_SERIAL)
@@ -177,69 +193,92 @@ LONG SSCP_SerialSend(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length)
 	return SSCP_SUCCESS;
 }
 
-LONG SSCP_SerialRecv(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD length)
+static LONG SSCP_Com_Read(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD maxLength, DWORD timeout, DWORD* actLength)
 {
-	BYTE* pRecvBuffer;
-	DWORD dwRemainingLen = length;
-	DWORD dwReceivedLen = 0;
+	DWORD dwGotLen = 0;
 	DWORD i;
 
 	if (ctx == NULL)
 		return SSCP_ERR_INVALID_CONTEXT;
 	if (ctx->commHandle == INVALID_HANDLE_VALUE)
 		return SSCP_ERR_COMM_NOT_OPEN;
-	if (buffer == NULL)
+	if ((buffer == NULL) || (maxLength == 0) || (actLength == NULL))
 		return SSCP_ERR_INVALID_PARAMETER;
 
-	pRecvBuffer = buffer;
+	*actLength = 0;
 
-	while (dwRemainingLen)
+	if (timeout == 0)
+		timeout = 1;
+
+	if (timeout != ctx->readTimeout)
 	{
-		DWORD dwWantLen, dwGotLen;
+		/* Return as soon as at least one byte is there, with whatever is available, or after the timeout */
+		COMMTIMEOUTS stTimeout = { 0 };
 
-		if (dwRemainingLen < 32)
-			dwWantLen = dwRemainingLen;
-		else
-			dwWantLen = 32;
+		stTimeout.ReadIntervalTimeout = MAXDWORD;
+		stTimeout.ReadTotalTimeoutMultiplier = MAXDWORD;
+		stTimeout.ReadTotalTimeoutConstant = timeout;
+		stTimeout.WriteTotalTimeoutConstant = SSCP_RESPONSE_FIRST_TIMEOUT;
+		stTimeout.WriteTotalTimeoutMultiplier = SSCP_RESPONSE_NEXT_TIMEOUT;
 
-		if (!ReadFile(ctx->commHandle, pRecvBuffer, dwWantLen, &dwGotLen, 0))
+		if (!SetCommTimeouts(ctx->commHandle, &stTimeout))
 		{
 			if (SSCP_DEBUG_SERIAL)
-				SSCP_Trace("ReadFile failed (%d)\n", GetLastError());
-			return SSCP_ERR_COMM_RECV_FAILED;
+				SSCP_Trace("SetCommTimeouts failed (%d)\n", GetLastError());
+			ctx->readTimeout = 0;
+			return SSCP_ERR_COMM_CONTROL_FAILED;
 		}
 
-		ctx->stats.bytesReceived += dwGotLen;
+		ctx->readTimeout = timeout;
+	}
 
-		if (SSCP_DEBUG_SERIAL)
-		{
-			SSCP_Trace(">");
-			for (i = 0; i < dwGotLen; i++)
-				SSCP_Trace("%02X", pRecvBuffer[i]);
-			SSCP_Trace("\n");
-		}
+	ctx->stats.readCalls++;
 
-		dwRemainingLen -= dwGotLen;
-		dwReceivedLen += dwGotLen;
-		pRecvBuffer += dwGotLen;
+	if (!ReadFile(ctx->commHandle, buffer, maxLength, &dwGotLen, 0))
+	{
+		if (SSCP_DEBUG_SERIAL)
+			SSCP_Trace("ReadFile failed (%d)\n", GetLastError());
+		return SSCP_ERR_COMM_RECV_FAILED;
+	}
 
-		if (dwGotLen < dwWantLen)
-		{
-			if (SSCP_DEBUG_SERIAL)
-				SSCP_Trace("ReadFile timeout (%d<%d, total %d/%d, code %d)\n", dwGotLen, dwWantLen, dwReceivedLen, length, GetLastError());
-			break;
-		}
+	if (dwGotLen == 0)
+	{
+		if (SSCP_DEBUG_SERIAL)
+			SSCP_Trace("ReadFile timeout (%dms)\n", timeout);
+		return SSCP_ERR_COMM_RECV_MUTE;
 	}
 
-	if (dwRemainingLen)	/* A timeout has occured */
+	ctx->stats.bytesReceived += dwGotLen;
+
+	if (SSCP_DEBUG_SERIAL)
 	{
-		if (dwReceivedLen == 0)
-			return SSCP_ERR_COMM_RECV_MUTE;
-		else
-			return SSCP_ERR_COMM_RECV_STOPPED;
+		SSCP_Trace(">");
+		for (i = 0; i < dwGotLen; i++)
+			SSCP_Trace("%02X", buffer[i]);
+		SSCP_Trace("\n");
 	}
 
+	*actLength = dwGotLen;
+
 	return SSCP_SUCCESS;
 }
 
+/* A COM port can't be waited on with poll() */
+static int SSCP_Com_PollFd(SSCP_CTX_ST* ctx)
+{
+	return -1;
+}
+
+const SSCP_TRANSPORT_ST SSCP_TRANSPORT_SERIAL = {
+	SSCP_Com_Open,
+	SSCP_Com_Close,
+	SSCP_Com_Configure,
+	SSCP_Com_Send,
+	SSCP_Com_Read,
+	SSCP_Com_Flush,
+	SSCP_Com_PollFd,
+	SSCP_Com_CheckBaudrate,
+	NULL
+};
+
 #endif
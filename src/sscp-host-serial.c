@@ -0,0 +1,560 @@
+#include "sscp-host-serial_i.h"
+
+/*
+ * Transports
+ * ----------
+ *
+ * The name given to SSCP_Open chooses the transport: "loop:" the in-memory loopback, "tcp:host:port" or "unix:path"
+ * a stream socket, "rfc2217:host:port" a Telnet COM port server, anything else a serial port. The SSCP_Serial functions check the context and hand over to it.
+ */
+
+static const struct
+{
+	const char* prefix;
+	const SSCP_TRANSPORT_ST* transport;
+} SSCP_TRANSPORTS[] = {
+	{ "loop:", &SSCP_TRANSPORT_LOOPBACK },
+#ifndef _WIN32
+	{ "tcp:", &SSCP_TRANSPORT_SOCKET },
+	{ "unix:", &SSCP_TRANSPORT_SOCKET },
+	{ "rfc2217:", &SSCP_TRANSPORT_SOCKET },
+#endif
+};
+
+static const SSCP_TRANSPORT_ST* SSCP_GetTransport(const char* commName)
+{
+	DWORD i;
+
+	for (i = 0; i < sizeof(SSCP_TRANSPORTS) / sizeof(SSCP_TRANSPORTS[0]); i++)
+		if (!strncmp(commName, SSCP_TRANSPORTS[i].prefix, strlen(SSCP_TRANSPORTS[i].prefix)))
+			return SSCP_TRANSPORTS[i].transport;
+
+	return &SSCP_TRANSPORT_SERIAL;
+}
+
+LONG SSCP_SerialOpen(SSCP_CTX_ST* ctx, const char* commName)
+{
+	const SSCP_TRANSPORT_ST* transport;
+	LONG rc;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (commName == NULL)
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	/* Don't forget to close in case of it were previously open */
+	SSCP_SerialClose(ctx);
+
+	transport = SSCP_GetTransport(commName);
+	rc = transport->open(ctx, commName);
+	if (rc)
+		return rc;
+
+	ctx->transport = transport;
+	SSCP_SerialPurge(ctx);
+
+	return SSCP_SUCCESS;
+}
+
+LONG SSCP_SerialClose(SSCP_CTX_ST* ctx)
+{
+	LONG rc;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (ctx->transport == NULL)
+		return SSCP_ERR_COMM_NOT_OPEN;
+
+	rc = ctx->transport->close(ctx);
+	ctx->transport = NULL;
+
+	return rc;
+}
+
+LONG SSCP_SerialConfigure(SSCP_CTX_ST* ctx, DWORD baudrate)
+{
+	LONG rc;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (ctx->transport == NULL)
+		return SSCP_ERR_COMM_NOT_OPEN;
+
+	rc = ctx->transport->configure(ctx, baudrate);
+	if (rc)
+		return rc;
+
+	ctx->baudrate = baudrate;
+	return SSCP_SUCCESS;
+}
+
+LONG SSCP_SerialCheckBaudrate(SSCP_CTX_ST* ctx, DWORD baudrate)
+{
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (ctx->transport == NULL)
+		return SSCP_ERR_COMM_NOT_OPEN;
+
+	/* Sockets and the loopback: the rate is not ours to change */
+	if (ctx->transport->checkBaudrate == NULL)
+		return SSCP_ERR_COMM_CONTROL_FAILED;
+
+	return ctx->transport->checkBaudrate(ctx, baudrate);
+}
+
+LONG SSCP_SerialSetRS485(SSCP_CTX_ST* ctx, DWORD rs485Flags, DWORD delayBeforeSendMs, DWORD delayAfterSendMs)
+{
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (ctx->transport == NULL)
+		return SSCP_ERR_COMM_NOT_OPEN;
+
+	if (ctx->transport->setRS485 == NULL)
+		return SSCP_ERR_COMM_CONTROL_FAILED;
+
+	return ctx->transport->setRS485(ctx, rs485Flags, delayBeforeSendMs, delayAfterSendMs);
+}
+
+LONG SSCP_SerialSetTimeouts(SSCP_CTX_ST* ctx, DWORD first_byte, DWORD inter_byte)
+{
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (ctx->transport == NULL)
+		return SSCP_ERR_COMM_NOT_OPEN;
+
+	/* Applied by SSCP_SerialRead */
+	ctx->firstByteTimeout = first_byte;
+	ctx->interByteTimeout = inter_byte;
+
+	return SSCP_SUCCESS;
+}
+
+LONG SSCP_SerialFlush(SSCP_CTX_ST* ctx)
+{
+	LONG rc;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (ctx->transport == NULL)
+		return SSCP_ERR_COMM_NOT_OPEN;
+
+	rc = ctx->transport->flush(ctx);
+	SSCP_SerialPurge(ctx);
+
+	return rc;
+}
+
+LONG SSCP_SerialSend(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length)
+{
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (ctx->transport == NULL)
+		return SSCP_ERR_COMM_NOT_OPEN;
+
+	return ctx->transport->send(ctx, buffer, length);
+}
+
+LONG SSCP_SerialRead(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD maxLength, DWORD timeout, DWORD* actLength)
+{
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (ctx->transport == NULL)
+		return SSCP_ERR_COMM_NOT_OPEN;
+
+	return ctx->transport->read(ctx, buffer, maxLength, timeout, actLength);
+}
+
+/**
+ * \brief descriptor to wait on for the responses of the reader, in an event loop; -1 if the transport has none
+ */
+LONG SSCP_GetPollFd(SSCP_CTX_ST* ctx, int* fd)
+{
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (fd == NULL)
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	*fd = -1;
+	if (ctx->transport == NULL)
+		return SSCP_ERR_COMM_NOT_OPEN;
+
+	*fd = ctx->transport->pollFd(ctx);
+	return SSCP_SUCCESS;
+}
+
+/*
+ * Receive ring
+ * ------------
+ *
+ * Whatever the device has sent is read at once into the ring of the context (as much as available, in a single
+ * system call), then frames and bytes are taken from the ring. recvHead and recvTail are free-running counters,
+ * the ring size being a power of 2.
+ */
+
+#define SSCP_RING_COUNT(ctx) ((ctx)->recvHead - (ctx)->recvTail)
+#define SSCP_RING_AT(ctx, i) ((ctx)->recvRing[((ctx)->recvTail + (i)) & (SSCP_RECV_RING_SIZE - 1)])
+
+/**
+ * \brief make sure there are at least 'needed' bytes in the ring
+ */
+static LONG SSCP_SerialFill(SSCP_CTX_ST* ctx, DWORD needed, BOOL started)
+{
+	DWORD now;
+	LONG rc;
+
+	if (ctx->recvRing == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (needed > SSCP_RECV_RING_SIZE)
+		return SSCP_ERR_RESPONSE_TOO_LONG;
+
+	while (SSCP_RING_COUNT(ctx) < needed)
+	{
+		DWORD offset = ctx->recvHead & (SSCP_RECV_RING_SIZE - 1);
+		DWORD room = SSCP_RECV_RING_SIZE - SSCP_RING_COUNT(ctx);
+		DWORD got = 0;
+
+		/* Stick to the contiguous part, we'll wrap on next read */
+		if (room > SSCP_RECV_RING_SIZE - offset)
+			room = SSCP_RECV_RING_SIZE - offset;
+
+		rc = SSCP_SerialRead(ctx, &ctx->recvRing[offset], room, started ? ctx->interByteTimeout : ctx->firstByteTimeout, &got);
+		if (rc)
+		{
+			if (started && (rc == SSCP_ERR_COMM_RECV_MUTE))
+				rc = SSCP_ERR_COMM_RECV_STOPPED;
+			return rc;
+		}
+
+		/* Timing of the response, for the adaptive timeouts */
+		now = SSCP_GetTimeUs();
+		if (!started)
+			ctx->recvFirstUs = now ? now : 1;
+		else if (now - ctx->recvLastUs > ctx->recvMaxGapUs)
+			ctx->recvMaxGapUs = now - ctx->recvLastUs;
+		ctx->recvLastUs = now;
+		ctx->recvReads++;
+
+		ctx->recvHead += got;
+		started = TRUE;
+	}
+
+	return SSCP_SUCCESS;
+}
+
+static void SSCP_SerialTake(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD length)
+{
+	DWORD offset = ctx->recvTail & (SSCP_RECV_RING_SIZE - 1);
+	DWORD first = length;
+
+	if (first > SSCP_RECV_RING_SIZE - offset)
+		first = SSCP_RECV_RING_SIZE - offset;
+
+	if (buffer != NULL)
+	{
+		memcpy(buffer, &ctx->recvRing[offset], first);
+		memcpy(&buffer[first], ctx->recvRing, length - first);
+	}
+
+	ctx->recvTail += length;
+	ctx->recvCrcSz = 0;
+}
+
+/**
+ * \brief get exactly 'length' bytes from the device
+ */
+LONG SSCP_SerialRecv(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD length)
+{
+	LONG rc;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if (buffer == NULL)
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	rc = SSCP_SerialFill(ctx, length, SSCP_RING_COUNT(ctx) > 0);
+	if (rc)
+		return rc;
+
+	SSCP_SerialTake(ctx, buffer, length);
+	return SSCP_SUCCESS;
+}
+
+/**
+ * \brief forget everything that has been received and not consumed yet
+ */
+void SSCP_SerialPurge(SSCP_CTX_ST* ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	ctx->recvTail = ctx->recvHead;
+	ctx->recvCrcSz = 0;
+}
+
+/**
+ * \brief CRC of 'length' bytes of the ring, starting 'offset' bytes after its tail
+ */
+static WORD SSCP_SerialCRC16(SSCP_CTX_ST* ctx, WORD crc, DWORD offset, DWORD length)
+{
+	DWORD start = (ctx->recvTail + offset) & (SSCP_RECV_RING_SIZE - 1);
+	DWORD first = length;
+
+	if (first > SSCP_RECV_RING_SIZE - start)
+		first = SSCP_RECV_RING_SIZE - start;
+
+	crc = SSCP_CRC16_Update(crc, &ctx->recvRing[start], first);
+	return SSCP_CRC16_Update(crc, ctx->recvRing, length - first);
+}
+
+/**
+ * \brief CRC of the frame at the tail of the ring, over its first 'length' bytes after the SOF; only the bytes not
+ * seen by the previous call are read
+ */
+static WORD SSCP_SerialFrameCRC16(SSCP_CTX_ST* ctx, DWORD length)
+{
+	if (ctx->recvCrcSz == 0)
+		ctx->recvCrc = SSCP_CRC16_Init();
+
+	if (length > ctx->recvCrcSz)
+	{
+		ctx->recvCrc = SSCP_SerialCRC16(ctx, ctx->recvCrc, 1 + ctx->recvCrcSz, length - ctx->recvCrcSz);
+		ctx->recvCrcSz = length;
+	}
+
+	return ctx->recvCrc;
+}
+
+/**
+ * \brief offset of the first complete and valid frame after the tail of the ring, 0 if there is none (yet)
+ */
+static DWORD SSCP_SerialFindFrame(SSCP_CTX_ST* ctx)
+{
+	DWORD count = SSCP_RING_COUNT(ctx);
+	DWORD offset, length;
+	BYTE crc[2];
+
+	for (offset = 1; offset + SSCP_FRAME_HEADER_SIZE + SSCP_FRAME_CRC_SIZE <= count; offset++)
+	{
+		if (SSCP_RING_AT(ctx, offset) != 0x02)
+			continue;
+
+		length = SSCP_RING_AT(ctx, offset + 1);
+		length <<= 8;
+		length |= SSCP_RING_AT(ctx, offset + 2);
+		if (offset + SSCP_FRAME_HEADER_SIZE + length + SSCP_FRAME_CRC_SIZE > count)
+			continue;
+
+		SSCP_CRC16_Final(SSCP_SerialCRC16(ctx, SSCP_CRC16_Init(), offset + 1, 4 + length), crc);
+		if ((crc[0] == SSCP_RING_AT(ctx, offset + SSCP_FRAME_HEADER_SIZE + length)) && (crc[1] == SSCP_RING_AT(ctx, offset + SSCP_FRAME_HEADER_SIZE + length + 1)))
+			return offset;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief throw away 'length' bytes that are not part of a valid frame (resync mode)
+ */
+static void SSCP_SerialDrop(SSCP_CTX_ST* ctx, DWORD length)
+{
+	SSCP_SerialTake(ctx, NULL, length);
+	ctx->stats.bytesDropped += length;
+
+	if (SSCP_RING_COUNT(ctx) == 0)
+	{
+		/* Nothing left, the response may still be coming: time it from now on */
+		ctx->recvFirstUs = 0;
+		ctx->recvMaxGapUs = 0;
+		ctx->recvReads = 0;
+	}
+}
+
+/**
+ * \brief whether the 'length' bytes at the tail of the ring are the copy of the frame just sent
+ */
+static BOOL SSCP_SerialIsEcho(SSCP_CTX_ST* ctx, DWORD length)
+{
+	DWORD i;
+
+	if ((ctx->echoSz == 0) || (ctx->echoSz != length))
+		return FALSE;
+
+	for (i = 0; i < length; i++)
+		if (SSCP_RING_AT(ctx, i) != ctx->frameBuffer[i])
+			return FALSE;
+
+	return TRUE;
+}
+
+/**
+ * \brief get a complete SSCP frame from the device, check its CRC and return its header and payload
+ *
+ * In resync mode (SSCP_COMM_FLAG_RESYNC), whatever comes before a SOF is skipped, and a candidate frame that has an
+ * impossible length, a wrong CRC, or that does not complete in time is skipped byte after byte until a valid frame
+ * is found. Otherwise, the first bytes must be a valid frame.
+ *
+ * With SSCP_COMM_FLAG_ECHO, a frame identical to the one just sent is the adapter's echo and is skipped, even when it
+ * is longer than maxPayloadSz.
+ */
+LONG SSCP_SerialRecvFrame(SSCP_CTX_ST* ctx, BYTE header[SSCP_FRAME_HEADER_SIZE], BYTE payload[], DWORD maxPayloadSz, DWORD* actPayloadSz)
+{
+	BOOL resync, echo;
+	BYTE crcA[2], crcB[2];
+	DWORD length, i;
+	WORD crc;
+	LONG rc;
+
+	if (ctx == NULL)
+		return SSCP_ERR_INVALID_CONTEXT;
+	if ((header == NULL) || ((payload == NULL) && (maxPayloadSz > 0)))
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	resync = (ctx->commFlags & SSCP_COMM_FLAG_RESYNC) ? TRUE : FALSE;
+
+	ctx->recvFirstUs = 0;
+	ctx->recvMaxGapUs = 0;
+	ctx->recvReads = 0;
+
+	for (;;)
+	{
+		/* Header */
+		if (resync)
+		{
+			/* Look for a SOF */
+			rc = SSCP_SerialFill(ctx, 1, SSCP_RING_COUNT(ctx) > 0);
+			if (rc)
+				return rc;
+
+			for (i = 0; i < SSCP_RING_COUNT(ctx); i++)
+				if (SSCP_RING_AT(ctx, i) == 0x02)
+					break;
+			if (i > 0)
+			{
+				SSCP_SerialDrop(ctx, i);
+				continue;
+			}
+		}
+
+		rc = SSCP_SerialFill(ctx, SSCP_FRAME_HEADER_SIZE, SSCP_RING_COUNT(ctx) > 0);
+		if (rc)
+		{
+			if (resync && (rc == SSCP_ERR_COMM_RECV_STOPPED) && (SSCP_RING_COUNT(ctx) > 1))
+			{
+				SSCP_SerialDrop(ctx, 1);
+				continue;
+			}
+			return rc;
+		}
+
+		for (i = 0; i < SSCP_FRAME_HEADER_SIZE; i++)
+			header[i] = SSCP_RING_AT(ctx, i);
+
+		/* Not a frame: what follows cannot be trusted either, don't leave it for the next exchange */
+		if (header[0] != 0x02)
+		{
+			SSCP_SerialPurge(ctx);
+			return SSCP_ERR_WRONG_RESPONSE_COMMAND;
+		}
+		length = header[1];
+		length <<= 8;
+		length |= header[2];
+
+		/* A command, so its echo, may be longer than any response: let it come, it is checked whole further on */
+		echo = ((ctx->echoSz == SSCP_FRAME_HEADER_SIZE + length + SSCP_FRAME_CRC_SIZE) && !memcmp(header, ctx->frameBuffer, SSCP_FRAME_HEADER_SIZE)) ? TRUE : FALSE;
+
+		if (resync && !echo && (length > SSCP_MAX_PAYLOAD_SIZE))
+		{
+			SSCP_SerialDrop(ctx, 1);
+			continue;
+		}
+
+		if (!resync && !echo && (length > maxPayloadSz)) /* Payload will not fit */
+		{
+			SSCP_SerialPurge(ctx);
+			return SSCP_ERR_RESPONSE_TOO_LONG;
+		}
+
+		/* Don't wait for the end of a false SOF if a valid frame follows */
+		if (resync && !echo && (SSCP_RING_COUNT(ctx) < SSCP_FRAME_HEADER_SIZE + length + SSCP_FRAME_CRC_SIZE))
+		{
+			i = SSCP_SerialFindFrame(ctx);
+			if (i > 0)
+			{
+				SSCP_SerialDrop(ctx, i);
+				continue;
+			}
+		}
+
+		/* Payload and CRC, most of the time they are already there; otherwise what has come is added to the CRC while
+		 * the rest is on its way */
+		rc = SSCP_SUCCESS;
+		while ((rc == SSCP_SUCCESS) && (SSCP_RING_COUNT(ctx) < SSCP_FRAME_HEADER_SIZE + length + SSCP_FRAME_CRC_SIZE))
+		{
+			i = SSCP_RING_COUNT(ctx) - 1;
+			SSCP_SerialFrameCRC16(ctx, (i < 4 + length) ? i : 4 + length);
+			rc = SSCP_SerialFill(ctx, SSCP_RING_COUNT(ctx) + 1, TRUE);
+		}
+		if (rc)
+		{
+			if (resync && (rc == SSCP_ERR_COMM_RECV_STOPPED))
+			{
+				SSCP_SerialDrop(ctx, 1);
+				if (SSCP_RING_COUNT(ctx) > 0)
+					continue;
+			}
+			return rc;
+		}
+
+		crc = SSCP_SerialFrameCRC16(ctx, 4 + length);
+		SSCP_CRC16_Final(crc, crcA);
+		crcB[0] = SSCP_RING_AT(ctx, SSCP_FRAME_HEADER_SIZE + length);
+		crcB[1] = SSCP_RING_AT(ctx, SSCP_FRAME_HEADER_SIZE + length + 1);
+
+		if (memcmp(crcA, crcB, 2))
+		{
+			if (resync)
+			{
+				SSCP_SerialDrop(ctx, 1);
+				continue;
+			}
+			SSCP_SerialTake(ctx, NULL, SSCP_FRAME_HEADER_SIZE + length + SSCP_FRAME_CRC_SIZE);
+			return SSCP_ERR_WRONG_RESPONSE_CRC;
+		}
+
+		if (SSCP_SerialIsEcho(ctx, SSCP_FRAME_HEADER_SIZE + length + SSCP_FRAME_CRC_SIZE))
+		{
+			/* A timeout retry sends the same frame again, so there may be more than one */
+			SSCP_SerialTake(ctx, NULL, ctx->echoSz);
+			ctx->stats.echoesDropped++;
+
+			/* The response is timed from its own first byte */
+			if (SSCP_RING_COUNT(ctx) == 0)
+			{
+				ctx->recvFirstUs = 0;
+				ctx->recvMaxGapUs = 0;
+				ctx->recvReads = 0;
+			}
+			continue;
+		}
+
+		break;
+	}
+
+	/* This is a valid frame */
+	SSCP_SerialTake(ctx, NULL, SSCP_FRAME_HEADER_SIZE);
+	ctx->stats.framesReceived++;
+
+	if (length > maxPayloadSz) /* Payload will not fit */
+	{
+		SSCP_SerialTake(ctx, NULL, length + SSCP_FRAME_CRC_SIZE);
+		return SSCP_ERR_RESPONSE_TOO_LONG;
+	}
+
+	SSCP_SerialTake(ctx, payload, length);
+	SSCP_SerialTake(ctx, NULL, SSCP_FRAME_CRC_SIZE);
+
+	if (actPayloadSz != NULL)
+		*actPayloadSz = length;
+
+	return SSCP_SUCCESS;
+}
@@ -3,11 +3,30 @@
 
 #include "sscp-host_i.h"
 
+extern BOOL SSCP_DEBUG_SERIAL;
+
 #define SSCP_RESPONSE_FIRST_TIMEOUT 1000
 #define SSCP_RESPONSE_NEXT_TIMEOUT  50
 
+/* Default first-byte timeouts of the commands that do not need SSCP_RESPONSE_FIRST_TIMEOUT */
+#define SSCP_OUTPUTS_FIRST_TIMEOUT 250
+#define SSCP_GET_INFOS_FIRST_TIMEOUT 250
+#define SSCP_SCAN_GLOBAL_FIRST_TIMEOUT 500
+#define SSCP_TRANSCEIVE_APDU_FIRST_TIMEOUT 3000
+
+/* Default bounds of the adaptive timeouts */
+#define SSCP_RESPONSE_MIN_TIMEOUT 20
+#define SSCP_RESPONSE_MAX_TIMEOUT 5000
+#define SSCP_RTT_MAX_BACKOFF 3
+
 #define SSCP_MAX_TIMEOUT_RETRY 3
 
+/* Class of the commands that keep their fixed first-byte timeout, see SSCP_GetCommandClass */
+#define SSCP_RTT_CLASS_NONE SSCP_RTT_CLASS_COUNT
+
 #define SSCP_SCAN_GLOBAL_GUARD_TIME 125
 
+/* How long a reader may take to answer the probe of SSCP_Discover, once the probe is on the line */
+#define SSCP_DISCOVER_REPLY_TIMEOUT 30
+
 #endif
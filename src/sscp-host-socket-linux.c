@@ -0,0 +1,676 @@
+#include "sscp-host-serial_i.h"
+
+#ifndef _WIN32
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <limits.h>
+
+/*
+ * Socket transport
+ * ----------------
+ *
+ * "tcp:host:port" connects to a serial device server that passes the bytes of the UART as they are (raw TCP), and
+ * "unix:path" to a local stream socket; the baud rate is then set on the device server. "rfc2217:host:port" speaks
+ * Telnet with the COM Port Control option (RFC 2217): the baud rate is set remotely, 0xFF is escaped both ways.
+ *
+ * Nagle is disabled and a frame goes out in a single send(), so that the device server gets it at once. When the
+ * connection drops (device server restarted, idle timeout...), the exchange in progress fails and the next frame is
+ * sent over a new connection, with the baud rate set again. The session with the reader is not affected. Connecting
+ * again goes to the address found at open time, without resolving the name, and takes no longer than the first-byte
+ * timeout of the exchange.
+ */
+
+/* Telnet (RFC 854) */
+#define TELNET_IAC 255
+#define TELNET_DONT 254
+#define TELNET_DO 253
+#define TELNET_WONT 252
+#define TELNET_WILL 251
+#define TELNET_SB 250
+#define TELNET_SE 240
+#define TELNET_OPTION_BINARY 0
+#define TELNET_OPTION_SGA 3
+#define TELNET_OPTION_COM_PORT 44
+
+/* COM Port Control (RFC 2217), the server answers with the code + 100 */
+#define COM_PORT_SET_BAUDRATE 1
+#define COM_PORT_SET_DATASIZE 2
+#define COM_PORT_SET_PARITY 3
+#define COM_PORT_SET_STOPSIZE 4
+#define COM_PORT_SET_CONTROL 5
+#define COM_PORT_SERVER 100
+
+/* How long the server has to confirm a new baud rate */
+#define SSCP_RFC2217_TIMEOUT 1000
+
+/* How long the first connection may take, at open time */
+#define SSCP_SOCKET_CONNECT_TIMEOUT 3000
+
+/* Where the receive parser is within the Telnet stream */
+#define TELNET_STATE_DATA 0
+#define TELNET_STATE_IAC 1
+#define TELNET_STATE_OPTION 2
+#define TELNET_STATE_SUB 3
+#define TELNET_STATE_SUB_IAC 4
+
+typedef struct
+{
+	char name[256];
+	struct sockaddr_storage addr;	/* To connect again, once connected */
+	socklen_t addrLen;
+	BOOL rfc2217;
+	DWORD baudrate;		/* Set again after a new connection, 0 until configured */
+	DWORD baudrateAck;	/* Confirmed by the server */
+	BYTE telnetState;
+	BYTE telnetCommand;	/* WILL, WONT, DO or DONT, waiting for its option */
+	BYTE sub[16];		/* Subnegotiation being received */
+	DWORD subSz;
+	BYTE sendBuffer[2 * (SSCP_FRAME_HEADER_SIZE + SSCP_MAX_COMMAND_SIZE + SSCP_FRAME_CRC_SIZE)];	/* Frame with 0xFF doubled */
+} SSCP_SOCKET_ST;
+
+static LONG SSCP_Socket_Configure(SSCP_CTX_ST* ctx, DWORD baudrate);
+
+/**
+ * \brief connect without blocking for longer than timeout ms; the socket is blocking again when it is returned
+ */
+static int SSCP_Socket_ConnectAddr(const struct sockaddr* addr, socklen_t addrLen, DWORD timeout)
+{
+	struct pollfd pfd;
+	socklen_t errLen = sizeof(int);
+	int fd, flags, sel;
+	int err = 0;
+	int one = 1;
+
+	fd = socket(addr->sa_family, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	flags = fcntl(fd, F_GETFL, 0);
+	if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0))
+		goto failed;
+
+	if (connect(fd, addr, addrLen))
+	{
+		if (errno != EINPROGRESS)
+			goto failed;
+
+		pfd.fd = fd;
+		pfd.events = POLLOUT;
+		do
+		{
+			pfd.revents = 0;
+			sel = poll(&pfd, 1, (timeout > INT_MAX) ? INT_MAX : (int)timeout);
+		} while ((sel < 0) && (errno == EINTR));
+
+		if (sel == 0)
+			errno = ETIMEDOUT;
+		if (sel <= 0)
+			goto failed;
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen) || err)
+		{
+			errno = err;
+			goto failed;
+		}
+	}
+
+	if (fcntl(fd, F_SETFL, flags) < 0)
+		goto failed;
+
+	/* Small frames, each one waited for: don't let Nagle hold them back */
+	if (addr->sa_family != AF_UNIX)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	return fd;
+
+failed:
+	close(fd);
+	return -1;
+}
+
+static int SSCP_Socket_ConnectTcp(SSCP_SOCKET_ST* sock, const char* address, DWORD timeout)
+{
+	struct addrinfo hints;
+	struct addrinfo* result;
+	struct addrinfo* ai;
+	char host[256];
+	const char* port;
+	size_t hostLen;
+	int fd = -1;
+
+	/* host:port, or [host]:port for an IPv6 address */
+	port = strrchr(address, ':');
+	if ((port == NULL) || (port == address) || (port[1] == '\0'))
+		return -1;
+	hostLen = port - address;
+	port++;
+	if ((address[0] == '[') && (address[hostLen - 1] == ']'))
+	{
+		address++;
+		hostLen -= 2;
+	}
+	if (hostLen >= sizeof(host))
+		return -1;
+	memcpy(host, address, hostLen);
+	host[hostLen] = '\0';
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(host, port, &hints, &result))
+		return -1;
+
+	for (ai = result; ai != NULL; ai = ai->ai_next)
+	{
+		if (ai->ai_addrlen > sizeof(sock->addr))
+			continue;
+		fd = SSCP_Socket_ConnectAddr(ai->ai_addr, ai->ai_addrlen, timeout);
+		if (fd >= 0)
+		{
+			/* Connecting again won't have to resolve the name */
+			memcpy(&sock->addr, ai->ai_addr, ai->ai_addrlen);
+			sock->addrLen = ai->ai_addrlen;
+			break;
+		}
+	}
+
+	freeaddrinfo(result);
+	return fd;
+}
+
+static int SSCP_Socket_ConnectUnix(SSCP_SOCKET_ST* sock, const char* path, DWORD timeout)
+{
+	struct sockaddr_un* sun = (struct sockaddr_un*)&sock->addr;
+
+	if (strlen(path) >= sizeof(sun->sun_path))
+		return -1;
+
+	memset(sun, 0, sizeof(*sun));
+	sun->sun_family = AF_UNIX;
+	strcpy(sun->sun_path, path);
+	sock->addrLen = sizeof(*sun);
+
+	return SSCP_Socket_ConnectAddr((struct sockaddr*)sun, sock->addrLen, timeout);
+}
+
+static void SSCP_Socket_Disconnect(SSCP_CTX_ST* ctx)
+{
+	if (ctx->commFd >= 0)
+		close(ctx->commFd);
+	ctx->commFd = -1;
+}
+
+/**
+ * \brief send everything, in as few calls as the kernel allows (one, most of the time)
+ *
+ * On failure, *error (if not NULL) is the errno of send(), before anything else may have changed it.
+ */
+static LONG SSCP_Socket_SendAll(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length, int* error)
+{
+	DWORD offset = 0;
+	ssize_t sent;
+	int err;
+
+	while (offset < length)
+	{
+		/* No SIGPIPE if the server has gone */
+		do
+		{
+			sent = send(ctx->commFd, &buffer[offset], length - offset, MSG_NOSIGNAL);
+		} while ((sent < 0) && (errno == EINTR));
+
+		ctx->stats.writeCalls++;
+
+		if (sent <= 0)
+		{
+			err = (sent < 0) ? errno : EPIPE;
+			if (error != NULL)
+				*error = err;
+			if (SSCP_DEBUG_SERIAL)
+				SSCP_Trace("send(%lu) error (%d)\n", length - offset, err);
+			return SSCP_ERR_COMM_SEND_FAILED;
+		}
+
+		ctx->stats.bytesSent += sent;
+		offset += sent;
+	}
+
+	return SSCP_SUCCESS;
+}
+
+/* Refuse what we have not asked for; what we have asked for needs no answer */
+static void SSCP_Telnet_Negotiate(SSCP_CTX_ST* ctx, BYTE command, BYTE option)
+{
+	BYTE reply[3];
+
+	reply[0] = TELNET_IAC;
+	reply[2] = option;
+
+	if ((command == TELNET_DO) && (option != TELNET_OPTION_BINARY) && (option != TELNET_OPTION_SGA) && (option != TELNET_OPTION_COM_PORT))
+		reply[1] = TELNET_WONT;
+	else if ((command == TELNET_WILL) && (option != TELNET_OPTION_BINARY) && (option != TELNET_OPTION_SGA))
+		reply[1] = TELNET_DONT;
+	else
+		return;
+
+	SSCP_Socket_SendAll(ctx, reply, sizeof(reply), NULL);
+}
+
+static void SSCP_Telnet_Subnegotiation(SSCP_SOCKET_ST* sock)
+{
+	/* Only the confirmation of the baud rate matters, line and modem states are of no use */
+	if ((sock->subSz == 6) && (sock->sub[0] == TELNET_OPTION_COM_PORT) && (sock->sub[1] == COM_PORT_SERVER + COM_PORT_SET_BAUDRATE))
+		sock->baudrateAck = ((DWORD)sock->sub[2] << 24) | ((DWORD)sock->sub[3] << 16) | ((DWORD)sock->sub[4] << 8) | sock->sub[5];
+}
+
+/**
+ * \brief strip the Telnet commands from what has been received, in place; returns the number of data bytes left
+ *
+ * A command may be split over two reads, the state of the parser is kept in between.
+ */
+static DWORD SSCP_Telnet_Filter(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD length)
+{
+	SSCP_SOCKET_ST* sock = ctx->transportState;
+	DWORD i, out = 0;
+
+	for (i = 0; i < length; i++)
+	{
+		BYTE b = buffer[i];
+
+		switch (sock->telnetState)
+		{
+			case TELNET_STATE_DATA:
+				if (b == TELNET_IAC)
+					sock->telnetState = TELNET_STATE_IAC;
+				else
+					buffer[out++] = b;
+			break;
+
+			case TELNET_STATE_IAC:
+				sock->telnetState = TELNET_STATE_DATA;
+				if (b == TELNET_IAC)
+				{
+					/* Escaped 0xFF */
+					buffer[out++] = b;
+				}
+				else if ((b == TELNET_WILL) || (b == TELNET_WONT) || (b == TELNET_DO) || (b == TELNET_DONT))
+				{
+					sock->telnetCommand = b;
+					sock->telnetState = TELNET_STATE_OPTION;
+				}
+				else if (b == TELNET_SB)
+				{
+					sock->subSz = 0;
+					sock->telnetState = TELNET_STATE_SUB;
+				}
+				/* Anything else (NOP, GA...) is ignored */
+			break;
+
+			case TELNET_STATE_OPTION:
+				SSCP_Telnet_Negotiate(ctx, sock->telnetCommand, b);
+				sock->telnetState = TELNET_STATE_DATA;
+			break;
+
+			case TELNET_STATE_SUB:
+				if (b == TELNET_IAC)
+					sock->telnetState = TELNET_STATE_SUB_IAC;
+				else if (sock->subSz < sizeof(sock->sub))
+					sock->sub[sock->subSz++] = b;
+			break;
+
+			case TELNET_STATE_SUB_IAC:
+				if (b == TELNET_SE)
+				{
+					SSCP_Telnet_Subnegotiation(sock);
+					sock->telnetState = TELNET_STATE_DATA;
+				}
+				else
+				{
+					if (sock->subSz < sizeof(sock->sub))
+						sock->sub[sock->subSz++] = b;
+					sock->telnetState = TELNET_STATE_SUB;
+				}
+			break;
+		}
+	}
+
+	return out;
+}
+
+/**
+ * \brief wait up to timeout ms, then read what is there; *actLength may be 0 if only Telnet commands have come
+ */
+static LONG SSCP_Socket_RecvOnce(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD maxLength, DWORD timeout, DWORD* actLength)
+{
+	SSCP_SOCKET_ST* sock = ctx->transportState;
+	struct pollfd pfd;
+	ssize_t done;
+	int sel;
+
+	*actLength = 0;
+
+	/* Lost, the next send connects again */
+	if (ctx->commFd < 0)
+		return SSCP_ERR_COMM_RECV_FAILED;
+
+	pfd.fd = ctx->commFd;
+	pfd.events = POLLIN;
+
+	do
+	{
+		pfd.revents = 0;
+		sel = poll(&pfd, 1, (timeout > INT_MAX) ? INT_MAX : (int)timeout);
+	} while ((sel < 0) && (errno == EINTR));
+
+	if (sel < 0)
+		return SSCP_ERR_COMM_RECV_FAILED;
+	if (sel == 0)
+		return SSCP_ERR_COMM_RECV_MUTE;
+
+	do
+	{
+		done = recv(ctx->commFd, buffer, maxLength, 0);
+	} while ((done < 0) && (errno == EINTR));
+
+	ctx->stats.readCalls++;
+
+	/* 0 is the end of the stream: the server has closed the connection */
+	if (done <= 0)
+	{
+		if (SSCP_DEBUG_SERIAL)
+			SSCP_Trace("recv(%lu) failed (%d) [%ld]\n", maxLength, errno, (long)done);
+		SSCP_Socket_Disconnect(ctx);
+		return SSCP_ERR_COMM_RECV_FAILED;
+	}
+
+	ctx->stats.bytesReceived += done;
+
+	*actLength = sock->rfc2217 ? SSCP_Telnet_Filter(ctx, buffer, done) : (DWORD)done;
+	return SSCP_SUCCESS;
+}
+
+/**
+ * \brief connect, to the address of the first connection if there has been one; then with RFC 2217, negotiate and set
+ * the baud rate again
+ */
+static LONG SSCP_Socket_Connect(SSCP_CTX_ST* ctx, DWORD timeout)
+{
+	static const BYTE NEGOTIATION[] = {
+		TELNET_IAC, TELNET_WILL, TELNET_OPTION_BINARY,
+		TELNET_IAC, TELNET_DO, TELNET_OPTION_BINARY,
+		TELNET_IAC, TELNET_WILL, TELNET_OPTION_SGA,
+		TELNET_IAC, TELNET_DO, TELNET_OPTION_SGA,
+		TELNET_IAC, TELNET_WILL, TELNET_OPTION_COM_PORT
+	};
+	SSCP_SOCKET_ST* sock = ctx->transportState;
+	LONG rc;
+
+	if (SSCP_DEBUG_SERIAL)
+		SSCP_Trace("Connecting to %s...\n", sock->name);
+
+	if (sock->addrLen > 0)
+		ctx->commFd = SSCP_Socket_ConnectAddr((struct sockaddr*)&sock->addr, sock->addrLen, timeout);
+	else if (!strncmp(sock->name, "tcp:", 4))
+		ctx->commFd = SSCP_Socket_ConnectTcp(sock, &sock->name[4], timeout);
+	else if (!strncmp(sock->name, "rfc2217:", 8))
+		ctx->commFd = SSCP_Socket_ConnectTcp(sock, &sock->name[8], timeout);
+	else if (!strncmp(sock->name, "unix:", 5))
+		ctx->commFd = SSCP_Socket_ConnectUnix(sock, &sock->name[5], timeout);
+	else
+		ctx->commFd = -1;
+
+	if (ctx->commFd < 0)
+	{
+		if (SSCP_DEBUG_SERIAL)
+			SSCP_Trace("connect (%d)\n", errno);
+		return SSCP_ERR_COMM_NOT_AVAILABLE;
+	}
+
+	if (sock->rfc2217)
+	{
+		sock->telnetState = TELNET_STATE_DATA;
+		rc = SSCP_Socket_SendAll(ctx, NEGOTIATION, sizeof(NEGOTIATION), NULL);
+		if (!rc && sock->baudrate)
+			rc = SSCP_Socket_Configure(ctx, sock->baudrate);
+		if (rc)
+		{
+			SSCP_Socket_Disconnect(ctx);
+			return rc;
+		}
+	}
+
+	return SSCP_SUCCESS;
+}
+
+static LONG SSCP_Socket_Open(SSCP_CTX_ST* ctx, const char* commName)
+{
+	SSCP_SOCKET_ST* sock;
+	LONG rc;
+
+	if (strlen(commName) >= sizeof(sock->name))
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	sock = calloc(1, sizeof(SSCP_SOCKET_ST));
+	if (sock == NULL)
+		return SSCP_ERR_OUT_OF_MEMORY;
+	ctx->stats.trackedAllocations++;
+
+	strcpy(sock->name, commName);
+	sock->rfc2217 = !strncmp(commName, "rfc2217:", 8) ? TRUE : FALSE;
+	ctx->transportState = sock;
+
+	rc = SSCP_Socket_Connect(ctx, SSCP_SOCKET_CONNECT_TIMEOUT);
+	if (rc)
+	{
+		free(sock);
+		ctx->transportState = NULL;
+	}
+
+	return rc;
+}
+
+static LONG SSCP_Socket_Close(SSCP_CTX_ST* ctx)
+{
+	SSCP_Socket_Disconnect(ctx);
+	free(ctx->transportState);
+	ctx->transportState = NULL;
+	return SSCP_SUCCESS;
+}
+
+/**
+ * \brief with RFC 2217, set the line of the device server (baud rate, 8N1, no flow control) and wait for the baud rate
+ * to be confirmed; otherwise, nothing to do
+ */
+static LONG SSCP_Socket_Configure(SSCP_CTX_ST* ctx, DWORD baudrate)
+{
+	SSCP_SOCKET_ST* sock = ctx->transportState;
+	BYTE command[48];
+	DWORD commandSz = 0;
+	BYTE buffer[64];
+	DWORD got, start, elapsed;
+	LONG rc;
+	int i;
+
+	if (!sock->rfc2217)
+		return SSCP_SUCCESS;
+	if (ctx->commFd < 0)
+		return SSCP_ERR_COMM_NOT_OPEN;
+
+	command[commandSz++] = TELNET_IAC;
+	command[commandSz++] = TELNET_SB;
+	command[commandSz++] = TELNET_OPTION_COM_PORT;
+	command[commandSz++] = COM_PORT_SET_BAUDRATE;
+	for (i = 24; i >= 0; i -= 8)
+	{
+		command[commandSz++] = (BYTE)(baudrate >> i);
+		if (command[commandSz - 1] == TELNET_IAC)
+			command[commandSz++] = TELNET_IAC;
+	}
+	command[commandSz++] = TELNET_IAC;
+	command[commandSz++] = TELNET_SE;
+
+	/* 8 data bits, no parity (1), 1 stop bit (1), no flow control (1) */
+	for (i = COM_PORT_SET_DATASIZE; i <= COM_PORT_SET_CONTROL; i++)
+	{
+		command[commandSz++] = TELNET_IAC;
+		command[commandSz++] = TELNET_SB;
+		command[commandSz++] = TELNET_OPTION_COM_PORT;
+		command[commandSz++] = (BYTE)i;
+		command[commandSz++] = (i == COM_PORT_SET_DATASIZE) ? 8 : 1;
+		command[commandSz++] = TELNET_IAC;
+		command[commandSz++] = TELNET_SE;
+	}
+
+	sock->baudrate = baudrate;
+	sock->baudrateAck = 0;
+
+	rc = SSCP_Socket_SendAll(ctx, command, commandSz, NULL);
+	if (rc)
+		return rc;
+
+	/* Data that come meanwhile are not a response to anything */
+	start = SSCP_GetTimeUs();
+	while (sock->baudrateAck == 0)
+	{
+		elapsed = (SSCP_GetTimeUs() - start) / 1000;
+		if (elapsed >= SSCP_RFC2217_TIMEOUT)
+			break;
+		if (SSCP_Socket_RecvOnce(ctx, buffer, sizeof(buffer), SSCP_RFC2217_TIMEOUT - elapsed, &got) == SSCP_ERR_COMM_RECV_FAILED)
+			return SSCP_ERR_COMM_CONTROL_FAILED;
+	}
+
+	if (sock->baudrateAck != baudrate)
+	{
+		if (SSCP_DEBUG_SERIAL)
+			SSCP_Trace("RFC 2217 baud rate %lu, confirmed %lu\n", baudrate, sock->baudrateAck);
+		return SSCP_ERR_COMM_CONTROL_FAILED;
+	}
+
+	return SSCP_SUCCESS;
+}
+
+/**
+ * \brief only a Telnet COM port server has a line to set; whether it takes the rate is known when it confirms it
+ */
+static LONG SSCP_Socket_CheckBaudrate(SSCP_CTX_ST* ctx, DWORD baudrate)
+{
+	SSCP_SOCKET_ST* sock = ctx->transportState;
+
+	(void)baudrate;
+
+	if ((sock == NULL) || !sock->rfc2217)
+		return SSCP_ERR_COMM_CONTROL_FAILED;
+
+	return SSCP_SUCCESS;
+}
+
+static LONG SSCP_Socket_Send(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length)
+{
+	SSCP_SOCKET_ST* sock = ctx->transportState;
+	const BYTE* data = buffer;
+	DWORD dataSz = length;
+	DWORD i;
+	int error = 0;
+	LONG rc;
+
+	if (buffer == NULL)
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	if (sock->rfc2217)
+	{
+		if (length > sizeof(sock->sendBuffer) / 2)
+			return SSCP_ERR_COMMAND_TOO_LONG;
+
+		dataSz = 0;
+		for (i = 0; i < length; i++)
+		{
+			sock->sendBuffer[dataSz++] = buffer[i];
+			if (buffer[i] == TELNET_IAC)
+				sock->sendBuffer[dataSz++] = TELNET_IAC;
+		}
+		data = sock->sendBuffer;
+	}
+
+	if (ctx->commFd >= 0)
+	{
+		rc = SSCP_Socket_SendAll(ctx, data, dataSz, &error);
+		if (rc == SSCP_SUCCESS)
+			return rc;
+		if ((error != EPIPE) && (error != ECONNRESET) && (error != ENOTCONN))
+			return rc;
+	}
+
+	/* The connection has dropped, since the last exchange or right now: once more over a new one, within the time the
+	   response would have had */
+	SSCP_Socket_Disconnect(ctx);
+	rc = SSCP_Socket_Connect(ctx, ctx->firstByteTimeout);
+	if (rc)
+		return SSCP_ERR_COMM_SEND_FAILED;
+	ctx->stats.reconnects++;
+
+	return SSCP_Socket_SendAll(ctx, data, dataSz, NULL);
+}
+
+static LONG SSCP_Socket_Read(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD maxLength, DWORD timeout, DWORD* actLength)
+{
+	DWORD start, elapsed;
+	LONG rc;
+
+	if ((buffer == NULL) || (maxLength == 0) || (actLength == NULL))
+		return SSCP_ERR_INVALID_PARAMETER;
+
+	/* Telnet commands alone don't count as data, wait for the rest of the timeout */
+	start = SSCP_GetTimeUs();
+	for (;;)
+	{
+		rc = SSCP_Socket_RecvOnce(ctx, buffer, maxLength, timeout, actLength);
+		if (rc || (*actLength > 0))
+			return rc;
+
+		elapsed = (SSCP_GetTimeUs() - start) / 1000;
+		if (elapsed >= timeout)
+			return SSCP_ERR_COMM_RECV_MUTE;
+		timeout -= elapsed;
+		start += elapsed * 1000;
+	}
+}
+
+static LONG SSCP_Socket_Flush(SSCP_CTX_ST* ctx)
+{
+	BYTE buffer[256];
+	DWORD got;
+
+	/* Through the Telnet parser, so that negotiations are still answered */
+	while ((ctx->commFd >= 0) && (SSCP_Socket_RecvOnce(ctx, buffer, sizeof(buffer), 0, &got) == SSCP_SUCCESS))
+		;
+
+	return SSCP_SUCCESS;
+}
+
+static int SSCP_Socket_PollFd(SSCP_CTX_ST* ctx)
+{
+	return ctx->commFd;
+}
+
+const SSCP_TRANSPORT_ST SSCP_TRANSPORT_SOCKET = {
+	SSCP_Socket_Open,
+	SSCP_Socket_Close,
+	SSCP_Socket_Configure,
+	SSCP_Socket_Send,
+	SSCP_Socket_Read,
+	SSCP_Socket_Flush,
+	SSCP_Socket_PollFd,
+	SSCP_Socket_CheckBaudrate,
+	NULL
+};
+
+#endif
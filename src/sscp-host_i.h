@@ -4,15 +4,118 @@
 #include <sscp-host.h>
 #include <sscp-consts.h>
 
+#ifndef SSCP_WITH_OPENSSL
+#define SSCP_WITH_OPENSSL 0
+#endif
+#ifndef SSCP_CRYPTO_PROVIDER_DEFAULT
+#define SSCP_CRYPTO_PROVIDER_DEFAULT SSCP_CRYPTO_PROVIDER_BUILTIN
+#endif
+
+#include "sscp-host-crypto_i.h"
+
+/* SSCP frame is SOF + length (2) + address + protocol, payload, CRC (2) */
+#define SSCP_FRAME_HEADER_SIZE 5
+#define SSCP_FRAME_CRC_SIZE 2
+/* Largest payload of an SSCP frame */
+#define SSCP_MAX_PAYLOAD_SIZE 4096
+/* Largest secure command: counter + type + code + length + data + HMAC + padding + IV */
+#define SSCP_MAX_COMMAND_SIZE (4 + 1 + 2 + 2 + SSCP_MAX_PAYLOAD_SIZE + 32 + 16 + 16)
+/* Counter, type, code and length, before the data of a secure command */
+#define SSCP_COMMAND_HEADER_SIZE (4 + 1 + 2 + 2)
+/* Largest secure response (the frame's payload) */
+#define SSCP_MAX_RESPONSE_SIZE SSCP_MAX_PAYLOAD_SIZE
+/* Receive ring, must be a power of 2 and hold at least one complete frame */
+#define SSCP_RECV_RING_SIZE 8192
+/* Entries in the per-command timeout table */
+#define SSCP_MAX_COMMAND_TIMEOUTS 16
+
+typedef struct
+{
+	WORD commandCode; /* 0 for a free entry */
+	BOOL userDefined; /* Set by SSCP_SetCommandTimeout, otherwise only used until the response time is known */
+	DWORD firstByteTimeout;
+} SSCP_COMMAND_TIMEOUT_ST;
+
+typedef struct
+{
+	DWORD srtt; /* us */
+	DWORD rttvar; /* us */
+	DWORD samples;
+	BYTE backoff; /* Timeout is doubled after each timeout */
+	BOOL skipNext;
+} SSCP_RTT_ST;
+
+typedef struct
+{
+	BOOL authenticated;
+	BYTE keyNo;
+	BYTE ti[4];				/* Transaction identifier, set by AuthenticateEV2First */
+	WORD cmdCtr;
+	BYTE status;			/* Last status returned by the card */
+	BOOL kxValid;
+	BYTE kxValue[16];
+	AES_CMAC_CTX_ST kx;		/* Key of the last authentication, kept for the next one */
+	AES_CTX_ST sesEnc;		/* SesAuthENCKey */
+	AES_CMAC_CTX_ST sesMac;	/* SesAuthMACKey */
+	BYTE* chainBuffer;		/* Response that spans several frames, allocated on first need */
+} SSCP_DESFIRE_ST;
+
+/*
+ * Transport: how the bytes of the frames reach the reader, chosen by SSCP_Open (see sscp-host-serial.c). read() waits
+ * up to timeout ms for the first byte, then returns whatever is there; pollFd() is -1 if there is nothing to poll.
+ */
+typedef struct
+{
+	LONG (*open)(SSCP_CTX_ST* ctx, const char* commName);
+	LONG (*close)(SSCP_CTX_ST* ctx);
+	LONG (*configure)(SSCP_CTX_ST* ctx, DWORD baudrate);
+	LONG (*send)(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length);
+	LONG (*read)(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD maxLength, DWORD timeout, DWORD* actLength);
+	LONG (*flush)(SSCP_CTX_ST* ctx);	/* Drop what the device has sent and has not been read yet */
+	int (*pollFd)(SSCP_CTX_ST* ctx);
+	LONG (*checkBaudrate)(SSCP_CTX_ST* ctx, DWORD baudrate);	/* Whether configure() would work, NULL if there is no line to set */
+	LONG (*setRS485)(SSCP_CTX_ST* ctx, DWORD rs485Flags, DWORD delayBeforeSendMs, DWORD delayAfterSendMs);	/* NULL if the driver cannot do it */
+} SSCP_TRANSPORT_ST;
+
 struct _SSCP_CTX_ST
 {
+	/* Transport of the link, NULL when closed */
+	const SSCP_TRANSPORT_ST* transport;
+	void* transportState;	/* Transport's own state */
+	SSCP_LOOPBACK_PEER_FN loopbackPeer;
+	void* loopbackParam;
+
 #ifdef _WIN32
 	HANDLE commHandle;
+	DWORD readTimeout;
 #else
 	int commFd;
+#endif
+	DWORD commFlags;
+	DWORD baudrate;		/* Of the last successful SSCP_SerialConfigure */
 	DWORD firstByteTimeout;
 	DWORD interByteTimeout;
-#endif
+
+	/* First-byte timeout of each command, see SSCP_SetCommandTimeout */
+	SSCP_COMMAND_TIMEOUT_ST commandTimeouts[SSCP_MAX_COMMAND_TIMEOUTS];
+
+	/* Response time estimates, see sscp-host-rtt.c */
+	SSCP_RTT_ST rtt[SSCP_RTT_CLASS_COUNT];
+	SSCP_RTT_ST rttGap;
+	DWORD timeoutFloor;
+	DWORD timeoutCeiling;
+	DWORD recvFirstUs; /* When the first byte of the frame has been read, 0 if it was already in the ring */
+	DWORD recvLastUs;
+	DWORD recvMaxGapUs;
+	DWORD recvReads;
+
+	/* Receive ring, see sscp-host-serial.c */
+	BYTE* recvRing;
+	DWORD recvHead;
+	DWORD recvTail;
+	WORD recvCrc;	/* CRC of the frame at the tail, so far: of the recvCrcSz bytes after its SOF */
+	DWORD recvCrcSz;
+
 	BYTE address;
 	DWORD counter;
 	BYTE sessionKeyCipherAB[16];
@@ -20,6 +123,30 @@ struct _SSCP_CTX_ST
 	BYTE sessionKeySignAB[16];
 	BYTE sessionKeySignBA[16];
 
+	/* Session keys, ready to use (prepared once by the crypto provider, after SSCP_ComputeSessionKeys) */
+	const SSCP_CRYPTO_PROVIDER_ST* crypto;
+	BOOL cryptoOpen;
+	void* cryptoSession;	/* Provider's own state */
+	AES_CTX_ST sessionCipherAB;
+	AES_CTX_ST sessionDecipherBA;
+	HMAC_SHA256_CTX_ST sessionSignAB;
+	HMAC_SHA256_CTX_ST sessionSignBA;
+
+	/* Source of the IVs and of rndA (seeded on first use) */
+	SSCP_DRBG_ST drbg;
+
+	/* DESFire session with the card in the field, see sscp-host-desfire.c */
+	SSCP_DESFIRE_ST desfire;
+
+	/* Exchange buffers, allocated once by SSCP_Alloc */
+	BYTE* frameBuffer;		/* Header + command + CRC, sent at once */
+	DWORD frameBufferSz;
+	DWORD echoSz;			/* Frame of frameBuffer the adapter echoes (SSCP_COMM_FLAG_ECHO), 0 if none */
+	BYTE* commandBuffer;	/* Within frameBuffer, after the room for the header */
+	DWORD commandBufferSz;
+	BYTE* responseBuffer;
+	DWORD responseBufferSz;
+
 	BOOL guardRunning;
 #ifdef _WIN32	
 	LARGE_INTEGER guardFreq;
@@ -37,12 +164,23 @@ struct _SSCP_CTX_ST
 		DWORD errorCount;
 		DWORD bytesSent;
 		DWORD bytesReceived;
+		DWORD trackedAllocations;
+		DWORD framesSent;
+		DWORD writeCalls;
+		DWORD framesReceived;
+		DWORD readCalls;
+		DWORD bytesDropped;
+		DWORD framesDropped;
+		DWORD reconnects;
+		DWORD echoesDropped;
 	} stats;
 };
 
-LONG SSCP_ExchangeRaw(SSCP_CTX_ST* ctx, BYTE address, BYTE protocol, const BYTE command[], DWORD commandSz, BYTE response[], DWORD maxResponseSz, DWORD* actResponseSz);
+LONG SSCP_SendFrame(SSCP_CTX_ST* ctx, BYTE address, BYTE protocol, const BYTE command[], DWORD commandSz);
+LONG SSCP_ExchangeRaw(SSCP_CTX_ST* ctx, BYTE address, BYTE protocol, WORD commandCode, const BYTE command[], DWORD commandSz, BYTE response[], DWORD maxResponseSz, DWORD expectedResponseSz, DWORD* actResponseSz);
 
 LONG SSCP_Exchange(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE commandData[], DWORD commandDataSz, BYTE responseData[], DWORD maxResponseDataSz, DWORD* actResponseDataSz);
+LONG SSCP_Exchange_View(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE commandData[], DWORD commandDataSz, const BYTE** responseView, DWORD* responseViewSz);
 LONG SSCP_Exchange_NoDataIn(SSCP_CTX_ST* ctx, DWORD commandHeader, BYTE responseData[], DWORD maxResponseDataSz, DWORD* actResponseDataSz);
 LONG SSCP_Exchange_NoDataOut(SSCP_CTX_ST* ctx, DWORD commandHeader, const BYTE commandData[], DWORD commandDataSz);
 LONG SSCP_Exchange_NoDataInOut(SSCP_CTX_ST* ctx, DWORD commandHeader);
@@ -53,23 +191,85 @@ BOOL SSCP_HMAC(const BYTE keyValue[16], const BYTE buffer[], DWORD length, BYTE
 BOOL SSCP_Cipher(const BYTE keyValue[16], const BYTE initVector[16], BYTE buffer[], DWORD length);
 BOOL SSCP_Decipher(const BYTE keyValue[16], const BYTE initVector[16], BYTE buffer[], DWORD length);
 BOOL SSCP_ComputeSessionKeys(SSCP_CTX_ST* ctx, const BYTE authKeyValue[16], const BYTE rndA[16], const BYTE rndB[16]);
+BOOL SSCP_ComputeSessionKeys_Ctx(SSCP_CTX_ST* ctx, AES_CTX_ST* kp_ctx, const BYTE rndA[16], const BYTE rndB[16]);
+BOOL SSCP_AuthKeyHMAC(SSCP_CTX_ST* ctx, const SSCP_AUTH_KEY_ST* authKey, const BYTE buffer[], DWORD length, BYTE hmac[32]);
+SSCP_AUTH_KEY_ST* SSCP_KeyStoreGet(SSCP_KEYSTORE_ST* store, DWORD keyHandle);
+
+BYTE* SSCP_CommandDataBuffer(SSCP_CTX_ST* ctx);
+
+void SSCP_DESFireReset(SSCP_CTX_ST* ctx);
+void SSCP_DESFireFree(SSCP_CTX_ST* ctx);
+void SSCP_DESFireSessionKeys(AES_CMAC_CTX_ST* kx, const BYTE rndA[16], const BYTE rndB[16], BYTE encKey[16], BYTE macKey[16]);
+
+DWORD SSCP_GetCommandTimeout(SSCP_CTX_ST* ctx, WORD commandCode);
+
+DWORD SSCP_GetCommandClass(WORD commandCode);
+void SSCP_RttInit(SSCP_CTX_ST* ctx);
+DWORD SSCP_RttFirstByteTimeout(SSCP_CTX_ST* ctx, DWORD commandClass, DWORD initial);
+DWORD SSCP_RttInterByteTimeout(SSCP_CTX_ST* ctx);
+void SSCP_RttSample(SSCP_CTX_ST* ctx, DWORD commandClass, DWORD sentUs, LONG rc);
+DWORD SSCP_LineTime(DWORD baudrate, DWORD bytes);
 
 void SSCP_GuardTime(SSCP_CTX_ST* ctx, DWORD guardTimeMs);
 void SSCP_InitGuardTime(SSCP_CTX_ST* ctx, DWORD guardTimeMs);
 void SSCP_WaitGuardTime(SSCP_CTX_ST* ctx);
+DWORD SSCP_GetTimeUs(void);
 
 LONG SSCP_SerialOpen(SSCP_CTX_ST* ctx, const char* commName);
 LONG SSCP_SerialClose(SSCP_CTX_ST* ctx);
 LONG SSCP_SerialConfigure(SSCP_CTX_ST* ctx, DWORD baudrate);
+LONG SSCP_SerialCheckBaudrate(SSCP_CTX_ST* ctx, DWORD baudrate);
+LONG SSCP_SerialSetRS485(SSCP_CTX_ST* ctx, DWORD rs485Flags, DWORD delayBeforeSendMs, DWORD delayAfterSendMs);
 LONG SSCP_SerialSetTimeouts(SSCP_CTX_ST* ctx, DWORD first_byte, DWORD inter_byte);
 LONG SSCP_SerialSend(SSCP_CTX_ST* ctx, const BYTE buffer[], DWORD length);
+LONG SSCP_SerialRead(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD maxLength, DWORD timeout, DWORD* actLength);
 LONG SSCP_SerialRecv(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD length);
+LONG SSCP_SerialRecvFrame(SSCP_CTX_ST* ctx, BYTE header[SSCP_FRAME_HEADER_SIZE], BYTE payload[], DWORD maxPayloadSz, DWORD* actPayloadSz);
+void SSCP_SerialPurge(SSCP_CTX_ST* ctx);
+LONG SSCP_SerialFlush(SSCP_CTX_ST* ctx);
+
+extern const SSCP_TRANSPORT_ST SSCP_TRANSPORT_SERIAL;
+extern const SSCP_TRANSPORT_ST SSCP_TRANSPORT_LOOPBACK;
+#ifndef _WIN32
+extern const SSCP_TRANSPORT_ST SSCP_TRANSPORT_SOCKET;
+#endif
 
 BOOL SSCP_GetRandom(BYTE buffer[], DWORD bufferSz);
 
+WORD SSCP_CRC16_Init(void);
+WORD SSCP_CRC16_Update(WORD crc, const BYTE data[], DWORD length);
+void SSCP_CRC16_Final(WORD crc, BYTE pcrc[2]);
+
+#define SSCP_CRC16_BACKEND_AUTO  0
+#define SSCP_CRC16_BACKEND_TABLE 1
+#define SSCP_CRC16_BACKEND_CLMUL 2
+BOOL SSCP_CRC16_SetBackend(DWORD backend);
+
+/* Below this length, folding with carry-less multiply is not worth it */
+#define SSCP_CRC16_CLMUL_THRESHOLD 64
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SSCP_HAVE_X86_INTRINSICS 1
+#else
+#define SSCP_HAVE_X86_INTRINSICS 0
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SSCP_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SSCP_TARGET(isa)
+#endif
+
+#define SSCP_CPU_SSSE3  0x00000001
+#define SSCP_CPU_PCLMUL 0x00000002
+#define SSCP_CPU_AESNI  0x00000004
+#define SSCP_CPU_SSE41  0x00000008
+#define SSCP_CPU_SHA    0x00000010
+#define SSCP_CPU_AVX2   0x00000020
+DWORD SSCP_GetCpuFeatures(void);
+
 #define SSCP_Trace printf
 
-#include "sscp-host-crypto_i.h"
 #include "sscp-host-serial_i.h"
 
 #endif
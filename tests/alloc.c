@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "fixture.h"
+
+/*
+ * Steady-state allocations
+ * ------------------------
+ *
+ * sscp-host-alloc-tests is linked with --wrap for malloc, calloc, realloc and free, so every heap call the library
+ * makes goes through the counter below. Once a context is open and authenticated, the exchanges must not make any.
+ * The reader at the other end of the loop is not counted, only the host.
+ */
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+static BOOL counting;
+static DWORD heapCalls;
+
+void* __wrap_malloc(size_t size)
+{
+	if (counting)
+		heapCalls++;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+	if (counting)
+		heapCalls++;
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	if (counting)
+		heapCalls++;
+	return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr)
+{
+	if (counting)
+		heapCalls++;
+	__real_free(ptr);
+}
+
+/* The reader, with the counter paused while it works */
+static DWORD uncountedReader(void* param, const BYTE data[], DWORD dataSz, BYTE response[], DWORD maxResponseSz)
+{
+	BOOL wasCounting = counting;
+	DWORD n;
+
+	counting = FALSE;
+	n = loopbackReader(param, data, dataSz, response, maxResponseSz);
+	counting = wasCounting;
+	return n;
+}
+
+/* A card that answers every C-APDU with 90 00 */
+static DWORD successCard(void* param, const BYTE capdu[], DWORD capduSz, BYTE rapdu[])
+{
+	(void)param;
+	(void)capdu;
+	(void)capduSz;
+
+	rapdu[0] = 0x90;
+	rapdu[1] = 0x00;
+	return 2;
+}
+
+/* Exchanges of every kind: secure command, card scan, short and long APDU; the number of failures */
+static int exchanges(SSCP_CTX_ST* ctx, DWORD loops)
+{
+	static BYTE apdu[SSCP_MAX_PAYLOAD_SIZE - 16];
+	BYTE infos[16], uid[16], ats[32], rapdu[16];
+	BYTE uidSz, atsSz;
+	DWORD infosSz, rapduSz, i;
+	WORD protocol;
+	int failures = 0;
+
+	for (i = 0; i < loops; i++)
+	{
+		if (SSCP_Exchange(ctx, SSCP_CMD_GET_INFOS, NULL, 0, infos, sizeof(infos), &infosSz))
+			failures++;
+		if (SSCP_TransceiveNFC(ctx, apdu, 5, rapdu, sizeof(rapdu), &rapduSz) || (rapduSz != 2))
+			failures++;
+		if (SSCP_TransceiveNFC(ctx, apdu, sizeof(apdu), rapdu, sizeof(rapdu), &rapduSz) || (rapduSz != 2))
+			failures++;
+	}
+
+	/* SCAN_GLOBAL has a guard time of its own, a few are enough */
+	for (i = 0; i < 2; i++)
+	{
+		if (SSCP_ScanNFC(ctx, &protocol, uid, sizeof(uid), &uidSz, ats, sizeof(ats), &atsSz) || (protocol != 0x0001) || (uidSz != 7))
+			failures++;
+	}
+
+	return failures;
+}
+
+int main(void)
+{
+	static LOOPBACK_READER_ST reader;
+	SSCP_CTX_ST* ctx;
+	int errors = 0;
+
+	/* The counter must see the library, or the rest proves nothing */
+	counting = TRUE;
+	ctx = SSCP_Alloc();
+	SSCP_Free(ctx);
+	counting = FALSE;
+	if ((ctx == NULL) || (heapCalls == 0))
+	{
+		printf("alloc: heap calls of the library not seen, --wrap is not in effect\n");
+		return 1;
+	}
+
+	reader.card = successCard;
+	ctx = openLoopbackReader(&reader);
+	if (ctx == NULL)
+	{
+		printf("alloc: authentication failed\n");
+		return 1;
+	}
+	SSCP_SetLoopbackPeer(ctx, uncountedReader, &reader);
+
+	/* Whatever is made on first use */
+	if (exchanges(ctx, 1))
+	{
+		printf("alloc: exchanges failed\n");
+		errors++;
+	}
+
+	heapCalls = 0;
+	counting = TRUE;
+	if (exchanges(ctx, 100))
+		errors++;
+	counting = FALSE;
+
+	if (heapCalls != 0)
+	{
+		printf("alloc: %lu heap calls in steady state\n", (unsigned long)heapCalls);
+		errors++;
+	}
+
+	SSCP_Free(ctx);
+	SSCP_Free(reader.keys);
+
+	printf("Steady-state allocations check %s\n", errors ? "failed" : "OK");
+	return errors;
+}
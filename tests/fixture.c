@@ -0,0 +1,262 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "fixture.h"
+
+void referenceCRC16(const BYTE data[], DWORD length, BYTE pcrc[2])
+{
+	WORD crc = 0xFFFF;
+	DWORD i;
+	int j;
+
+	for (i = 0; i < length; i++)
+	{
+		crc ^= (WORD)data[i] << 8;
+		for (j = 0; j < 8; j++)
+			crc = (crc & 0x8000) ? (WORD)((crc << 1) ^ 0x1021) : (WORD)(crc << 1);
+	}
+
+	pcrc[0] = (BYTE)(crc >> 8);
+	pcrc[1] = (BYTE)(crc);
+}
+
+const FIXTURE_BACKEND_ST CRC16_BACKENDS[2] = {
+	{ SSCP_CRC16_BACKEND_TABLE, "table" },
+	{ SSCP_CRC16_BACKEND_CLMUL, "clmul" }
+};
+
+const BYTE FIXTURE_KEY_C[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+const BYTE FIXTURE_KEY_S[16] = { 0x60, 0x3D, 0xEB, 0x10, 0x15, 0xCA, 0x71, 0xBE, 0x2B, 0x73, 0xAE, 0xF0, 0x85, 0x7D, 0x77, 0x81 };
+const BYTE FIXTURE_IV[16] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F };
+
+const FIXTURE_BACKEND_ST AES_BACKENDS[3] = {
+	{ AES_BACKEND_PORTABLE, "table" },
+	{ AES_BACKEND_AESNI, "aesni" },
+	{ AES_BACKEND_COMPACT, "compact" }
+};
+
+const FIXTURE_BACKEND_ST SHA256_BACKENDS[2] = {
+	{ SHA256_BACKEND_PORTABLE, "c" },
+	{ SHA256_BACKEND_SHANI, "shani" }
+};
+
+/* Counter, opcode, length, data, type, status, HMAC, padding */
+DWORD makeResponse(BYTE response[], DWORD dataSz)
+{
+	DWORD i, sz = 0;
+
+	response[sz++] = 0x00;
+	response[sz++] = 0x00;
+	response[sz++] = 0x01;
+	response[sz++] = 0x02;
+	response[sz++] = 0x00;
+	response[sz++] = 0x5F;
+	response[sz++] = (BYTE)(dataSz >> 8);
+	response[sz++] = (BYTE)(dataSz);
+	for (i = 0; i < dataSz; i++)
+		response[sz++] = (BYTE)rand();
+	response[sz++] = 0x00;
+	response[sz++] = 0x00;
+	for (i = 0; i < 32; i++)
+		response[sz++] = (BYTE)rand();
+	if ((sz % 16) != 0)
+		response[sz++] = 0x80;
+	while ((sz % 16) != 0)
+		response[sz++] = 0x00;
+
+	return sz;
+}
+
+/* A provider works on the keys of a session: give it those of the key-based primitives */
+BOOL openProvider(SSCP_CTX_ST* ctx, DWORD provider)
+{
+	if (SSCP_SetCryptoProvider(ctx, provider) != SSCP_SUCCESS)
+		return FALSE;
+
+	memcpy(ctx->sessionKeyCipherAB, FIXTURE_KEY_C, 16);
+	memcpy(ctx->sessionKeyCipherBA, FIXTURE_KEY_C, 16);
+	memcpy(ctx->sessionKeySignAB, FIXTURE_KEY_S, 16);
+	memcpy(ctx->sessionKeySignBA, FIXTURE_KEY_S, 16);
+	return SSCP_CryptoOpen(ctx);
+}
+
+const char* PROVIDER_NAMES[2] = { "builtin", "openssl" };
+
+const BYTE DIVERSIFY_MASTER[16] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF };
+
+/* Loopback reader */
+
+static const BYTE LOOPBACK_KEY[16] = { 0xE7, 0x4A, 0x54, 0x0F, 0xA0, 0x7C, 0x4D, 0xB1, 0xB4, 0x64, 0x21, 0x12, 0x6D, 0xF7, 0xAD, 0x36 };
+
+/* Rates of SET_BAUDRATE and GET_INFOS, by code */
+static const DWORD LOOPBACK_BAUDRATES[8] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600 };
+
+static DWORD loopbackFrame(BYTE address, BYTE protocol, const BYTE payload[], DWORD payloadSz, BYTE response[])
+{
+	BYTE crc[2];
+
+	response[0] = 0x02;
+	response[1] = (BYTE)(payloadSz >> 8);
+	response[2] = (BYTE)payloadSz;
+	response[3] = address;
+	response[4] = protocol;
+	memmove(&response[5], payload, payloadSz);
+	SSCP_CRC16_Final(SSCP_CRC16_Update(SSCP_CRC16_Init(), &response[1], 4 + payloadSz), crc);
+	memcpy(&response[5 + payloadSz], crc, 2);
+	return 5 + payloadSz + 2;
+}
+
+static DWORD loopbackSecure(LOOPBACK_READER_ST* reader, BYTE address, BYTE p[], DWORD n, BYTE response[])
+{
+	BYTE infos[5] = { 0x02, 0x02, 0x00, 0x13, 0x88 };
+	BYTE* r = reader->response;
+	BYTE iv[16], hmac[32];
+	DWORD counter, dataSz, rl = 0;
+
+	if ((n < 48) || (n % 16))
+		return 0;
+	memcpy(iv, &p[n - 16], 16);
+	n -= 16;
+	SSCP_Decipher(reader->keys->sessionKeyCipherAB, iv, p, n);
+	dataSz = ((DWORD)p[7] << 8) | p[8];
+	SSCP_HMAC(reader->keys->sessionKeySignAB, p, 9 + dataSz, hmac);
+	if ((9 + dataSz + 32 > n) || memcmp(hmac, &p[9 + dataSz], 32))
+		return 0;
+
+	counter = (((DWORD)p[0] << 24) | ((DWORD)p[1] << 16) | ((DWORD)p[2] << 8) | p[3]) + 1;
+	r[rl++] = (BYTE)(counter >> 24);
+	r[rl++] = (BYTE)(counter >> 16);
+	r[rl++] = (BYTE)(counter >> 8);
+	r[rl++] = (BYTE)counter;
+	r[rl++] = p[5];
+	r[rl++] = p[6];
+	if ((((WORD)p[5] << 8) | p[6]) == (SSCP_CMD_GET_INFOS & 0xFFFF))
+	{
+		for (infos[1] = 0; reader->baudrate && (LOOPBACK_BAUDRATES[infos[1]] != reader->baudrate); infos[1]++)
+			;
+		r[rl++] = 0x00;
+		r[rl++] = sizeof(infos);
+		memcpy(&r[rl], infos, sizeof(infos));
+		rl += sizeof(infos);
+	}
+	else if (((((WORD)p[5] << 8) | p[6]) == (SSCP_CMD_SET_BAUDRATE & 0xFFFF)) && reader->baudrate && (dataSz == 1) && (p[9] < 8))
+	{
+		/* The response goes at the previous rate, then the reader switches */
+		if (reader->baudrateResponse == 2)
+			return 0;
+		reader->baudrate = LOOPBACK_BAUDRATES[p[9]];
+		if (reader->baudrateResponse == 1)
+			return 0;
+		r[rl++] = 0x00;
+		r[rl++] = 0x00;
+	}
+	else if (((((WORD)p[5] << 8) | p[6]) == (SSCP_CMD_SCAN_GLOBAL & 0xFFFF)) && (reader->card != NULL))
+	{
+		/* ISO A, ATQA 0344, SAK 20, then the UID */
+		static const BYTE ISOA[13] = { 0x01, 0x01, 0x03, 0x44, 0x20, 0x07, 0x04, 0x5A, 0x1B, 0x2C, 0x3D, 0x4E, 0x80 };
+		r[rl++] = 0x00;
+		r[rl++] = sizeof(ISOA);
+		memcpy(&r[rl], ISOA, sizeof(ISOA));
+		rl += sizeof(ISOA);
+	}
+	else if (((((WORD)p[5] << 8) | p[6]) == (SSCP_CMD_TRANSCEIVE_APDU & 0xFFFF)) && (reader->card != NULL))
+	{
+		/* Status 00 then the R-APDU */
+		DWORD rapduSz = reader->card(reader->cardParam, &p[9], dataSz, &r[rl + 3]);
+		r[rl++] = (BYTE)((rapduSz + 1) >> 8);
+		r[rl++] = (BYTE)(rapduSz + 1);
+		r[rl++] = 0x00;
+		rl += rapduSz;
+	}
+	else
+	{
+		r[rl++] = 0x00;
+		r[rl++] = 0x00;
+	}
+	r[rl++] = p[4]; /* Type */
+	r[rl++] = 0x00; /* Status */
+	SSCP_HMAC(reader->keys->sessionKeySignBA, r, rl, &r[rl]);
+	rl += 32;
+	if (rl % 16)
+	{
+		r[rl++] = 0x80;
+		while (rl % 16)
+			r[rl++] = 0x00;
+	}
+	SSCP_GetRandom(iv, 16);
+	SSCP_Cipher(reader->keys->sessionKeyCipherBA, iv, r, rl);
+	memcpy(&r[rl], iv, 16);
+	rl += 16;
+
+	return loopbackFrame(address, SSCP_PROTOCOL_SECURE, r, rl, response);
+}
+
+DWORD loopbackReader(void* param, const BYTE data[], DWORD dataSz, BYTE response[], DWORD maxResponseSz)
+{
+	LOOPBACK_READER_ST* reader = param;
+	BYTE* p = reader->command;
+	DWORD n;
+
+	/* Garbage at the wrong rate */
+	if (reader->baudrate && (reader->hostBaudrate != reader->baudrate))
+		return 0;
+
+	/* One frame per call, with room for the answer */
+	if ((dataSz < 7) || (dataSz > sizeof(reader->command)) || (maxResponseSz < sizeof(reader->response) + 7))
+		return 0;
+	n = ((DWORD)data[1] << 8) | data[2];
+	if (n + 7 != dataSz)
+		return 0;
+
+	if (data[4] == SSCP_PROTOCOL_AUTHENTICATE)
+	{
+		if (n == 18)
+		{
+			memcpy(reader->rndA, &data[7], 16);
+			SSCP_GetRandom(reader->rndB, 16);
+			memset(p, 0, 8);
+			memcpy(&p[8], reader->rndA, 16);
+			memcpy(&p[24], reader->rndB, 16);
+			SSCP_HMAC(LOOPBACK_KEY, p, 40, &p[40]);
+			return loopbackFrame(data[3], SSCP_PROTOCOL_AUTHENTICATE, p, 72, response);
+		}
+		else
+		{
+			static const BYTE ACK[6] = { 0, 0, 0, 0, 0, 8 };
+			SSCP_ComputeSessionKeys(reader->keys, LOOPBACK_KEY, reader->rndA, reader->rndB);
+			return loopbackFrame(data[3], SSCP_PROTOCOL_AUTHENTICATE, ACK, sizeof(ACK), response);
+		}
+	}
+
+	memcpy(p, &data[5], n);
+	return loopbackSecure(reader, data[3], p, n, response);
+}
+
+SSCP_CTX_ST* openLoopbackReader(LOOPBACK_READER_ST* reader)
+{
+	SSCP_CTX_ST* ctx = SSCP_Alloc();
+
+	if (reader->keys == NULL)
+		reader->keys = SSCP_Alloc();
+	if ((ctx == NULL) || (reader->keys == NULL))
+	{
+		SSCP_Free(ctx);
+		return NULL;
+	}
+
+	SSCP_SetLoopbackPeer(ctx, loopbackReader, reader);
+	if (SSCP_Open(ctx, "loop:", 38400, 0) || SSCP_Authenticate(ctx, LOOPBACK_KEY))
+	{
+		SSCP_Free(ctx);
+		return NULL;
+	}
+
+	return ctx;
+}
+
+SSCP_CTX_ST* openLoopback(void)
+{
+	static LOOPBACK_READER_ST loopbackState;
+
+	return openLoopbackReader(&loopbackState);
+}
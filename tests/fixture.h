@@ -0,0 +1,70 @@
+#ifndef __SSCP_HOST_FIXTURE_H__
+#define __SSCP_HOST_FIXTURE_H__
+
+/*
+ * What the tests and sscp-bench-crypto share: keys, the backends compiled in, and a reader at the other end of a
+ * "loop:" link. Both work on the internal primitives of the library.
+ */
+#include "sscp-host_i.h"
+
+typedef struct
+{
+	DWORD backend;
+	const char* name;
+} FIXTURE_BACKEND_ST;
+
+extern const FIXTURE_BACKEND_ST CRC16_BACKENDS[2];
+extern const FIXTURE_BACKEND_ST AES_BACKENDS[3];
+extern const FIXTURE_BACKEND_ST SHA256_BACKENDS[2];
+extern const char* PROVIDER_NAMES[2];
+
+extern const BYTE FIXTURE_KEY_C[16];
+extern const BYTE FIXTURE_KEY_S[16];
+extern const BYTE FIXTURE_IV[16];
+extern const BYTE DIVERSIFY_MASTER[16];
+
+/* Readers of a polling sweep */
+#define BATCH_MESSAGES 256
+
+/** \brief the original bit-serial CRC16, used as reference */
+void referenceCRC16(const BYTE data[], DWORD length, BYTE pcrc[2]);
+
+/** \brief a plausible deciphered response with dataSz bytes of data, padded; returns its size */
+DWORD makeResponse(BYTE response[], DWORD dataSz);
+
+/** \brief set the provider of ctx, with FIXTURE_KEY_C and FIXTURE_KEY_S as session keys */
+BOOL openProvider(SSCP_CTX_ST* ctx, DWORD provider);
+
+/*
+ * Loopback reader
+ * ---------------
+ *
+ * The peer of a "loop:" link plays an SSCP reader: mutual authentication, then secure commands, GET_INFOS answered,
+ * SCAN_GLOBAL and TRANSCEIVE_APDU answered by the card if there is one, and everything else acknowledged. The whole
+ * stack runs (framing, CRC, ring, crypto) without a serial port.
+ */
+
+typedef struct
+{
+	SSCP_CTX_ST* keys; /* Session keys of the reader, derived as the host does */
+	BYTE rndA[16];
+	BYTE rndB[16];
+	BYTE command[SSCP_MAX_COMMAND_SIZE];
+	BYTE response[SSCP_MAX_COMMAND_SIZE];
+	DWORD (*card)(void* param, const BYTE capdu[], DWORD capduSz, BYTE rapdu[]); /* Card in the field, or NULL */
+	void* cardParam;
+	DWORD baudrate;		/* 0 if there is no line, otherwise nothing gets through unless the host is at this rate */
+	DWORD hostBaudrate;
+	BYTE baudrateResponse;	/* SET_BAUDRATE: 0 answered, 1 obeyed but not answered, 2 neither */
+} LOOPBACK_READER_ST;
+
+/** \brief the peer function of a loopback reader, param is its LOOPBACK_READER_ST */
+DWORD loopbackReader(void* param, const BYTE data[], DWORD dataSz, BYTE response[], DWORD maxResponseSz);
+
+/** \brief a context authenticated with its own reader */
+SSCP_CTX_ST* openLoopbackReader(LOOPBACK_READER_ST* reader);
+
+/** \brief a context authenticated with a reader of its own, shared by every caller */
+SSCP_CTX_ST* openLoopback(void);
+
+#endif
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "tests.h"
+
+static const struct
+{
+	const char* name;
+	int (*check)(void);
+} CHECKS[] = {
+	{ "CRC16 equivalence", checkCRC16 },
+	{ "AES known-answer", checkAES },
+	{ "AES multi-block", checkAESBlocks },
+	{ "SHA-256 known-answer", checkSHA256 },
+	{ "HMAC batch", checkHMACBatch },
+	{ "Crypto provider equivalence", checkProviders },
+	{ "DRBG", checkDRBG },
+	{ "Key store", checkKeyStore },
+	{ "DESFire EV2 crypto", checkDESFire },
+	{ "Loopback exchange", checkLoopback },
+	{ "Loopback batch", checkLoopbackBatch },
+	{ "Baud rate change", checkBaudrate },
+	{ "Reader discovery", checkDiscover },
+	{ "DESFire loopback card", checkDESFireCard },
+#ifndef _WIN32
+	{ "Line time", checkLineTime },
+	{ "RFC 2217 socket", checkSocket },
+#endif
+	{ "Cross-backend equivalence", checkSuiteBackends }
+};
+
+/*
+ * sscp-host-tests [<name>...]
+ *
+ * Runs every check, or those whose name is given; the exit code is the number of checks that failed.
+ */
+int main(int argc, char** argv)
+{
+	DWORD i;
+	int a, failed = 0;
+
+	for (i = 0; i < sizeof(CHECKS) / sizeof(CHECKS[0]); i++)
+	{
+		if (argc > 1)
+		{
+			for (a = 1; (a < argc) && strcmp(argv[a], CHECKS[i].name); a++)
+				;
+			if (a == argc)
+				continue;
+		}
+
+		if (CHECKS[i].check())
+		{
+			printf("%s check failed\n", CHECKS[i].name);
+			failed++;
+		}
+		else
+		{
+			printf("%s check OK\n", CHECKS[i].name);
+		}
+	}
+
+	return failed;
+}
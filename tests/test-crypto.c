@@ -0,0 +1,702 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tests.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+int checkCRC16(void)
+{
+	static BYTE data[SSCP_MAX_PAYLOAD_SIZE + 5];
+	DWORD b, i, length;
+	int errors = 0;
+
+	srand(0x5CC9);
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (BYTE)rand();
+
+	for (b = 0; b < sizeof(CRC16_BACKENDS) / sizeof(CRC16_BACKENDS[0]); b++)
+	{
+		if (!SSCP_CRC16_SetBackend(CRC16_BACKENDS[b].backend))
+		{
+			printf("crc16 %-6s not available on this CPU\n", CRC16_BACKENDS[b].name);
+			continue;
+		}
+
+		for (length = 0; length <= sizeof(data); length += (length < 300) ? 1 : 97)
+		{
+			BYTE expected[2], computed[2];
+			DWORD split = length / 3;
+			WORD crc;
+
+			referenceCRC16(data, length, expected);
+
+			/* In one call */
+			crc = SSCP_CRC16_Update(SSCP_CRC16_Init(), data, length);
+			SSCP_CRC16_Final(crc, computed);
+			if (memcmp(expected, computed, 2))
+			{
+				printf("crc16 %s mismatch for length %lu\n", CRC16_BACKENDS[b].name, (unsigned long)length);
+				errors++;
+			}
+
+			/* Incrementally, as the receive path does */
+			crc = SSCP_CRC16_Init();
+			crc = SSCP_CRC16_Update(crc, data, split);
+			crc = SSCP_CRC16_Update(crc, &data[split], length - split);
+			SSCP_CRC16_Final(crc, computed);
+			if (memcmp(expected, computed, 2))
+			{
+				printf("crc16 %s mismatch for length %lu split at %lu\n", CRC16_BACKENDS[b].name, (unsigned long)length, (unsigned long)split);
+				errors++;
+			}
+		}
+	}
+
+	SSCP_CRC16_SetBackend(SSCP_CRC16_BACKEND_AUTO);
+	return errors;
+}
+
+/* FIPS-197 appendix C */
+static const struct
+{
+	DWORD keyBits;
+	BYTE key[32];
+	BYTE plain[16];
+	BYTE cipher[16];
+} AES_VECTORS[] = {
+	{
+		128,
+		{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F },
+		{ 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF },
+		{ 0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B, 0x04, 0x30, 0xD8, 0xCD, 0xB7, 0x80, 0x70, 0xB4, 0xC5, 0x5A }
+	},
+	{
+		192,
+		{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+		  0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17 },
+		{ 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF },
+		{ 0xDD, 0xA9, 0x7C, 0xA4, 0x86, 0x4C, 0xDF, 0xE0, 0x6E, 0xAF, 0x70, 0xA0, 0xEC, 0x0D, 0x71, 0x91 }
+	},
+	{
+		256,
+		{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+		  0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F },
+		{ 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF },
+		{ 0x8E, 0xA2, 0xB7, 0xCA, 0x51, 0x67, 0x45, 0xBF, 0xEA, 0xFC, 0x49, 0x90, 0x4B, 0x49, 0x60, 0x89 }
+	}
+};
+
+int checkAES(void)
+{
+	AES_CTX_ST ctx, encryptOnly, reference;
+	BYTE key[16], block[16], expected[16];
+	DWORD b, v, i;
+	int errors = 0;
+
+	for (b = 0; b < sizeof(AES_BACKENDS) / sizeof(AES_BACKENDS[0]); b++)
+	{
+		if (!AES_SetBackend(AES_BACKENDS[b].backend))
+		{
+			printf("aes %-7s not available on this CPU\n", AES_BACKENDS[b].name);
+			continue;
+		}
+
+		for (v = 0; v < sizeof(AES_VECTORS) / sizeof(AES_VECTORS[0]); v++)
+		{
+			AES_InitEx(&ctx, AES_VECTORS[v].key, AES_VECTORS[v].keyBits);
+			AES_Encrypt2(&ctx, block, AES_VECTORS[v].plain);
+			if (memcmp(block, AES_VECTORS[v].cipher, 16))
+			{
+				printf("aes %s encrypt mismatch for AES-%lu\n", AES_BACKENDS[b].name, (unsigned long)AES_VECTORS[v].keyBits);
+				errors++;
+			}
+			AES_Decrypt(&ctx, block);
+			if (memcmp(block, AES_VECTORS[v].plain, 16))
+			{
+				printf("aes %s decrypt mismatch for AES-%lu\n", AES_BACKENDS[b].name, (unsigned long)AES_VECTORS[v].keyBits);
+				errors++;
+			}
+		}
+
+		/* Random keys and blocks, against the portable code */
+		srand(0xAE5);
+		for (v = 0; v < 1000; v++)
+		{
+			for (i = 0; i < 16; i++)
+			{
+				key[i] = (BYTE)rand();
+				block[i] = (BYTE)rand();
+			}
+
+			AES_SetBackend(AES_BACKEND_PORTABLE);
+			AES_Init(&reference, key);
+			AES_SetBackend(AES_BACKENDS[b].backend);
+			AES_Init(&ctx, key);
+			AES_InitEncrypt(&encryptOnly, key);
+
+			AES_Encrypt2(&reference, expected, block);
+			AES_Encrypt(&ctx, block);
+			if (memcmp(block, expected, 16))
+			{
+				printf("aes %s encrypt differs from the portable code\n", AES_BACKENDS[b].name);
+				errors++;
+				break;
+			}
+			AES_Encrypt2(&encryptOnly, expected, block);
+			AES_Encrypt2(&reference, block, block);
+			if (memcmp(block, expected, 16))
+			{
+				printf("aes %s encrypt-only context differs from the portable code\n", AES_BACKENDS[b].name);
+				errors++;
+				break;
+			}
+			AES_Decrypt(&ctx, block);
+			AES_Decrypt(&reference, expected);
+			if (memcmp(block, expected, 16))
+			{
+				printf("aes %s decrypt differs from the portable code\n", AES_BACKENDS[b].name);
+				errors++;
+				break;
+			}
+		}
+	}
+
+	AES_SetBackend(AES_BACKEND_AUTO);
+	return errors;
+}
+
+int checkAESBlocks(void)
+{
+	static BYTE plain[16 * 40], work[16 * 40], expected[16 * 40];
+	BYTE iv[16], carry[16];
+	AES_CTX_ST ctx;
+	DWORD b, blocks, split, i, j;
+	int errors = 0;
+
+	srand(0xCBC);
+	for (i = 0; i < sizeof(plain); i++)
+		plain[i] = (BYTE)rand();
+	for (i = 0; i < 16; i++)
+		iv[i] = (BYTE)rand();
+
+	for (b = 0; b < sizeof(AES_BACKENDS) / sizeof(AES_BACKENDS[0]); b++)
+	{
+		if (!AES_SetBackend(AES_BACKENDS[b].backend))
+			continue;
+		AES_Init(&ctx, FIXTURE_KEY_C);
+
+		for (blocks = 0; blocks <= 40; blocks++)
+		{
+			/* ECB against one block at a time */
+			memcpy(expected, plain, 16 * blocks);
+			for (i = 0; i < blocks; i++)
+				AES_Encrypt(&ctx, &expected[16 * i]);
+			memcpy(work, plain, 16 * blocks);
+			AES_EncryptBlocks(&ctx, work, blocks);
+			if (memcmp(work, expected, 16 * blocks))
+			{
+				printf("aes %s EncryptBlocks mismatch for %lu blocks\n", AES_BACKENDS[b].name, (unsigned long)blocks);
+				errors++;
+			}
+			AES_DecryptBlocks(&ctx, work, blocks);
+			if (memcmp(work, plain, 16 * blocks))
+			{
+				printf("aes %s DecryptBlocks mismatch for %lu blocks\n", AES_BACKENDS[b].name, (unsigned long)blocks);
+				errors++;
+			}
+
+			/* CBC against the textbook construction, in two calls to check the IV is carried over */
+			memcpy(carry, iv, 16);
+			for (i = 0; i < blocks; i++)
+			{
+				for (j = 0; j < 16; j++)
+					expected[16 * i + j] = plain[16 * i + j] ^ carry[j];
+				AES_Encrypt(&ctx, &expected[16 * i]);
+				memcpy(carry, &expected[16 * i], 16);
+			}
+
+			split = blocks / 3;
+			memcpy(work, plain, 16 * blocks);
+			memcpy(carry, iv, 16);
+			AES_EncryptCBC(&ctx, carry, work, split);
+			AES_EncryptCBC(&ctx, carry, &work[16 * split], blocks - split);
+			if (memcmp(work, expected, 16 * blocks))
+			{
+				printf("aes %s EncryptCBC mismatch for %lu blocks\n", AES_BACKENDS[b].name, (unsigned long)blocks);
+				errors++;
+			}
+
+			memcpy(carry, iv, 16);
+			AES_DecryptCBC(&ctx, carry, work, split);
+			AES_DecryptCBC(&ctx, carry, &work[16 * split], blocks - split);
+			if (memcmp(work, plain, 16 * blocks) || (blocks && memcmp(carry, &expected[16 * (blocks - 1)], 16)))
+			{
+				printf("aes %s DecryptCBC mismatch for %lu blocks\n", AES_BACKENDS[b].name, (unsigned long)blocks);
+				errors++;
+			}
+		}
+	}
+
+	AES_SetBackend(AES_BACKEND_AUTO);
+	return errors;
+}
+
+/* FIPS 180-2 appendix B */
+static const struct
+{
+	const char* message;
+	DWORD repeat;
+	BYTE digest[32];
+} SHA256_VECTORS[] = {
+	{
+		"abc", 1,
+		{ 0xBA, 0x78, 0x16, 0xBF, 0x8F, 0x01, 0xCF, 0xEA, 0x41, 0x41, 0x40, 0xDE, 0x5D, 0xAE, 0x22, 0x23,
+		  0xB0, 0x03, 0x61, 0xA3, 0x96, 0x17, 0x7A, 0x9C, 0xB4, 0x10, 0xFF, 0x61, 0xF2, 0x00, 0x15, 0xAD }
+	},
+	{
+		"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+		{ 0x24, 0x8D, 0x6A, 0x61, 0xD2, 0x06, 0x38, 0xB8, 0xE5, 0xC0, 0x26, 0x93, 0x0C, 0x3E, 0x60, 0x39,
+		  0xA3, 0x3C, 0xE4, 0x59, 0x64, 0xFF, 0x21, 0x67, 0xF6, 0xEC, 0xED, 0xD4, 0x19, 0xDB, 0x06, 0xC1 }
+	},
+	{
+		"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", 10000,
+		{ 0xCD, 0xC7, 0x6E, 0x5C, 0x99, 0x14, 0xFB, 0x92, 0x81, 0xA1, 0xC7, 0xE2, 0x84, 0xD7, 0x3E, 0x67,
+		  0xF1, 0x80, 0x9A, 0x48, 0xA4, 0x97, 0x20, 0x0E, 0x04, 0x6D, 0x39, 0xCC, 0xC7, 0x11, 0x2C, 0xD0 }
+	}
+};
+
+int checkSHA256(void)
+{
+	static BYTE data[1000];
+	SHA256_CTX_ST ctx;
+	BYTE expected[32], computed[32];
+	DWORD b, v, i, length, split;
+	int errors = 0;
+
+	srand(0x5A256);
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (BYTE)rand();
+
+	for (b = 0; b < sizeof(SHA256_BACKENDS) / sizeof(SHA256_BACKENDS[0]); b++)
+	{
+		if (!SHA256_SetBackend(SHA256_BACKENDS[b].backend))
+		{
+			printf("sha256 %-6s not available on this CPU\n", SHA256_BACKENDS[b].name);
+			continue;
+		}
+
+		for (v = 0; v < sizeof(SHA256_VECTORS) / sizeof(SHA256_VECTORS[0]); v++)
+		{
+			SHA256_Init(&ctx);
+			for (i = 0; i < SHA256_VECTORS[v].repeat; i++)
+				SHA256_Update(&ctx, (const BYTE*)SHA256_VECTORS[v].message, strlen(SHA256_VECTORS[v].message));
+			SHA256_Final(&ctx, computed);
+			if (memcmp(computed, SHA256_VECTORS[v].digest, 32))
+			{
+				printf("sha256 %s mismatch for vector %lu\n", SHA256_BACKENDS[b].name, (unsigned long)v);
+				errors++;
+			}
+		}
+
+		/* Random messages, in one call against in two calls with the portable code */
+		for (length = 0; length <= sizeof(data); length += (length < 200) ? 1 : 37)
+		{
+			split = (length * 7) / 11;
+
+			SHA256_SetBackend(SHA256_BACKEND_PORTABLE);
+			SHA256_Init(&ctx);
+			SHA256_Update(&ctx, data, split);
+			SHA256_Update(&ctx, &data[split], length - split);
+			SHA256_Final(&ctx, expected);
+
+			SHA256_SetBackend(SHA256_BACKENDS[b].backend);
+			SHA256_Init(&ctx);
+			SHA256_Update(&ctx, data, length);
+			SHA256_Final(&ctx, computed);
+
+			if (memcmp(computed, expected, 32))
+			{
+				printf("sha256 %s mismatch for length %lu\n", SHA256_BACKENDS[b].name, (unsigned long)length);
+				errors++;
+			}
+		}
+	}
+
+	SHA256_SetBackend(SHA256_BACKEND_AUTO);
+	return errors;
+}
+
+/* Every batch size and a range of lengths, against one message at a time (the lanes only run with the portable SHA-256) */
+int checkHMACBatch(void)
+{
+	static HMAC_SHA256_CTX_ST keys[BATCH_MESSAGES];
+	static HMAC_SHA256_JOB_ST jobs[BATCH_MESSAGES];
+	static BYTE data[BATCH_MESSAGES][300], digests[BATCH_MESSAGES][32];
+	DWORD b, count, i, j;
+	int errors = 0;
+
+	srand(0x5A8);
+	for (i = 0; i < BATCH_MESSAGES; i++)
+	{
+		BYTE key[16];
+
+		for (j = 0; j < sizeof(key); j++)
+			key[j] = (BYTE)rand();
+		HMAC_SHA256_Prepare(&keys[i], key, sizeof(key));
+		for (j = 0; j < sizeof(data[i]); j++)
+			data[i][j] = (BYTE)rand();
+	}
+
+	for (b = 0; b < sizeof(SHA256_BACKENDS) / sizeof(SHA256_BACKENDS[0]); b++)
+	{
+		if (!SHA256_SetBackend(SHA256_BACKENDS[b].backend))
+			continue;
+
+		for (count = 1; count <= 40; count++)
+		{
+			for (i = 0; i < count; i++)
+			{
+				jobs[i].key = &keys[i];
+				jobs[i].data = data[i];
+				jobs[i].length = (count * 7 + i * 13) % sizeof(data[i]); /* Mixed lengths in a batch, 0 included */
+				jobs[i].digest = digests[i];
+			}
+
+			HMAC_SHA256_ComputeBatch(jobs, count);
+
+			for (i = 0; i < count; i++)
+			{
+				BYTE expected[32];
+
+				HMAC_SHA256_Compute(jobs[i].key, jobs[i].data, jobs[i].length, expected);
+				if (memcmp(expected, jobs[i].digest, 32))
+				{
+					printf("hmac batch of %lu (%s): mismatch for message %lu (%lu bytes)\n", (unsigned long)count, SHA256_BACKENDS[b].name, (unsigned long)i, (unsigned long)jobs[i].length);
+					errors++;
+				}
+			}
+		}
+	}
+
+	SHA256_SetBackend(SHA256_BACKEND_AUTO);
+	return errors;
+}
+
+/* What a provider makes of a given session, for one response and one command */
+typedef struct
+{
+	BYTE command[1024];
+	BYTE response[1024];
+	BYTE sign[32];
+	BYTE hmac[32];
+	BYTE oneShot[32];
+} PROVIDER_OUTPUT_ST;
+
+static BOOL runProvider(SSCP_CTX_ST* ctx, const BYTE plain[], DWORD sz, PROVIDER_OUTPUT_ST* out)
+{
+	memcpy(out->command, plain, sz);
+	if (!ctx->crypto->sign(ctx, out->command, sz, out->sign))
+		return FALSE;
+	if (!ctx->crypto->cipher(ctx, FIXTURE_IV, out->command, sz))
+		return FALSE;
+	memcpy(out->response, plain, sz);
+	if (!ctx->crypto->decipher(ctx, FIXTURE_IV, out->response, sz))
+		return FALSE;
+	if (!ctx->crypto->verify(ctx, out->response, SSCP_SignedResponseSz(out->response, sz), out->hmac))
+		return FALSE;
+	if (!ctx->crypto->hmac(FIXTURE_KEY_S, plain, sz, out->oneShot))
+		return FALSE;
+	return TRUE;
+}
+
+/* The same session is handed from one provider to the other; every output must be the same */
+int checkProviders(void)
+{
+	static PROVIDER_OUTPUT_ST reference, output;
+	BYTE plain[1024];
+	SSCP_CTX_ST* ctx;
+	DWORD p, sz;
+	int errors = 0;
+
+	ctx = SSCP_Alloc();
+	if (ctx == NULL)
+		return 1;
+
+	SSCP_SetCryptoProvider(ctx, SSCP_CRYPTO_PROVIDER_BUILTIN);
+	SSCP_ComputeSessionKeys(ctx, FIXTURE_KEY_C, FIXTURE_KEY_S, FIXTURE_IV);
+
+	srand(0xC0DE);
+	sz = makeResponse(plain, 900);
+	if (!runProvider(ctx, plain, sz, &reference))
+		errors++;
+
+	for (p = SSCP_CRYPTO_PROVIDER_OPENSSL; p < sizeof(PROVIDER_NAMES) / sizeof(PROVIDER_NAMES[0]); p++)
+	{
+		if (SSCP_SetCryptoProvider(ctx, p) != SSCP_SUCCESS)
+		{
+			printf("crypto provider %s not available\n", PROVIDER_NAMES[p]);
+			continue;
+		}
+
+		if (!runProvider(ctx, plain, sz, &output) || memcmp(&reference, &output, sizeof(output)))
+		{
+			printf("crypto provider %s does not match builtin\n", PROVIDER_NAMES[p]);
+			errors++;
+		}
+	}
+
+	SSCP_Free(ctx);
+	return errors;
+}
+
+/* No repeated IV over a reseed, and a child process does not get its parent's IVs */
+int checkDRBG(void)
+{
+	static BYTE ivs[2 * SSCP_DRBG_RESEED_INTERVAL / 16][16];
+	static SSCP_DRBG_ST drbg;
+	DWORD i, count = sizeof(ivs) / sizeof(ivs[0]);
+	int errors = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		if (!SSCP_DRBG_Generate(&drbg, ivs[i], 16))
+			return 1;
+		if ((i > 0) && !memcmp(ivs[i], ivs[i - 1], 16))
+			errors++;
+	}
+	/* Only neighbours are compared; a broken counter would show up there */
+	if (errors)
+		printf("DRBG repeated %d IVs\n", errors);
+
+#ifndef _WIN32
+	{
+		BYTE parent[16], child[16];
+		int fds[2];
+		pid_t pid;
+
+		if (pipe(fds) != 0)
+			return errors + 1;
+
+		/* Leave output in the buffer, the child must not serve it */
+		SSCP_DRBG_Generate(&drbg, parent, 16);
+
+		pid = fork();
+		if (pid == 0)
+		{
+			SSCP_DRBG_Generate(&drbg, child, 16);
+			if (write(fds[1], child, 16) != 16)
+				_exit(1);
+			_exit(0);
+		}
+
+		SSCP_DRBG_Generate(&drbg, parent, 16);
+		if ((pid < 0) || (read(fds[0], child, 16) != 16) || !memcmp(parent, child, 16))
+		{
+			printf("DRBG output is the same in parent and child\n");
+			errors++;
+		}
+		if (pid > 0)
+			waitpid(pid, NULL, 0);
+		close(fds[0]);
+		close(fds[1]);
+	}
+#endif
+
+	SSCP_DRBG_Clear(&drbg);
+	return errors;
+}
+
+/* AN10922 example (UID, AID and system identifier as input), and a 31-byte input checked against OpenSSL's AES-CMAC */
+int checkKeyStore(void)
+{
+	static const BYTE AN10922_INPUT[] = { 0x04, 0x78, 0x2E, 0x21, 0x80, 0x1D, 0x80, 0x30, 0x42, 0xF5, 0x4E, 0x58, 0x50, 0x20, 0x41, 0x62, 0x75 };
+	static const BYTE EXPECTED[2][16] = {
+		{ 0xA8, 0xDD, 0x63, 0xA3, 0xB8, 0x9D, 0x54, 0xB3, 0x7C, 0xA8, 0x02, 0x47, 0x3F, 0xDA, 0x91, 0x75 },
+		{ 0x9F, 0x3B, 0x27, 0x75, 0x79, 0xB9, 0x93, 0x84, 0xB2, 0x66, 0xBD, 0x32, 0x2F, 0xC1, 0x25, 0x3D }
+	};
+	static const char* const SERIALS[] = { "SN-0123456789ABCDEFGHIJKLMNOPQR", "A", "B", "C", "D" };
+	const BYTE* inputs[2] = { AN10922_INPUT, (const BYTE*)SERIALS[0] };
+	DWORD inputSz[2] = { sizeof(AN10922_INPUT), 31 };
+	BYTE keys[2][16];
+	SSCP_KEYSTORE_ST* store;
+	DWORD master, handles[5], again;
+	int errors = 0;
+
+	if (!SSCP_DiversifyKeys(DIVERSIFY_MASTER, inputs, inputSz, 2, keys) || memcmp(keys, EXPECTED, sizeof(EXPECTED)))
+	{
+		printf("key diversification: wrong keys\n");
+		errors++;
+	}
+
+	/* Room for the master key and three readers */
+	store = SSCP_KeyStoreAlloc(4);
+	if ((store == NULL) || SSCP_KeyStoreAdd(store, DIVERSIFY_MASTER, &master))
+		return errors + 1;
+
+	if (SSCP_KeyStoreDiversify(store, master, SERIALS, 3, handles) || memcmp(SSCP_KeyStoreGet(store, handles[0])->value, EXPECTED[1], 16))
+	{
+		printf("key store: wrong diversified key\n");
+		errors++;
+	}
+	if (SSCP_KeyStoreDiversify(store, master, &SERIALS[1], 1, &again) || (again != handles[1]))
+	{
+		printf("key store: a reader already known got a new key\n");
+		errors++;
+	}
+
+	/* Full: "D" evicts the reader used the longest ago ("B", the others have been used since), not the master key */
+	if (SSCP_KeyStoreDiversify(store, master, &SERIALS[4], 1, &handles[4]) || (SSCP_KeyStoreGet(store, handles[2]) != NULL) || (SSCP_KeyStoreGet(store, handles[1]) == NULL) || (SSCP_KeyStoreGet(store, master) == NULL))
+	{
+		printf("key store: wrong eviction\n");
+		errors++;
+	}
+
+	if (SSCP_KeyStoreRemove(store, master) || (SSCP_KeyStoreDiversify(store, master, SERIALS, 1, handles) != SSCP_ERR_INVALID_PARAMETER))
+	{
+		printf("key store: removed key still in use\n");
+		errors++;
+	}
+	if ((SSCP_KeyStoreAdd(store, DIVERSIFY_MASTER, &again) != SSCP_SUCCESS) || (again == master))
+	{
+		printf("key store: the handle of a removed key is given again\n");
+		errors++;
+	}
+
+	SSCP_KeyStoreFree(store);
+	return errors;
+}
+
+/* What sscp-bench-crypto measures, computed by each backend over the same input: everything must match the first backend */
+typedef struct
+{
+	BYTE cipher[4096];
+	BYTE decipher[4096];
+	BYTE sessionKeys[64];
+	BYTE sha256[32];
+	BYTE hmac[32];
+	BYTE crc[2];
+} BACKEND_OUTPUT_ST;
+
+int checkSuiteBackends(void)
+{
+	static const DWORD SIZES[] = { 16, 64, 256, 1024, 4096 };
+	static BACKEND_OUTPUT_ST reference, output;
+	static BYTE data[4096];
+	SSCP_CTX_ST* ctx = SSCP_Alloc();
+	DWORD b, s, i;
+	int errors = 0;
+
+	if (ctx == NULL)
+		return 1;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (BYTE)(i * 13 + 7);
+
+	for (s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); s++)
+	{
+		DWORD size = SIZES[s];
+
+		for (b = 0; b < sizeof(AES_BACKENDS) / sizeof(AES_BACKENDS[0]); b++)
+		{
+			if (!AES_SetBackend(AES_BACKENDS[b].backend))
+				continue;
+
+			memcpy(output.cipher, data, size);
+			SSCP_Cipher(FIXTURE_KEY_C, FIXTURE_IV, output.cipher, size);
+			memcpy(output.decipher, data, size);
+			SSCP_Decipher(FIXTURE_KEY_C, FIXTURE_IV, output.decipher, size);
+			SSCP_ComputeSessionKeys(ctx, FIXTURE_KEY_C, FIXTURE_IV, &data[size - 16]);
+			memcpy(&output.sessionKeys[0], ctx->sessionKeyCipherAB, 16);
+			memcpy(&output.sessionKeys[16], ctx->sessionKeyCipherBA, 16);
+			memcpy(&output.sessionKeys[32], ctx->sessionKeySignAB, 16);
+			memcpy(&output.sessionKeys[48], ctx->sessionKeySignBA, 16);
+
+			if (b == 0)
+			{
+				memcpy(&reference, &output, sizeof(output));
+			}
+			else if (memcmp(reference.cipher, output.cipher, size) || memcmp(reference.decipher, output.decipher, size) || memcmp(reference.sessionKeys, output.sessionKeys, 64))
+			{
+				printf("cross-backend: aes %s differs from %s at %lu bytes\n", AES_BACKENDS[b].name, AES_BACKENDS[0].name, (unsigned long)size);
+				errors++;
+			}
+		}
+		AES_SetBackend(AES_BACKEND_AUTO);
+
+		for (b = 0; b < sizeof(SHA256_BACKENDS) / sizeof(SHA256_BACKENDS[0]); b++)
+		{
+			SHA256_CTX_ST sha256_ctx;
+
+			if (!SHA256_SetBackend(SHA256_BACKENDS[b].backend))
+				continue;
+
+			SHA256_Init(&sha256_ctx);
+			SHA256_Update(&sha256_ctx, data, size);
+			SHA256_Final(&sha256_ctx, output.sha256);
+			SSCP_HMAC(FIXTURE_KEY_S, data, size, output.hmac);
+
+			if (b == 0)
+			{
+				memcpy(reference.sha256, output.sha256, 32);
+				memcpy(reference.hmac, output.hmac, 32);
+			}
+			else if (memcmp(reference.sha256, output.sha256, 32) || memcmp(reference.hmac, output.hmac, 32))
+			{
+				printf("cross-backend: sha256 %s differs from %s at %lu bytes\n", SHA256_BACKENDS[b].name, SHA256_BACKENDS[0].name, (unsigned long)size);
+				errors++;
+			}
+		}
+		SHA256_SetBackend(SHA256_BACKEND_AUTO);
+
+		for (b = 0; b < sizeof(CRC16_BACKENDS) / sizeof(CRC16_BACKENDS[0]); b++)
+		{
+			if (!SSCP_CRC16_SetBackend(CRC16_BACKENDS[b].backend))
+				continue;
+
+			SSCP_CRC16_Final(SSCP_CRC16_Update(SSCP_CRC16_Init(), data, size), output.crc);
+
+			if (b == 0)
+			{
+				memcpy(reference.crc, output.crc, 2);
+			}
+			else if (memcmp(reference.crc, output.crc, 2))
+			{
+				printf("cross-backend: crc16 %s differs from %s at %lu bytes\n", CRC16_BACKENDS[b].name, CRC16_BACKENDS[0].name, (unsigned long)size);
+				errors++;
+			}
+		}
+		SSCP_CRC16_SetBackend(SSCP_CRC16_BACKEND_AUTO);
+
+#if SSCP_WITH_OPENSSL
+		/* The OpenSSL provider, against the first AES and SHA-256 backends */
+		if (!openProvider(ctx, SSCP_CRYPTO_PROVIDER_OPENSSL))
+		{
+			printf("cross-backend: provider %s not available\n", PROVIDER_NAMES[SSCP_CRYPTO_PROVIDER_OPENSSL]);
+			errors++;
+		}
+		else
+		{
+			memcpy(output.cipher, data, size);
+			ctx->crypto->cipher(ctx, FIXTURE_IV, output.cipher, size);
+			memcpy(output.decipher, data, size);
+			ctx->crypto->decipher(ctx, FIXTURE_IV, output.decipher, size);
+			ctx->crypto->sign(ctx, data, size, output.hmac);
+
+			if (memcmp(reference.cipher, output.cipher, size) || memcmp(reference.decipher, output.decipher, size) || memcmp(reference.hmac, output.hmac, 32))
+			{
+				printf("cross-backend: provider %s differs from %s/%s at %lu bytes\n", PROVIDER_NAMES[SSCP_CRYPTO_PROVIDER_OPENSSL], AES_BACKENDS[0].name, SHA256_BACKENDS[0].name, (unsigned long)size);
+				errors++;
+			}
+		}
+		SSCP_SetCryptoProvider(ctx, SSCP_CRYPTO_PROVIDER_BUILTIN);
+#endif
+	}
+
+	SSCP_Free(ctx);
+	return errors;
+}
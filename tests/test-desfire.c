@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tests.h"
+
+/* AuthenticateEV2First in NXP AN12196, with the all-zero key */
+static const BYTE AN12196_RND_A[16] = { 0x13, 0xC5, 0xDB, 0x8A, 0x59, 0x30, 0x43, 0x9F, 0xC3, 0xDE, 0xF9, 0xA4, 0xC6, 0x75, 0x36, 0x0F };
+static const BYTE AN12196_RND_B[16] = { 0xB9, 0xE2, 0xFC, 0x78, 0x9B, 0x64, 0xBF, 0x23, 0x7C, 0xCC, 0xAA, 0x20, 0xEC, 0x7E, 0x6E, 0x48 };
+static const BYTE AN12196_TI[4] = { 0x9D, 0x00, 0xC4, 0xDF };
+static const BYTE AN12196_SES_ENC[16] = { 0x13, 0x09, 0xC8, 0x77, 0x50, 0x9E, 0x5A, 0x21, 0x50, 0x07, 0xFF, 0x0E, 0xD1, 0x9C, 0xA5, 0x64 };
+static const BYTE AN12196_SES_MAC[16] = { 0x4C, 0x66, 0x26, 0xF5, 0xE7, 0x2E, 0xA6, 0x94, 0x20, 0x21, 0x39, 0x29, 0x5C, 0x7A, 0x7F, 0xC7 };
+
+/* RFC 4493 (CMAC) and NXP AN12196 (session keys of AuthenticateEV2First) */
+int checkDESFire(void)
+{
+	static const BYTE MESSAGE[64] = {
+		0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96, 0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A,
+		0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03, 0xAC, 0x9C, 0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51,
+		0x30, 0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11, 0xE5, 0xFB, 0xC1, 0x19, 0x1A, 0x0A, 0x52, 0xEF,
+		0xF6, 0x9F, 0x24, 0x45, 0xDF, 0x4F, 0x9B, 0x17, 0xAD, 0x2B, 0x41, 0x7B, 0xE6, 0x6C, 0x37, 0x10
+	};
+	static const DWORD MESSAGE_SZ[4] = { 0, 16, 40, 64 };
+	static const BYTE EXPECTED_CMAC[4][16] = {
+		{ 0xBB, 0x1D, 0x69, 0x29, 0xE9, 0x59, 0x37, 0x28, 0x7F, 0xA3, 0x7D, 0x12, 0x9B, 0x75, 0x67, 0x46 },
+		{ 0x07, 0x0A, 0x16, 0xB4, 0x6B, 0x4D, 0x41, 0x44, 0xF7, 0x9B, 0xDD, 0x9D, 0xD0, 0x4A, 0x28, 0x7C },
+		{ 0xDF, 0xA6, 0x67, 0x47, 0xDE, 0x9A, 0xE6, 0x30, 0x30, 0xCA, 0x32, 0x61, 0x14, 0x97, 0xC8, 0x27 },
+		{ 0x51, 0xF0, 0xBE, 0xBF, 0x7E, 0x3B, 0x9D, 0x92, 0xFC, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3C, 0xFE }
+	};
+	BYTE zero[16] = { 0 };
+	AES_CMAC_CTX_ST cmac_ctx;
+	AES_CMAC_STATE_ST state;
+	BYTE mac[16], encKey[16], macKey[16];
+	DWORD i, j;
+	int errors = 0;
+
+	AES_CMAC_Prepare(&cmac_ctx, FIXTURE_KEY_C);
+	for (i = 0; i < 4; i++)
+	{
+		AES_CMAC_Compute(&cmac_ctx, MESSAGE, MESSAGE_SZ[i], mac);
+		if (memcmp(mac, EXPECTED_CMAC[i], 16))
+		{
+			printf("AES-CMAC: wrong MAC of %lu bytes\n", (unsigned long)MESSAGE_SZ[i]);
+			errors++;
+		}
+
+		/* Byte by byte, as the secure messaging feeds it */
+		AES_CMAC_Init(&state);
+		for (j = 0; j < MESSAGE_SZ[i]; j++)
+			AES_CMAC_Update(&cmac_ctx, &state, &MESSAGE[j], 1);
+		AES_CMAC_Final(&cmac_ctx, &state, mac);
+		if (memcmp(mac, EXPECTED_CMAC[i], 16))
+		{
+			printf("AES-CMAC: wrong MAC of %lu bytes, streamed\n", (unsigned long)MESSAGE_SZ[i]);
+			errors++;
+		}
+	}
+
+	AES_CMAC_Prepare(&cmac_ctx, zero);
+	SSCP_DESFireSessionKeys(&cmac_ctx, AN12196_RND_A, AN12196_RND_B, encKey, macKey);
+	if (memcmp(encKey, AN12196_SES_ENC, 16) || memcmp(macKey, AN12196_SES_MAC, 16))
+	{
+		printf("DESFire EV2: wrong session keys\n");
+		errors++;
+	}
+
+	return errors;
+}
+
+/*
+ * Loopback DESFire card
+ * ---------------------
+ *
+ * A DESFire EV2 card behind the loopback reader. AuthenticateEV2First replays the worked example of NXP AN12196 byte
+ * for byte (all-zero key 0, the host being handed the RndA of the example), then the card uses the session keys of the
+ * example, so the host must have derived the same ones. File 1 is read with MAC, file 2 is written and read enciphered;
+ * responses are sent in frames of 64 bytes at most.
+ */
+
+static const BYTE AN12196_PART1_CAPDU[8] = { 0x90, 0x71, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00 };
+static const BYTE AN12196_PART1_RAPDU[18] = {
+	0xA0, 0x4C, 0x12, 0x42, 0x13, 0xC1, 0x86, 0xF2, 0x23, 0x99, 0xD3, 0x3A, 0xC2, 0xA3, 0x02, 0x15, 0x91, 0xAF
+};
+static const BYTE AN12196_PART2_CAPDU[38] = {
+	0x90, 0xAF, 0x00, 0x00, 0x20,
+	0x35, 0xC3, 0xE0, 0x5A, 0x75, 0x2E, 0x01, 0x44, 0xBA, 0xC0, 0xDE, 0x51, 0xC1, 0xF2, 0x2C, 0x56,
+	0xB3, 0x44, 0x08, 0xA2, 0x3D, 0x8A, 0xEA, 0x26, 0x6C, 0xAB, 0x94, 0x7E, 0xA8, 0xE0, 0x11, 0x8D,
+	0x00
+};
+static const BYTE AN12196_PART2_RAPDU[34] = {
+	0x3F, 0xA6, 0x4D, 0xB5, 0x44, 0x6D, 0x1F, 0x34, 0xCD, 0x6E, 0xA3, 0x11, 0x16, 0x7F, 0x5E, 0x49,
+	0x85, 0xB8, 0x96, 0x90, 0xC0, 0x4A, 0x05, 0xF1, 0x7F, 0xA7, 0xAB, 0x2F, 0x08, 0x12, 0x06, 0x63,
+	0x91, 0x00
+};
+
+#define CARD_FRAME_SIZE 64
+#define CARD_FILE_SIZE 128
+
+typedef struct
+{
+	BOOL part2;	/* Part 1 of the authentication done */
+	BOOL authenticated;
+	WORD cmdCtr;
+	AES_CTX_ST sesEnc;
+	AES_CMAC_CTX_ST sesMac;
+	BYTE files[3][CARD_FILE_SIZE];
+	BYTE pending[CARD_FILE_SIZE + 32];	/* Response being sent in several frames */
+	DWORD pendingSz;
+	DWORD pendingOffset;
+	BOOL corruptMAC;	/* Spoil the MAC of the next response */
+} LOOPBACK_CARD_ST;
+
+/* RndA of AN12196, for the next challenge the host draws */
+static const BYTE* cardForcedRndA;
+static const SSCP_CRYPTO_PROVIDER_ST* cardCryptoBase;
+static SSCP_CRYPTO_PROVIDER_ST cardCrypto;
+
+static BOOL cardRandom(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD length)
+{
+	if ((cardForcedRndA != NULL) && (length == 16))
+	{
+		memcpy(buffer, cardForcedRndA, 16);
+		cardForcedRndA = NULL;
+		return TRUE;
+	}
+	return cardCryptoBase->random(ctx, buffer, length);
+}
+
+/* CMACt (SesAuthMACKey, Code | CmdCtr | TI | data), written the long way rather than with the library's helpers */
+static void cardMACt(LOOPBACK_CARD_ST* card, BYTE code, WORD cmdCtr, const BYTE data[], DWORD dataSz, BYTE mact[8])
+{
+	BYTE buffer[7 + sizeof(card->pending)];
+	BYTE mac[16];
+	DWORD i;
+
+	buffer[0] = code;
+	buffer[1] = (BYTE)cmdCtr;
+	buffer[2] = (BYTE)(cmdCtr >> 8);
+	memcpy(&buffer[3], AN12196_TI, 4);
+	memcpy(&buffer[7], data, dataSz);
+	AES_CMAC_Compute(&card->sesMac, buffer, 7 + dataSz, mac);
+	for (i = 0; i < 8; i++)
+		mact[i] = mac[2 * i + 1];
+}
+
+static void cardIV(LOOPBACK_CARD_ST* card, BOOL response, WORD cmdCtr, BYTE iv[16])
+{
+	memset(iv, 0, 16);
+	iv[0] = response ? 0x5A : 0xA5;
+	iv[1] = response ? 0xA5 : 0x5A;
+	memcpy(&iv[2], AN12196_TI, 4);
+	iv[6] = (BYTE)cmdCtr;
+	iv[7] = (BYTE)(cmdCtr >> 8);
+	AES_Encrypt(&card->sesEnc, iv);
+}
+
+/* An error drops the authentication, as a real card does */
+static DWORD cardStatus(LOOPBACK_CARD_ST* card, BYTE status, BYTE rapdu[])
+{
+	card->authenticated = FALSE;
+	rapdu[0] = 0x91;
+	rapdu[1] = status;
+	return 2;
+}
+
+static DWORD cardFrame(LOOPBACK_CARD_ST* card, BYTE rapdu[])
+{
+	DWORD n = card->pendingSz - card->pendingOffset;
+
+	if (n > CARD_FRAME_SIZE)
+		n = CARD_FRAME_SIZE;
+	memcpy(rapdu, &card->pending[card->pendingOffset], n);
+	card->pendingOffset += n;
+	rapdu[n] = 0x91;
+	rapdu[n + 1] = (card->pendingOffset < card->pendingSz) ? 0xAF : 0x00;
+	return n + 2;
+}
+
+static DWORD loopbackCard(void* param, const BYTE c[], DWORD cSz, BYTE rapdu[])
+{
+	LOOPBACK_CARD_ST* card = param;
+	BYTE* r = card->pending;
+	BYTE iv[16], mact[8];
+	DWORD lc, fileNo, offset, length, sz, i, rl = 0;
+
+	if ((cSz == sizeof(AN12196_PART1_CAPDU)) && !memcmp(c, AN12196_PART1_CAPDU, cSz))
+	{
+		card->authenticated = FALSE;
+		card->part2 = TRUE;
+		cardForcedRndA = AN12196_RND_A;
+		memcpy(rapdu, AN12196_PART1_RAPDU, sizeof(AN12196_PART1_RAPDU));
+		return sizeof(AN12196_PART1_RAPDU);
+	}
+	if (card->part2)
+	{
+		card->part2 = FALSE;
+		if ((cSz != sizeof(AN12196_PART2_CAPDU)) || memcmp(c, AN12196_PART2_CAPDU, cSz))
+			return cardStatus(card, 0xAE, rapdu);
+		card->authenticated = TRUE;
+		card->cmdCtr = 0;
+		AES_Init(&card->sesEnc, AN12196_SES_ENC);
+		AES_CMAC_Prepare(&card->sesMac, AN12196_SES_MAC);
+		memcpy(rapdu, AN12196_PART2_RAPDU, sizeof(AN12196_PART2_RAPDU));
+		return sizeof(AN12196_PART2_RAPDU);
+	}
+	if ((cSz == 5) && (c[1] == 0xAF) && (card->pendingOffset < card->pendingSz))
+		return cardFrame(card, rapdu);
+	card->pendingSz = 0;
+	card->pendingOffset = 0;
+
+	/* 90 INS 00 00 Lc | FileNo Offset Length | data | MACt | 00 */
+	if (!card->authenticated || (cSz < 5 + 7 + 8 + 1) || (c[4] != cSz - 6))
+		return cardStatus(card, 0xAE, rapdu);
+	lc = c[4];
+	cardMACt(card, c[1], card->cmdCtr, &c[5], lc - 8, mact);
+	if (memcmp(mact, &c[5 + lc - 8], 8))
+		return cardStatus(card, 0x1E, rapdu);
+
+	fileNo = c[5];
+	offset = c[6] | ((DWORD)c[7] << 8) | ((DWORD)c[8] << 16);
+	length = c[9] | ((DWORD)c[10] << 8) | ((DWORD)c[11] << 16);
+	if ((fileNo < 1) || (fileNo > 2) || (offset + length > CARD_FILE_SIZE))
+		return cardStatus(card, 0xBE, rapdu);
+
+	if ((c[1] == 0xAD) && (lc == 7 + 8))
+	{
+		memcpy(r, &card->files[fileNo][offset], length);
+		rl = length;
+		if (fileNo == 2)
+		{
+			r[rl++] = 0x80;
+			while (rl % 16)
+				r[rl++] = 0x00;
+			cardIV(card, TRUE, card->cmdCtr + 1, iv);
+			AES_EncryptCBC(&card->sesEnc, iv, r, rl / 16);
+		}
+	}
+	else if ((c[1] == 0x3D) && (fileNo == 2))
+	{
+		/* Always padded, with a whole block when the data fill the last one */
+		sz = lc - 7 - 8;
+		if (sz != ((length + 16) & ~15UL))
+			return cardStatus(card, 0x7E, rapdu);
+		memcpy(r, &c[12], sz);
+		cardIV(card, FALSE, card->cmdCtr, iv);
+		AES_DecryptCBC(&card->sesEnc, iv, r, sz / 16);
+		if (r[length] != 0x80)
+			return cardStatus(card, 0x7E, rapdu);
+		for (i = length + 1; i < sz; i++)
+			if (r[i] != 0x00)
+				return cardStatus(card, 0x7E, rapdu);
+		memcpy(&card->files[2][offset], r, length);
+	}
+	else
+	{
+		return cardStatus(card, 0x1C, rapdu);
+	}
+
+	card->cmdCtr++;
+	cardMACt(card, 0x00, card->cmdCtr, r, rl, &r[rl]);
+	if (card->corruptMAC)
+	{
+		r[rl] ^= 0x01;
+		card->corruptMAC = FALSE;
+	}
+	card->pendingSz = rl + 8;
+	return cardFrame(card, rapdu);
+}
+
+int checkDESFireCard(void)
+{
+	static const BYTE ZERO_KEY[16] = { 0 };
+	static LOOPBACK_READER_ST reader;
+	static LOOPBACK_CARD_ST card;
+	SSCP_CTX_ST* ctx;
+	BYTE header[7] = { 0x02, 0x04, 0x00, 0x00, 0x10, 0x00, 0x00 };
+	BYTE written[16];
+	BYTE data[CARD_FILE_SIZE];
+	DWORD actSz, i;
+	int errors = 0;
+
+	memset(&card, 0, sizeof(card));
+	for (i = 0; i < CARD_FILE_SIZE; i++)
+	{
+		card.files[1][i] = (BYTE)i;
+		card.files[2][i] = (BYTE)(0xFF - i);
+	}
+	memset(written, 0xA5, sizeof(written));
+
+	reader.card = loopbackCard;
+	reader.cardParam = &card;
+	ctx = openLoopbackReader(&reader);
+	if (ctx == NULL)
+	{
+		printf("DESFire card: authentication failed\n");
+		return 1;
+	}
+	cardCryptoBase = ctx->crypto;
+	cardCrypto = *ctx->crypto;
+	cardCrypto.random = cardRandom;
+	ctx->crypto = &cardCrypto;
+
+	/* The card checks part 2 against AN12196, the host checks RndA' and takes TI */
+	if (SSCP_DESFireAuthenticateEV2First(ctx, 0x00, ZERO_KEY) || memcmp(ctx->desfire.ti, AN12196_TI, 4))
+	{
+		printf("DESFire card: AuthenticateEV2First differs from AN12196\n");
+		errors++;
+		goto done;
+	}
+
+	/* MAC only, the response comes in two frames */
+	if (SSCP_DESFireReadData(ctx, 1, 8, 100, SSCP_DESFIRE_COMM_MAC, data, sizeof(data), &actSz) || (actSz != 100) || memcmp(data, &card.files[1][8], 100))
+	{
+		printf("DESFire card: wrong ReadData with MAC\n");
+		errors++;
+	}
+
+	/* Enciphered, 16 bytes take a whole block of padding */
+	if (SSCP_DESFireCommand(ctx, 0x3D, header, sizeof(header), written, sizeof(written), SSCP_DESFIRE_COMM_FULL, NULL, 0, &actSz) || (actSz != 0) || memcmp(&card.files[2][4], written, sizeof(written)))
+	{
+		printf("DESFire card: wrong enciphered WriteData\n");
+		errors++;
+	}
+	if (SSCP_DESFireReadData(ctx, 2, 0, 100, SSCP_DESFIRE_COMM_FULL, data, sizeof(data), &actSz) || (actSz != 100) || memcmp(data, card.files[2], 100))
+	{
+		printf("DESFire card: wrong enciphered ReadData\n");
+		errors++;
+	}
+	if ((ctx->desfire.cmdCtr != 3) || (card.cmdCtr != 3))
+	{
+		printf("DESFire card: CmdCtr is %u on the host, %u on the card\n", ctx->desfire.cmdCtr, card.cmdCtr);
+		errors++;
+	}
+
+	/* A wrong response CMAC ends the session */
+	card.corruptMAC = TRUE;
+	if (SSCP_DESFireReadData(ctx, 1, 0, 16, SSCP_DESFIRE_COMM_MAC, data, sizeof(data), &actSz) != SSCP_ERR_NFC_CARD_SIGNATURE)
+	{
+		printf("DESFire card: wrong response CMAC accepted\n");
+		errors++;
+	}
+	if (ctx->desfire.authenticated || (SSCP_DESFireReadData(ctx, 1, 0, 16, SSCP_DESFIRE_COMM_MAC, data, sizeof(data), &actSz) != SSCP_ERR_INVALID_PARAMETER))
+	{
+		printf("DESFire card: session kept after a wrong response CMAC\n");
+		errors++;
+	}
+
+done:
+	ctx->crypto = cardCryptoBase;
+	SSCP_Free(ctx);
+	return errors;
+}
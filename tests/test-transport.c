@@ -0,0 +1,614 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tests.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+/* Stray bytes the line adds in front of the next response */
+static DWORD loopbackNoiseSz;
+
+static DWORD loopbackNoisyReader(void* param, const BYTE data[], DWORD dataSz, BYTE response[], DWORD maxResponseSz)
+{
+	DWORD noiseSz = loopbackNoiseSz;
+	DWORD n;
+
+	if (maxResponseSz < noiseSz)
+		return 0;
+	loopbackNoiseSz = 0;
+	memset(response, 0x55, noiseSz);
+	n = loopbackReader(param, data, dataSz, &response[noiseSz], maxResponseSz - noiseSz);
+	return n ? noiseSz + n : 0;
+}
+
+/* An adapter that echoes the frame it puts on the line, then the reader answers */
+static DWORD loopbackEchoingReader(void* param, const BYTE data[], DWORD dataSz, BYTE response[], DWORD maxResponseSz)
+{
+	static BYTE answer[SSCP_MAX_COMMAND_SIZE + 7];
+	DWORD n = loopbackReader(param, data, dataSz, answer, sizeof(answer));
+
+	if ((n == 0) || (dataSz + n > maxResponseSz))
+		return 0;
+	memcpy(response, data, dataSz);
+	memcpy(&response[dataSz], answer, n);
+	return dataSz + n;
+}
+
+/* A line that delivers a few bytes at a time */
+static SSCP_TRANSPORT_ST loopbackTrickle;
+static const SSCP_TRANSPORT_ST* loopbackTrickleBase;
+
+static LONG loopbackTrickleRead(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD maxLength, DWORD timeout, DWORD* actLength)
+{
+	return loopbackTrickleBase->read(ctx, buffer, (maxLength < 7) ? maxLength : 7, timeout, actLength);
+}
+
+int checkLoopback(void)
+{
+	static BYTE large[SSCP_MAX_PAYLOAD_SIZE];
+	SSCP_CTX_ST* ctx = openLoopback();
+	BYTE version, baudrate, address;
+	WORD voltage;
+	DWORD i;
+	int fd;
+	int errors = 0;
+
+	if (ctx == NULL)
+	{
+		printf("loopback: authentication failed\n");
+		return 1;
+	}
+
+	if (SSCP_GetInfos(ctx, &version, &baudrate, &address, &voltage) || (voltage != 0x1388))
+	{
+		printf("loopback: wrong GET_INFOS\n");
+		errors++;
+	}
+	if (SSCP_GetPollFd(ctx, &fd) || (fd != -1))
+	{
+		printf("loopback: unexpected descriptor\n");
+		errors++;
+	}
+
+	/* A stray byte fails one exchange, not the ones after it */
+	SSCP_SetLoopbackPeer(ctx, loopbackNoisyReader, ctx->loopbackParam);
+	loopbackNoiseSz = 1;
+	if (SSCP_GetInfos(ctx, &version, &baudrate, &address, &voltage) != SSCP_ERR_WRONG_RESPONSE_COMMAND)
+	{
+		printf("loopback: stray byte taken for a frame\n");
+		errors++;
+	}
+	if (SSCP_GetInfos(ctx, &version, &baudrate, &address, &voltage) || (voltage != 0x1388))
+	{
+		printf("loopback: stray byte left in the ring\n");
+		errors++;
+	}
+
+	/* The largest command makes a frame longer than any response, its echo is skipped all the same */
+	SSCP_SetLoopbackPeer(ctx, loopbackEchoingReader, ctx->loopbackParam);
+	for (i = 0; i < 2; i++)
+	{
+		ctx->commFlags = SSCP_COMM_FLAG_ECHO | (i ? SSCP_COMM_FLAG_RESYNC : 0);
+		ctx->stats.echoesDropped = 0;
+		if (SSCP_Exchange(ctx, SSCP_CMD_TRANSCEIVE_APDU, large, sizeof(large), NULL, 0, NULL) || (ctx->stats.echoesDropped != 1))
+		{
+			printf("loopback: echo of a long command not skipped%s\n", i ? " in resync mode" : "");
+			errors++;
+		}
+	}
+	ctx->commFlags = 0;
+
+	/* Frames that come in pieces, the CRC is carried over from one read to the next */
+	loopbackTrickleBase = ctx->transport;
+	loopbackTrickle = *ctx->transport;
+	loopbackTrickle.read = loopbackTrickleRead;
+	ctx->transport = &loopbackTrickle;
+	for (i = 0; i < 2; i++)
+	{
+		ctx->commFlags = SSCP_COMM_FLAG_ECHO | (i ? SSCP_COMM_FLAG_RESYNC : 0);
+		loopbackNoiseSz = i ? 3 : 0;
+		SSCP_SetLoopbackPeer(ctx, i ? loopbackNoisyReader : loopbackEchoingReader, ctx->loopbackParam);
+		if (SSCP_Exchange(ctx, SSCP_CMD_TRANSCEIVE_APDU, large, i ? 5 : sizeof(large), NULL, 0, NULL) || SSCP_GetInfos(ctx, &version, &baudrate, &address, &voltage) || (voltage != 0x1388))
+		{
+			printf("loopback: frame read in pieces rejected%s\n", i ? " in resync mode" : "");
+			errors++;
+		}
+	}
+	ctx->commFlags = 0;
+	ctx->transport = loopbackTrickleBase;
+
+	/* A mute reader */
+	SSCP_SetLoopbackPeer(ctx, NULL, NULL);
+	SSCP_Close(ctx);
+	if (SSCP_Open(ctx, "loop:", 38400, 0) || (SSCP_GetInfos(ctx, &version, &baudrate, &address, &voltage) == SSCP_SUCCESS))
+	{
+		printf("loopback: echo taken for a response\n");
+		errors++;
+	}
+
+	SSCP_Free(ctx);
+	return errors;
+}
+
+int checkLoopbackBatch(void)
+{
+	static const BYTE OUTPUTS[3] = { 0x02, 0x0A, 0x00 };
+	static LOOPBACK_READER_ST readers[2];
+	SSCP_CTX_ST* first = openLoopbackReader(&readers[0]);
+	SSCP_CTX_ST* second = openLoopbackReader(&readers[1]);
+	SSCP_BATCH_ITEM_ST items[3];
+	BYTE infos[2][16];
+	BYTE version, baudrate, address;
+	WORD voltage;
+	int errors = 0;
+
+	if ((first == NULL) || (second == NULL))
+	{
+		printf("loopback batch: authentication failed\n");
+		SSCP_Free(first);
+		SSCP_Free(second);
+		return 1;
+	}
+
+	/* The same context twice: the second command is refused, the first one still goes out as it was built */
+	memset(items, 0, sizeof(items));
+	items[0].ctx = first;
+	items[0].commandHeader = SSCP_CMD_GET_INFOS;
+	items[0].responseData = infos[0];
+	items[0].maxResponseDataSz = sizeof(infos[0]);
+	items[1].ctx = second;
+	items[1].commandHeader = SSCP_CMD_GET_INFOS;
+	items[1].responseData = infos[1];
+	items[1].maxResponseDataSz = sizeof(infos[1]);
+	items[2].ctx = first;
+	items[2].commandHeader = SSCP_CMD_OUTPUTS;
+	items[2].commandData = OUTPUTS;
+	items[2].commandDataSz = sizeof(OUTPUTS);
+
+	if (SSCP_ExchangeBatch(items, 3) != SSCP_ERR_INVALID_PARAMETER)
+	{
+		printf("loopback batch: duplicate context not reported\n");
+		errors++;
+	}
+	if (items[0].result || (items[0].actResponseDataSz != 5) || items[1].result || (items[1].actResponseDataSz != 5))
+	{
+		printf("loopback batch: command spoiled by a duplicate context (%ld, %ld)\n", items[0].result, items[1].result);
+		errors++;
+	}
+	if (items[2].result != SSCP_ERR_INVALID_PARAMETER)
+	{
+		printf("loopback batch: duplicate context accepted\n");
+		errors++;
+	}
+	if (SSCP_GetInfos(first, &version, &baudrate, &address, &voltage) || (voltage != 0x1388))
+	{
+		printf("loopback batch: session lost after a duplicate context\n");
+		errors++;
+	}
+
+	SSCP_Free(first);
+	SSCP_Free(second);
+	return errors;
+}
+
+/* The loopback with a line whose rate the host sets, see LOOPBACK_READER_ST.baudrate */
+static SSCP_TRANSPORT_ST loopbackLine;
+static DWORD loopbackLineConfigures;
+
+static LONG loopbackLineConfigure(SSCP_CTX_ST* ctx, DWORD baudrate)
+{
+	LOOPBACK_READER_ST* reader = ctx->loopbackParam;
+
+	reader->hostBaudrate = baudrate;
+	loopbackLineConfigures++;
+	return SSCP_SUCCESS;
+}
+
+static LONG loopbackLineCheckBaudrate(SSCP_CTX_ST* ctx, DWORD baudrate)
+{
+	(void)ctx;
+	(void)baudrate;
+
+	return SSCP_SUCCESS;
+}
+
+int checkBaudrate(void)
+{
+	static LOOPBACK_READER_ST reader;
+	SSCP_CTX_ST* ctx = openLoopbackReader(&reader);
+	BYTE version, baudrate, address;
+	WORD voltage;
+	LONG rc;
+	int errors = 0;
+
+	if (ctx == NULL)
+	{
+		printf("baud rate: authentication failed\n");
+		return 1;
+	}
+	loopbackLine = *ctx->transport;
+	loopbackLine.configure = loopbackLineConfigure;
+	loopbackLine.checkBaudrate = loopbackLineCheckBaudrate;
+	ctx->transport = &loopbackLine;
+	reader.baudrate = ctx->baudrate;
+	reader.hostBaudrate = ctx->baudrate;
+
+	if (SSCP_SetBaudrate(ctx, 115200) || (ctx->baudrate != 115200) || (reader.baudrate != 115200))
+	{
+		printf("baud rate: plain change failed\n");
+		errors++;
+	}
+
+	/* The reader has switched, only its response is lost */
+	reader.baudrateResponse = 1;
+	rc = SSCP_SetBaudrate(ctx, 230400);
+	if (rc || (ctx->baudrate != 230400) || SSCP_GetInfos(ctx, &version, &baudrate, &address, &voltage) || (baudrate != 5))
+	{
+		printf("baud rate: lost response, %ld at %lu for a reader at %lu\n", rc, (unsigned long)ctx->baudrate, (unsigned long)reader.baudrate);
+		errors++;
+	}
+
+	/* The reader has not got the command: the error comes back, and the link stays at the previous rate */
+	reader.baudrateResponse = 2;
+	rc = SSCP_SetBaudrate(ctx, 460800);
+	if ((rc >= 0) || (ctx->baudrate != 230400) || SSCP_GetInfos(ctx, &version, &baudrate, &address, &voltage) || (baudrate != 5))
+	{
+		printf("baud rate: lost command, %ld at %lu for a reader at %lu\n", rc, (unsigned long)ctx->baudrate, (unsigned long)reader.baudrate);
+		errors++;
+	}
+
+	SSCP_Free(ctx);
+	return errors;
+}
+
+int checkDiscover(void)
+{
+	static const BYTE ADDRESSES[3] = { 0x10, 0x11, 0x12 };
+	static LOOPBACK_READER_ST reader;
+	SSCP_CTX_ST* ctx = openLoopbackReader(&reader);
+	SSCP_DISCOVERY_ST found[8];
+	DWORD foundCount, sent;
+	int errors = 0;
+
+	if (ctx == NULL)
+	{
+		printf("discover: authentication failed\n");
+		return 1;
+	}
+	loopbackLine = *ctx->transport;
+	loopbackLine.configure = loopbackLineConfigure;
+	loopbackLine.checkBaudrate = loopbackLineCheckBaudrate;
+	ctx->transport = &loopbackLine;
+	reader.baudrate = 115200;
+	reader.hostBaudrate = ctx->baudrate;
+
+	/* 38400 (the current rate), then 115200 answers and the sweep ends there */
+	sent = ctx->stats.framesSent;
+	loopbackLineConfigures = 0;
+	if (SSCP_Discover(ctx, NULL, 0, ADDRESSES, sizeof(ADDRESSES), found, 8, &foundCount) || (foundCount != 3) || (found[0].baudrate != 115200) || (found[0].address != 0x10))
+	{
+		printf("discover: %lu readers found\n", (unsigned long)foundCount);
+		errors++;
+	}
+	if ((ctx->stats.framesSent - sent != 2 * sizeof(ADDRESSES)) || (loopbackLineConfigures != 2 + 1))
+	{
+		printf("discover: %lu probes and %lu rates for a reader at the second rate\n", (unsigned long)(ctx->stats.framesSent - sent), (unsigned long)loopbackLineConfigures);
+		errors++;
+	}
+	if ((ctx->baudrate != 115200) || (ctx->address != 0x10))
+	{
+		printf("discover: link left at %lu, address %02X\n", (unsigned long)ctx->baudrate, ctx->address);
+		errors++;
+	}
+
+	/* Now at the current rate, and one reader is enough */
+	sent = ctx->stats.framesSent;
+	if (SSCP_Discover(ctx, NULL, 0, NULL, 0, found, 1, &foundCount) || (foundCount != 1) || (ctx->stats.framesSent - sent != 1))
+	{
+		printf("discover: %lu probes for the first reader\n", (unsigned long)(ctx->stats.framesSent - sent));
+		errors++;
+	}
+
+	SSCP_Free(ctx);
+	SSCP_Free(reader.keys);
+	return errors;
+}
+
+#ifndef _WIN32
+/*
+ * Line time
+ * ---------
+ *
+ * The loopback with a line at the rate of the host: the response can be read once the command and the response have
+ * both gone over it. After many short APDUs the response times are short, a 4 KB APDU must still get its answer at the
+ * first attempt, and the short ones must not have been timed with their command.
+ */
+
+static SSCP_TRANSPORT_ST loopbackTimed;
+static const SSCP_TRANSPORT_ST* loopbackTimedBase;
+static DWORD loopbackTimedBaudrate;
+static DWORD loopbackTimedReadyUs;
+static DWORD loopbackTimedResponseSz;
+
+static DWORD loopbackTimedReader(void* param, const BYTE data[], DWORD dataSz, BYTE response[], DWORD maxResponseSz)
+{
+	DWORD n = loopbackReader(param, data, dataSz, response, maxResponseSz);
+
+	loopbackTimedReadyUs = SSCP_GetTimeUs() + SSCP_LineTime(loopbackTimedBaudrate, dataSz + n);
+	loopbackTimedResponseSz = n;
+	return n;
+}
+
+static LONG loopbackTimedRead(SSCP_CTX_ST* ctx, BYTE buffer[], DWORD maxLength, DWORD timeout, DWORD* actLength)
+{
+	DWORD now = SSCP_GetTimeUs();
+
+	if (loopbackTimedReadyUs - now < 0x80000000UL)
+	{
+		if (loopbackTimedReadyUs - now > timeout * 1000)
+		{
+			usleep(timeout * 1000);
+			*actLength = 0;
+			return SSCP_ERR_COMM_RECV_MUTE;
+		}
+		usleep(loopbackTimedReadyUs - now);
+	}
+
+	return loopbackTimedBase->read(ctx, buffer, maxLength, timeout, actLength);
+}
+
+/* A card that answers every C-APDU with 90 00 */
+static DWORD loopbackStatusCard(void* param, const BYTE capdu[], DWORD capduSz, BYTE rapdu[])
+{
+	(void)param;
+	(void)capdu;
+	(void)capduSz;
+
+	rapdu[0] = 0x90;
+	rapdu[1] = 0x00;
+	return 2;
+}
+
+int checkLineTime(void)
+{
+	static LOOPBACK_READER_ST reader;
+	static BYTE apdu[4096];
+	SSCP_CTX_ST* ctx;
+	BYTE rapdu[16];
+	DWORD rapduSz, i;
+	int errors = 0;
+
+	reader.card = loopbackStatusCard;
+	ctx = openLoopbackReader(&reader);
+	if (ctx == NULL)
+	{
+		printf("line time: authentication failed\n");
+		return 1;
+	}
+	loopbackTimedBase = ctx->transport;
+	loopbackTimed = *ctx->transport;
+	loopbackTimed.read = loopbackTimedRead;
+	ctx->transport = &loopbackTimed;
+	SSCP_SetLoopbackPeer(ctx, loopbackTimedReader, &reader);
+	loopbackTimedBaudrate = ctx->baudrate;
+
+	for (i = 0; i < 32; i++)
+	{
+		if (SSCP_TransceiveNFC(ctx, apdu, 5, rapdu, sizeof(rapdu), &rapduSz) || (rapduSz != 2))
+		{
+			printf("line time: short APDU failed\n");
+			errors++;
+			break;
+		}
+	}
+
+	/* What is left of a sample is the response on the line */
+	if (ctx->rtt[SSCP_RTT_CLASS_CARD].srtt > SSCP_LineTime(ctx->baudrate, loopbackTimedResponseSz) + 2000)
+	{
+		printf("line time: %lu us for a short APDU, the command is in the samples\n", (unsigned long)ctx->rtt[SSCP_RTT_CLASS_CARD].srtt);
+		errors++;
+	}
+
+	ctx->stats.errorCount = 0;
+	if (SSCP_TransceiveNFC(ctx, apdu, sizeof(apdu), rapdu, sizeof(rapdu), &rapduSz) || (rapduSz != 2) || (ctx->stats.errorCount != 0))
+	{
+		printf("line time: 4 KB APDU timed out\n");
+		errors++;
+	}
+
+	SSCP_Free(ctx);
+	SSCP_Free(reader.keys);
+	return errors;
+}
+
+/*
+ * RFC 2217 over a local socket
+ * ----------------------------
+ *
+ * A child process plays a Telnet COM port server on 127.0.0.1: it confirms the baud rate, checks that 0xFF is doubled,
+ * answers with data mixed with Telnet commands, then resets the connection so that the next frame goes over a new one.
+ */
+
+typedef struct
+{
+	int fd;
+	BYTE seen[1024];	/* Everything the host has sent on this connection */
+	DWORD seenSz;
+	DWORD from;		/* Where the next pattern is looked for */
+} SERVER_CONN_ST;
+
+static int serverAccept(int listener, SERVER_CONN_ST* conn)
+{
+	struct pollfd pfd;
+
+	memset(conn, 0, sizeof(*conn));
+	pfd.fd = listener;
+	pfd.events = POLLIN;
+	conn->fd = (poll(&pfd, 1, 2000) == 1) ? accept(listener, NULL, NULL) : -1;
+	return conn->fd;
+}
+
+/* Wait for the host to send pattern then extraSz more bytes, 2 s at most; returns the extra bytes */
+static const BYTE* serverExpect(SERVER_CONN_ST* conn, const BYTE pattern[], DWORD patternSz, DWORD extraSz)
+{
+	struct pollfd pfd;
+	ssize_t n;
+	DWORD i;
+
+	for (;;)
+	{
+		for (i = conn->from; i + patternSz + extraSz <= conn->seenSz; i++)
+		{
+			if (!memcmp(&conn->seen[i], pattern, patternSz))
+			{
+				conn->from = i + patternSz + extraSz;
+				return &conn->seen[i + patternSz];
+			}
+		}
+
+		pfd.fd = conn->fd;
+		pfd.events = POLLIN;
+		if ((conn->seenSz == sizeof(conn->seen)) || (poll(&pfd, 1, 2000) != 1))
+			return NULL;
+		n = recv(conn->fd, &conn->seen[conn->seenSz], sizeof(conn->seen) - conn->seenSz, 0);
+		if (n <= 0)
+			return NULL;
+		conn->seenSz += n;
+	}
+}
+
+/* Confirm the baud rate the host sets, as a COM port server does */
+static BOOL serverBaudrate(SERVER_CONN_ST* conn)
+{
+	static const BYTE SET_BAUDRATE[4] = { 0xFF, 0xFA, 0x2C, 0x01 };
+	BYTE ack[10] = { 0xFF, 0xFA, 0x2C, 0x65, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xF0 };
+	const BYTE* baudrate = serverExpect(conn, SET_BAUDRATE, sizeof(SET_BAUDRATE), 4);
+
+	if (baudrate == NULL)
+		return FALSE;
+	memcpy(&ack[4], baudrate, 4);
+	return (send(conn->fd, ack, sizeof(ack), 0) == sizeof(ack)) ? TRUE : FALSE;
+}
+
+static int socketServer(int listener)
+{
+	static const BYTE ESCAPED[6] = { 0x02, 0xFF, 0xFF, 0x10, 0xFF, 0xFF };
+	static const BYTE WONT_TTYPE[3] = { 0xFF, 0xFC, 0x18 };
+	/* AA FF BB in the data, with DO TERMINAL-TYPE, a NOTIFY-LINESTATE and a NOP in between */
+	static const BYTE REPLY[] = { 0xAA, 0xFF, 0xFF, 0xFF, 0xFD, 0x18, 0xFF, 0xFA, 0x2C, 0x6B, 0x00, 0xFF, 0xF0, 0xFF, 0xF1, 0xBB };
+	static const BYTE AGAIN[1] = { 0xCC };
+	struct linger reset = { 1, 0 };
+	SERVER_CONN_ST conn;
+
+	if ((serverAccept(listener, &conn) < 0) || !serverBaudrate(&conn) || (serverExpect(&conn, ESCAPED, sizeof(ESCAPED), 0) == NULL))
+		return 1;
+	if ((send(conn.fd, REPLY, sizeof(REPLY), 0) != sizeof(REPLY)) || (serverExpect(&conn, WONT_TTYPE, sizeof(WONT_TTYPE), 0) == NULL))
+		return 2;
+
+	/* Reset, as a device server that restarts */
+	setsockopt(conn.fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+	close(conn.fd);
+
+	if ((serverAccept(listener, &conn) < 0) || !serverBaudrate(&conn) || (serverExpect(&conn, ESCAPED, sizeof(ESCAPED), 0) == NULL))
+		return 3;
+	if (send(conn.fd, AGAIN, sizeof(AGAIN), 0) != sizeof(AGAIN))
+		return 4;
+
+	serverExpect(&conn, ESCAPED, sizeof(ESCAPED), 0); /* Until the host closes */
+	close(conn.fd);
+	return 0;
+}
+
+/* Read exactly expectedSz bytes of data, 1 s at most */
+static BOOL socketRead(SSCP_CTX_ST* ctx, const BYTE expected[], DWORD expectedSz)
+{
+	BYTE buffer[16];
+	DWORD got = 0, n;
+
+	while (got < expectedSz)
+	{
+		if (SSCP_SerialRead(ctx, &buffer[got], sizeof(buffer) - got, 1000, &n))
+			return FALSE;
+		got += n;
+	}
+
+	return ((got == expectedSz) && !memcmp(buffer, expected, expectedSz)) ? TRUE : FALSE;
+}
+
+int checkSocket(void)
+{
+	static const BYTE FRAME[4] = { 0x02, 0xFF, 0x10, 0xFF };
+	static const BYTE DATA[3] = { 0xAA, 0xFF, 0xBB };
+	static const BYTE AGAIN[1] = { 0xCC };
+	struct sockaddr_in sin;
+	socklen_t sinLen = sizeof(sin);
+	struct pollfd pfd;
+	SSCP_CTX_ST* ctx = NULL;
+	char name[64];
+	int listener, status = -1;
+	pid_t pid;
+	int errors = 0;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	if ((listener < 0) || bind(listener, (struct sockaddr*)&sin, sizeof(sin)) || listen(listener, 1) || getsockname(listener, (struct sockaddr*)&sin, &sinLen))
+	{
+		printf("socket: no local listener\n");
+		if (listener >= 0)
+			close(listener);
+		return 1;
+	}
+
+	pid = fork();
+	if (pid == 0)
+		_exit(socketServer(listener));
+	close(listener);
+	if (pid < 0)
+		return 1;
+
+	sprintf(name, "rfc2217:127.0.0.1:%u", ntohs(sin.sin_port));
+	ctx = SSCP_Alloc();
+	if ((ctx == NULL) || SSCP_Open(ctx, name, 38400, 0))
+	{
+		printf("socket: baud rate not confirmed\n");
+		errors++;
+		goto done;
+	}
+
+	if (SSCP_SerialSend(ctx, FRAME, sizeof(FRAME)) || !socketRead(ctx, DATA, sizeof(DATA)))
+	{
+		printf("socket: 0xFF or Telnet commands mishandled\n");
+		errors++;
+		goto done;
+	}
+
+	/* Wait for the reset, the next frame must find the connection broken and open a new one */
+	pfd.fd = ctx->commFd;
+	pfd.events = POLLIN;
+	poll(&pfd, 1, 2000);
+	if (SSCP_SerialSend(ctx, FRAME, sizeof(FRAME)) || !socketRead(ctx, AGAIN, sizeof(AGAIN)) || (ctx->stats.reconnects != 1))
+	{
+		printf("socket: no reconnection (%lu)\n", (unsigned long)ctx->stats.reconnects);
+		errors++;
+	}
+
+done:
+	SSCP_Free(ctx);
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+	{
+		printf("socket: server failed at step %d\n", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+		errors++;
+	}
+	return errors;
+}
+#endif
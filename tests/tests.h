@@ -0,0 +1,33 @@
+#ifndef __SSCP_HOST_TESTS_H__
+#define __SSCP_HOST_TESTS_H__
+
+#include "fixture.h"
+
+/* Each check returns the number of errors it found, and prints what they are */
+
+/* test-crypto.c */
+int checkCRC16(void);
+int checkAES(void);
+int checkAESBlocks(void);
+int checkSHA256(void);
+int checkHMACBatch(void);
+int checkProviders(void);
+int checkDRBG(void);
+int checkKeyStore(void);
+int checkSuiteBackends(void);
+
+/* test-desfire.c */
+int checkDESFire(void);
+int checkDESFireCard(void);
+
+/* test-transport.c */
+int checkLoopback(void);
+int checkLoopbackBatch(void);
+int checkBaudrate(void);
+int checkDiscover(void);
+#ifndef _WIN32
+int checkLineTime(void);
+int checkSocket(void);
+#endif
+
+#endif